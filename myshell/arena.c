@@ -0,0 +1,185 @@
+/**
+ * @file    arena.c
+ * @author  Joshua Ng
+ * @brief   A bump allocator whose allocations are released together.
+ * @date    2026-10-18
+ */
+
+#include "arena.h"
+#include "globals.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief The default size of a chunk, enough for most command lines.
+ */
+#define ARENA_CHUNK_SIZE    (64 * 1024)
+
+/**
+ * @brief The alignment of every allocation.
+ */
+#define ARENA_ALIGNMENT     16
+
+/**
+ * @brief A type with the strictest alignment, to align the chunk data.
+ */
+typedef union
+{
+    long double ld;
+    long long   ll;
+    void        *p;
+} ARENA_ALIGN;
+
+/**
+ * @brief A chunk of arena memory.
+ */
+typedef struct ARENA_CHUNK
+{
+    struct ARENA_CHUNK *next;
+    size_t size;                // Bytes available in data.
+    ARENA_ALIGN data[];
+} ARENA_CHUNK;
+
+/**
+ * @brief Allocates a new chunk after the current chunk.
+ *
+ * @param arena     The arena.
+ * @param size      The minimum size of the chunk.
+ * @return The new chunk.
+ */
+static ARENA_CHUNK *arena_chunk(ARENA *arena, size_t size)
+{
+    if (size < ARENA_CHUNK_SIZE)
+    {
+        size = ARENA_CHUNK_SIZE;
+    }
+
+    ARENA_CHUNK *chunk = malloc(sizeof(ARENA_CHUNK) + size);
+    check_allocation(chunk);
+    chunk->size = size;
+    chunk->next = NULL;
+    arena->mallocs++;
+
+    if (arena->current == NULL)
+    {
+        chunk->next = arena->head;
+        arena->head = chunk;
+    }
+    else
+    {
+        chunk->next = arena->current->next;
+        arena->current->next = chunk;
+    }
+
+    return chunk;
+}
+
+/**
+ * @brief Allocates memory from the arena.
+ *
+ * @param arena     The arena.
+ * @param size      The number of bytes.
+ * @return A pointer to the memory, valid until the arena is rewound.
+ */
+void* arena_alloc(ARENA *arena, size_t size)
+{
+    size = (size + ARENA_ALIGNMENT - 1) & ~(size_t) (ARENA_ALIGNMENT - 1);
+    arena->allocations++;
+
+    if ((arena->current == NULL) || (arena->used + size > arena->current->size))
+    {
+        // Reuse the next chunk if it is big enough.
+        ARENA_CHUNK *next = (arena->current != NULL)
+            ? arena->current->next
+            : arena->head;
+
+        if ((next == NULL) || (next->size < size))
+        {
+            next = arena_chunk(arena, size);
+        }
+
+        arena->current = next;
+        arena->used = 0;
+    }
+
+    void *p = (unsigned char *) arena->current->data + arena->used;
+    arena->used += size;
+    return p;
+}
+
+/**
+ * @brief Allocates zeroed memory from the arena.
+ *
+ * @param arena     The arena.
+ * @param size      The number of bytes.
+ * @return A pointer to the memory, valid until the arena is rewound.
+ */
+void* arena_calloc(ARENA *arena, size_t size)
+{
+    return memset(arena_alloc(arena, size), 0, size);
+}
+
+/**
+ * @brief Duplicates a string into the arena.
+ *
+ * @param arena     The arena.
+ * @param string    The string to duplicate.
+ * @return The copy, valid until the arena is rewound.
+ */
+char* arena_strdup(ARENA *arena, const char *string)
+{
+    size_t size = strlen(string) + 1;
+    return memcpy(arena_alloc(arena, size), string, size);
+}
+
+/**
+ * @brief Gets the current position of the arena.
+ *
+ * @param arena     The arena.
+ * @return The mark to rewind to.
+ */
+ARENA_MARK arena_mark(ARENA *arena)
+{
+    return (ARENA_MARK){.chunk = arena->current, .used = arena->used};
+}
+
+/**
+ * @brief Releases every allocation made since the mark, in O(1).
+ *
+ * @param arena     The arena.
+ * @param mark      The mark to rewind to.
+ */
+void arena_rewind(ARENA *arena, ARENA_MARK mark)
+{
+    arena->current = mark.chunk;
+    arena->used = mark.used;
+}
+
+/**
+ * @brief Releases every allocation of the arena, in O(1).
+ *
+ * @param arena     The arena.
+ */
+void arena_reset(ARENA *arena)
+{
+    arena_rewind(arena, (ARENA_MARK){.chunk = NULL, .used = 0});
+}
+
+/**
+ * @brief Frees the arena's chunks.
+ *
+ * @param arena     The arena.
+ */
+void arena_free(ARENA *arena)
+{
+    ARENA_CHUNK *chunk = arena->head;
+
+    while (chunk != NULL)
+    {
+        ARENA_CHUNK *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+
+    *arena = (ARENA){0};
+}
@@ -1,73 +1,496 @@
 /**
  * @file    background.c
  * @author  Joshua Ng
- * @brief   Executes shell commands asynchronously.
+ * @brief   Executes shell commands asynchronously, as jobs.
  * @date    2023-09-08
  */
 
 #include "background.h"
 #include "globals.h"
 #include "hashset.h"
+#include "jobserver.h"
+#include "eventloop.h"
 #include <stdlib.h>
 #include <signal.h>
+#include <string.h>
+#include <errno.h>
 #include <unistd.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
 
-#define MIN_CAPACITY 16
+/**
+ * Jobs live in slabs of JOBS_PER_SLAB, the first preallocated, and a freed
+ * job goes on a free list for the next, so launching a job never mallocs
+ * in the steady state. Jobs are found by pid through a hashset, and kept
+ * in launch order in a list for the jobs builtin.
+ *
+ * A terminated child is an event of the event loop, not a handler. The
+ * shell reaps its children between commands, in background_reap(), and
+ * while it waits for input, in background_notify(), where it is safe to
+ * print and to update the job table. A child reaped there that is not a
+ * job, e.g. a process substitution of a command still running, is kept
+ * for its owner, whose shell_wait() claims it.
+ */
+
+#define MIN_CAPACITY    16
+#define JOBS_PER_SLAB   256
+#define JOB_COMMAND_MAX 64      // The length of a job's command kept.
+#define JOBS_DONE_MAX   1024    // Finished jobs kept for wait.
+
+typedef enum
+{
+    JOB_RUNNING = 0,
+    JOB_DONE
+} JOBSTATE;
+
+typedef struct JOB
+{
+    pid_t       pid;
+    pid_t       shell;          // The shell that started the job.
+    unsigned    id;             // The job number, as in %1.
+    JOBSTATE    state;
+    int         status;         // The wait status, once done.
+    int         token;          // The jobserver token held while running.
+    struct JOB  *prev, *next;   // Launch order, or the free list.
+    char        command[JOB_COMMAND_MAX];
+} JOB;
+
+typedef struct SLAB
+{
+    struct SLAB *next;
+    JOB         jobs[JOBS_PER_SLAB];
+} SLAB;
+
+static size_t hash_job(const void *job);
+static bool jobs_equals(const void *job1, const void *job2);
 
-static size_t hash_pid(const void *pid);
-static bool pids_equals(const void *pid1, const void *pid2);
-static void resize_pids_capacity(size_t capacity);
-static void add_pid(pid_t pid);
-static void remove_pid(pid_t pid);
-static void parent_on_child_terminate(int signum);
-static void child_terminate(int signum);
+static HASHSET jobs = {.interface = {.hash = hash_job, .equals = jobs_equals}};
 
-static HASHSET pids = {.interface = {.hash = hash_pid, .equals = pids_equals}};
+static SLAB     first_slab;             // The preallocated slab.
+static SLAB     *slabs = &first_slab;   // The slabs, of which
+static SLAB     *carved;                // those carved into free jobs.
+static JOB      *free_jobs;
+static JOB      *first_job, *last_job;  // The jobs in launch order.
+static size_t   ndone;
+static size_t   nheld;                  // The jobs holding a pipe's token,
+static pid_t    holder;                 // of this shell, not a parent's.
+static unsigned next_id = 1;
 
 /**
- * @brief Handler for when parent recieves a child has terminated signal.
- * @param signum The terminate signal enum.
+ * @brief A child reaped that is not a job, kept for its owner to claim.
  */
-static void parent_on_child_terminate(int signum)
+typedef struct
 {
-    pid_t pid = 0;
-    int status;
+    pid_t           pid;
+    int             status;
+    struct rusage   usage;
+} REAPED;
+
+static REAPED   *reaped;
+static size_t   nreaped, reaped_capacity;
+
+/**
+ * @brief Compute the hash of a job's pid.
+ * @param job The job to be hashed.
+ * @return The hash of the job.
+ */
+static size_t hash_job(const void *job)
+{
+    return (size_t) ((const JOB *) job)->pid;
+}
+
+/**
+ * @brief Check if two jobs have the same pid.
+ * @param job1 The first job.
+ * @param job2 The second job.
+ * @return True if the jobs' pids equal each other.
+ */
+static bool jobs_equals(const void *job1, const void *job2)
+{
+    return ((const JOB *) job1)->pid == ((const JOB *) job2)->pid;
+}
+
+/**
+ * @brief Resize the jobs set capacity.
+ * @param capacity The new capacity.
+ */
+static void resize_jobs_capacity(size_t capacity)
+{
+    void *elements = calloc(capacity, sizeof(void *));
+    check_allocation(elements);
+    if (jobs.capacity == 0)
+    {
+        jobs.elements = elements;
+        jobs.capacity = capacity;
+        return;
+    }
+
+    void *old = hashset_resize(&jobs, elements, capacity);
+    if (old == NULL)
+    {
+        fprintf(stderr, "%s: unable to resize jobs capacity\n", name0);
+        exit(EXIT_FAILURE);
+    }
+    free(old);
+}
 
-    // Loop through all child processes that have changed their state.
-    // WNOHANG: Return immediately if no child has changed its state.
-    while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+/**
+ * @brief Takes a job from the free list, carving the next slab into free
+ * jobs when it is empty.
+ *
+ * @return The job.
+ */
+static JOB *allocate_job(void)
+{
+    if (free_jobs == NULL)
     {
-        if (!hashset_contains(&pids, &pid))
+        SLAB *slab = (carved == NULL) ? slabs : carved->next;
+
+        if (slab == NULL)
         {
-            continue;
+            slab = malloc(sizeof(SLAB));
+            check_allocation(slab);
+            slab->next = NULL;
+            carved->next = slab;
         }
 
-        if (WIFEXITED(status))
+        for (size_t i = JOBS_PER_SLAB; i > 0; i--)
         {
-            uint8_t exitstatus = WEXITSTATUS(status);
-            printf("Child %d exited with status %d\n", pid, exitstatus);
+            slab->jobs[i - 1].next = free_jobs;
+            free_jobs = &slab->jobs[i - 1];
         }
-        else if (WIFSIGNALED(status))
+
+        carved = slab;
+    }
+
+    JOB *job = free_jobs;
+    free_jobs = job->next;
+    return job;
+}
+
+/**
+ * @brief Removes a job from the table, returning it to the free list.
+ *
+ * @param job The job to remove.
+ */
+static void remove_job(JOB *job)
+{
+    hashset_remove(&jobs, job);
+    *(job->prev ? &job->prev->next : &first_job) = job->next;
+    *(job->next ? &job->next->prev : &last_job) = job->prev;
+    ndone -= (job->state == JOB_DONE);
+
+    job->next = free_jobs;
+    free_jobs = job;
+
+    // Job numbers start again once there are no jobs.
+    if (jobs.size == 0)
+    {
+        next_id = 1;
+    }
+}
+
+/**
+ * @brief Adds a job to the table.
+ *
+ * @param pid       The job's pid.
+ * @param command   A description of the job's command.
+ * @param token     The jobserver token the job holds.
+ */
+static JOB *add_job(pid_t pid, const char *command, int token)
+{
+    if (jobs.capacity == 0)
+    {
+        resize_jobs_capacity(MIN_CAPACITY);
+    }
+
+    // The pid of a finished job, kept for wait, may be given to a new child.
+    JOB key = {.pid = pid};
+    JOB *stale = hashset_find(&jobs, &key);
+
+    if (stale != NULL)
+    {
+        remove_job(stale);
+    }
+
+    JOB *job = allocate_job();
+    *job = (JOB) {.pid = pid, .shell = getpid(), .id = next_id++,
+        .state = JOB_RUNNING, .token = token, .prev = last_job};
+
+    // A forked copy of the shell counts only the tokens of its own jobs.
+    nheld = (holder == getpid()) ? nheld : 0;
+    holder = getpid();
+    nheld += (token >= 0);
+    snprintf(job->command, sizeof(job->command), "%s", command);
+
+    *(last_job ? &last_job->next : &first_job) = job;
+    last_job = job;
+    hashset_insert(&jobs, job);
+
+    if (jobs.size > jobs.capacity / 2)
+    {
+        resize_jobs_capacity(jobs.capacity * 2);
+    }
+
+    return job;
+}
+
+/**
+ * @brief Finds a job of this shell by its pid.
+ *
+ * @param pid   The job's pid.
+ * @return The job, or NULL if there is none.
+ */
+static JOB *find_job(pid_t pid)
+{
+    JOB key = {.pid = pid};
+    JOB *job = (jobs.size > 0) ? hashset_find(&jobs, &key) : NULL;
+    return ((job != NULL) && (job->shell == getpid())) ? job : NULL;
+}
+
+/**
+ * @brief Finds a job of this shell by a %N job number or a pid.
+ *
+ * @param id    The job's number or pid.
+ * @return The job, or NULL if there is none.
+ */
+static JOB *find_job_id(const char *id)
+{
+    char *end;
+    long n = strtol(id + (id[0] == '%'), &end, 10);
+
+    if ((*end != '\0') || (n <= 0))
+    {
+        return NULL;
+    }
+
+    if (id[0] != '%')
+    {
+        return find_job((pid_t) n);
+    }
+
+    for (JOB *job = first_job; job != NULL; job = job->next)
+    {
+        if ((job->id == (unsigned) n) && (job->shell == getpid()))
         {
-            printf("Child %d killed by signal %d\n", pid, WTERMSIG(status));
+            return job;
         }
-        else
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Records that a job has finished. Finished jobs are kept for the
+ * wait builtin, up to JOBS_DONE_MAX, after which the oldest are dropped.
+ *
+ * @param job       The job.
+ * @param status    The job's wait status.
+ */
+static void job_done(JOB *job, int status)
+{
+    job->state = JOB_DONE;
+    job->status = status;
+    ndone++;
+    nheld -= (job->token >= 0);
+    jobserver_release(job->token);
+    job->token = JOBSERVER_NONE;
+
+    if (ndone <= JOBS_DONE_MAX)
+    {
+        return;
+    }
+
+    // The oldest half are dropped at once, so dropping is O(1) a job.
+    for (JOB *old = first_job; (ndone > JOBS_DONE_MAX / 2) && (old != NULL); )
+    {
+        JOB *next = old->next;
+
+        if ((old->state == JOB_DONE) && (old != job))
         {
+            remove_job(old);
+        }
+
+        old = next;
+    }
+}
+
+/**
+ * @brief Converts a job's wait status to an exit status.
+ *
+ * @param job   The job.
+ * @return The exit status.
+ */
+static int job_exitstatus(JOB *job)
+{
+    return WIFEXITED(job->status) ? WEXITSTATUS(job->status) : EXIT_FAILURE;
+}
+
+/**
+ * @brief Prints a job's number, state and command.
+ *
+ * @param job   The job.
+ */
+static void print_job(JOB *job)
+{
+    char state[32] = "Running";
+
+    if ((job->state == JOB_DONE) && WIFEXITED(job->status))
+    {
+        snprintf(state, sizeof(state), (WEXITSTATUS(job->status) == 0)
+            ? "Done" : "Exit %d", WEXITSTATUS(job->status));
+    }
+    else if (job->state == JOB_DONE)
+    {
+        snprintf(state, sizeof(state), "%s", strsignal(WTERMSIG(job->status)));
+    }
+
+    printf("[%u]  %-8d %-24s %s\n", job->id, (int) job->pid, state, job->command);
+}
+
+/**
+ * @brief Appends text to a description, as much as fits.
+ *
+ * @param buffer    The description.
+ * @param size      The size of the description's buffer.
+ * @param text      The text to append.
+ */
+static void append(char *buffer, size_t size, const char *text)
+{
+    size_t length = strlen(buffer);
+    snprintf(buffer + length, size - length, "%s", text);
+}
+
+/**
+ * @brief A piece of a description: a command-tree to describe, or text.
+ */
+typedef struct
+{
+    SHELLCMD    *t;
+    const char  *text;
+} PIECE;
+
+/**
+ * @brief Pushes a piece of a description, still to append.
+ *
+ * @param stack     The stack of pieces.
+ * @param n         The number of pieces on the stack.
+ * @param capacity  The stack's capacity, updated if it grows.
+ * @param t         The command-tree, or NULL.
+ * @param text      The text, if there is no command-tree.
+ * @return The stack, moved if it grew.
+ */
+static PIECE *push_piece(PIECE *stack, size_t *n, size_t *capacity,
+    SHELLCMD *t, const char *text)
+{
+    if (*n == *capacity)
+    {
+        *capacity = (*capacity == 0) ? MIN_CAPACITY : *capacity * 2;
+        stack = realloc(stack, *capacity * sizeof(*stack));
+        check_allocation(stack);
+    }
+
+    stack[(*n)++] = (PIECE) {.t = t, .text = text};
+    return stack;
+}
+
+/**
+ * @brief Describes a command-tree for the job table. The pieces still to
+ * append are kept on a stack, for trees of any depth, and the description
+ * ends once the buffer is full.
+ *
+ * @param t         The command-tree.
+ * @param buffer    The buffer to append the description to.
+ * @param size      The size of the buffer.
+ */
+static void describe(SHELLCMD *t, char *buffer, size_t size)
+{
+    static const char *operators[] = {"", " ; ", " && ", " || ", "", " | ", " & "};
+    PIECE *stack = NULL;
+    size_t n = 0, capacity = 0;
+
+    #define PUSH(t, text)   (stack = push_piece(stack, &n, &capacity, (t), (text)))
+
+    PUSH(t, NULL);
+
+    while ((n > 0) && (strlen(buffer) + 1 < size))
+    {
+        PIECE piece = stack[--n];
+        t = piece.t;
+
+        if (piece.text != NULL)
+        {
+            append(buffer, size, piece.text);
             continue;
         }
 
-        remove_pid(pid);
+        if (t == NULL)
+        {
+            continue;
+        }
 
-        if (pids.size == 0)
+        // The pieces are pushed last first.
+        switch (t->type)
         {
-            signal(SIGCHLD, SIG_DFL);
+        case CMD_COMMAND:
+            for (int a = 0; a < t->argc; a++)
+            {
+                append(buffer, size, (a > 0) ? " " : "");
+                append(buffer, size, t->argv[a]);
+            }
+            break;
+        case CMD_SUBSHELL:
+            append(buffer, size, "( ");
+            PUSH(NULL, " )");
+            PUSH(t->left, NULL);
+            break;
+        case CMD_IF:
+            append(buffer, size, "if ");
+            PUSH(NULL, "; fi");
+            PUSH(t->right, NULL);
+            PUSH(t->left, NULL);
+            break;
+        case CMD_THEN:
+            append(buffer, size, "; then ");
+            PUSH(t->right, NULL);
+            PUSH(NULL, (t->right != NULL) ? "; else " : "");
+            PUSH(t->left, NULL);
+            break;
+        case CMD_WHILE:
+            append(buffer, size, "while ");
+            PUSH(NULL, "; done");
+            PUSH(t->right, NULL);
+            PUSH(NULL, "; do ");
+            PUSH(t->left, NULL);
+            break;
+        case CMD_FOR:
+            append(buffer, size, "for ");
+            append(buffer, size, t->argv[0]);
+            append(buffer, size, " in");
+
+            for (int a = 1; a < t->argc; a++)
+            {
+                append(buffer, size, " ");
+                append(buffer, size, t->argv[a]);
+            }
+
+            append(buffer, size, "; do ");
+            PUSH(NULL, "; done");
+            PUSH(t->left, NULL);
+            break;
+        default:
+            PUSH(t->right, NULL);
+            PUSH(NULL, operators[t->type]);
+            PUSH(t->left, NULL);
             break;
         }
     }
+
+    #undef PUSH
+    free(stack);
 }
 
 /**
@@ -76,166 +499,441 @@ static void parent_on_child_terminate(int signum)
  */
 static void child_terminate(int signum)
 {
-    exit(EXIT_SUCCESS);
+    _exit(EXIT_SUCCESS);
+}
+
+/**
+ * @brief Takes a jobserver token for a job, waiting for one to be free.
+ * The shell's jobs that finish meanwhile are reaped, and give theirs back.
+ *
+ * @return The token, or JOBSERVER_NONE if there is no jobserver.
+ */
+int background_token(void)
+{
+    if (!jobserver_active())
+    {
+        return JOBSERVER_NONE;
+    }
+
+    eventloop_init();
+    int token;
+
+    while ((token = jobserver_acquire()) == JOBSERVER_NONE)
+    {
+        if (eventloop_wait(jobserver_fd(), EVENT_INPUT | EVENT_CHILD)
+            & EVENT_CHILD)
+        {
+            background_notify();
+        }
+    }
+
+    return token;
 }
 
 /**
- * @brief Executes a background shell command.
- * 
+ * @brief Executes a background shell command. Under a jobserver the job
+ * first takes a token, which it gives back when reaped.
+ *
  * @param t     The shell command.
  * @return The exit status.
  */
 int background_shellcmd(SHELLCMD *t)
 {
-    signal(SIGCHLD, parent_on_child_terminate);
-    pid_t fpid = fork();
-    check_error(fpid);
+    // A child that terminates from now on is an event.
+    eventloop_init();
+    int token = background_token();
+
+    pid_t fpid = shell_fork();
 
     if (fpid == 0)                  // Child process
     {
-        signal(SIGCHLD, SIG_DFL);
         signal(SIGTERM, child_terminate);
         int exitstatus = EXIT_SUCCESS;
 
         if (t != NULL)
         {
+            finalcommand = true;
             exitstatus = execute_shellcmd(t);
         }
 
-        exit(exitstatus);
+        shell_exit(exitstatus);
+    }
+
+    char command[JOB_COMMAND_MAX] = "";
+    describe(t, command, sizeof(command));
+    JOB *job = add_job(fpid, command, token);
+
+    if (interactive)
+    {
+        fprintf(stderr, "[%u] %d\n", job->id, (int) fpid);
     }
 
-    add_pid(fpid);
     return EXIT_SUCCESS;
 }
 
 /**
- * @brief Handles terminating all background processes.
+ * @brief Keeps a reaped child that is not a job for its owner, who claims
+ * it with background_claim().
+ *
+ * @param pid       The child's pid.
+ * @param status    The child's wait status.
+ * @param usage     The child's resource usage.
  */
-void background_exit(void)
+void background_unowned(pid_t pid, int status, const struct rusage *usage)
 {
-    ITERATOR it = hashset_iterator(&pids);
+    if (nreaped == reaped_capacity)
+    {
+        reaped_capacity = (reaped_capacity == 0) ? 4 : 2 * reaped_capacity;
+        reaped = realloc(reaped, reaped_capacity * sizeof(*reaped));
+        check_allocation(reaped);
+    }
+
+    reaped[nreaped++] = (REAPED) {.pid = pid, .status = status,
+        .usage = *usage};
+}
 
-    while (it.has_next(&it))
+/**
+ * @brief Claims a child that was reaped while the shell waited for
+ * another.
+ *
+ * @param pid       The child's pid.
+ * @param status    Set to the child's wait status.
+ * @param usage     Set to the child's resource usage.
+ * @return True if the child was reaped, false if it is still to wait for.
+ */
+bool background_claim(pid_t pid, int *status, struct rusage *usage)
+{
+    for (size_t i = 0; i < nreaped; i++)
     {
-        pid_t *pid = (pid_t *) it.next(&it);
-        kill(*pid, SIGTERM);
-        free(pid);
+        if (reaped[i].pid == pid)
+        {
+            *status = reaped[i].status;
+            *usage = reaped[i].usage;
+            reaped[i] = reaped[--nreaped];
+            return true;
+        }
     }
 
-    pids.size = 0;
-    pids.capacity = 0;
-    free(pids.elements);
-    pids.elements = NULL;
+    return false;
 }
 
 /**
- * @brief Compute the hash of a pid
- * @param pid The pid to be hashed.
- * @return The hash of the pid.
+ * @brief Records a reaped child, if it is a job, and notifies it if
+ * interactive.
+ *
+ * @param pid       The child's pid.
+ * @param status    The child's wait status.
+ * @return True if the child was a job.
  */
-static size_t hash_pid(const void *pid)
+static bool reaped_job(pid_t pid, int status)
 {
-    return (size_t) *(pid_t *)pid;
+    JOB *job = find_job(pid);
+
+    if (job == NULL)
+    {
+        return false;
+    }
+
+    job_done(job, status);
+
+    if (interactive)
+    {
+        print_job(job);
+        remove_job(job);
+    }
+
+    return true;
 }
 
 /**
- * @brief Check if two pids are equal.
- * @param pid1 The first pid.
- * @param pid2 The second pid.
- * @return True if the pids equal each other.
+ * @brief Reaps the finished jobs, once a child has terminated, and
+ * notifies them if interactive. Called while the shell waits for input.
  */
-static bool pids_equals(const void *pid1, const void *pid2)
+void background_notify(void)
 {
-    return *(pid_t *)pid1 == *(pid_t *)pid2;
+    pid_t pid;
+    int status;
+    struct rusage usage;
+
+    while ((pid = wait4(-1, &status, WNOHANG, &usage)) > 0)
+    {
+        if (!reaped_job(pid, status))
+        {
+            background_unowned(pid, status, &usage);
+        }
+    }
+
+    fflush(stdout);
 }
 
 /**
- * @brief Resize the pids set capacity.
- * @param capacity The new capacity.
+ * @brief Reaps the finished jobs, if a child has terminated, and notifies
+ * them if interactive. Called between commands.
  */
-static void resize_pids_capacity(size_t capacity)
+void background_reap(void)
 {
-    void *elements = calloc(capacity, sizeof(void *));
-    check_allocation(elements);
-    if (pids.capacity == 0)
+    if (eventloop_take(EVENT_CHILD))
     {
-        pids.elements = elements;
-        pids.capacity = capacity;
-        return;
+        background_notify();
     }
+}
 
-    void *old = hashset_resize(&pids, elements, capacity);
-    if (old == NULL)
+/**
+ * @brief Waits, in the event loop, for a child of the shell that is not a
+ * job to terminate, e.g. one of parallel's. Jobs that finish meanwhile
+ * are recorded as by background_reap(). A child the caller does not own
+ * is handed back with background_unowned().
+ *
+ * @param status    Set to the child's wait status.
+ * @param usage     Set to the child's resource usage.
+ * @return The child's pid, or -1 if the shell has no children.
+ */
+pid_t background_wait(int *status, struct rusage *usage)
+{
+    // A child that terminates after the first wait4 is an event.
+    eventloop_init();
+
+    for (;;)
     {
-        fprintf(stderr, "%s: unable to resize pids capacity\n", name0);
-        exit(EXIT_FAILURE);
+        pid_t pid = wait4(-1, status, WNOHANG, usage);
+
+        if (pid > 0)
+        {
+            if (!reaped_job(pid, *status))
+            {
+                return pid;
+            }
+
+            continue;
+        }
+
+        if ((pid == -1) && (errno != EINTR))
+        {
+            return -1;
+        }
+
+        // A SIGCHLD since the wait4 is pending, so the wait returns.
+        eventloop_wait(-1, EVENT_CHILD);
     }
-    free(old);
 }
 
 /**
- * @brief Adds a pid to the hashset.
- * @param pid The pid to add.
+ * @brief Waits for a running job to finish, and records it as done, which
+ * gives back its token.
+ *
+ * @param job   The job.
  */
-static void add_pid(pid_t pid)
+static void reap_job(JOB *job)
 {
-    if (pids.capacity == 0)
+    int status = 0;
+
+    while ((waitpid(job->pid, &status, 0) == -1) && (errno == EINTR))
     {
-        resize_pids_capacity(MIN_CAPACITY);
+        continue;
     }
-    else if (pids.capacity == pids.size)
+
+    job_done(job, status);
+}
+
+/**
+ * @brief Waits for this shell's running jobs, or only those that hold a
+ * jobserver token. A job done may drop older ones from the list, so the
+ * list is walked again from the start after each.
+ *
+ * @param tokens    True to wait only for the jobs that hold a token.
+ */
+static void reap_running(bool tokens)
+{
+    JOB *job = first_job;
+
+    while (job != NULL)
     {
-        resize_pids_capacity(pids.capacity * 2);
+        if ((job->shell == getpid()) && (job->state == JOB_RUNNING)
+            && (!tokens || (job->token >= 0)))
+        {
+            reap_job(job);
+            job = first_job;
+            continue;
+        }
+
+        job = job->next;
+    }
+}
+
+/**
+ * @brief Waits for a job to finish, unless it has.
+ *
+ * @param job   The job.
+ * @return The job's exit status.
+ */
+static int wait_job(JOB *job)
+{
+    if (job->state == JOB_RUNNING)
+    {
+        reap_job(job);
     }
-    
-    pid_t *new_pid = malloc(sizeof(pid_t));
-    *new_pid = pid;
-    HASHSET_RESULT result = hashset_insert(&pids, new_pid);
-    
-    if (result.success)
+
+    int exitstatus = job_exitstatus(job);
+    remove_job(job);
+    return exitstatus;
+}
+
+/**
+ * @brief Handles the jobs command. Lists this shell's jobs, forgetting
+ * those listed as finished.
+ *
+ * @param t     The jobs shellcmd to handle.
+ * @return The exitstatus of the operation.
+ */
+int jobs_shellcmd(SHELLCMD *t)
+{
+    background_reap();
+
+    for (JOB *job = first_job, *next; job != NULL; job = next)
     {
-        if (pids.size > pids.capacity / 2)
+        next = job->next;
+
+        if (job->shell == getpid())
         {
-            resize_pids_capacity(pids.capacity * 2);
+            print_job(job);
+
+            if (job->state == JOB_DONE)
+            {
+                remove_job(job);
+            }
         }
     }
-    else
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Handles the wait command. Waits for the given jobs, as %N or
+ * pids, or else all of this shell's jobs.
+ *
+ * @param t     The wait shellcmd to handle.
+ * @return The exit status of the last job waited for.
+ */
+int wait_shellcmd(SHELLCMD *t)
+{
+    int exitstatus = EXIT_SUCCESS;
+
+    if (t->argc == 1)
     {
-        free(new_pid);
+        for (JOB *job = first_job, *next; job != NULL; job = next)
+        {
+            next = job->next;
+
+            if (job->shell == getpid())
+            {
+                wait_job(job);
+            }
+        }
+
+        return EXIT_SUCCESS;
     }
+
+    for (int a = 1; a < t->argc; a++)
+    {
+        JOB *job = find_job_id(t->argv[a]);
+
+        if (job == NULL)
+        {
+            fprintf(stderr, "%s: %s: no such job\n", t->argv[0], t->argv[a]);
+            exitstatus = 127;
+            continue;
+        }
+
+        exitstatus = wait_job(job);
+    }
+
+    return exitstatus;
 }
 
 /**
- * @brief Removes a pid from the hashset.
- * 
- * @param pid The pid to remove.
+ * @brief Handles the fg command. There is no job control, so the job,
+ * the given %N or pid or else the latest, is waited for in the foreground.
+ *
+ * @param t     The fg shellcmd to handle.
+ * @return The exit status of the job.
  */
-static void remove_pid(pid_t pid)
+int fg_shellcmd(SHELLCMD *t)
 {
-    HASHSET_RESULT result = hashset_remove(&pids, &pid);
-    if (!result.success)
-        return;
-    
-    free(result.element);
-    
-    if (pids.size == 0)
-    {
-        free(pids.elements);
-        pids.elements = NULL;
-        pids.capacity = 0;
-        return;
+    JOB *job = NULL;
+
+    if (t->argc > 1)
+    {
+        job = find_job_id(t->argv[1]);
     }
-    
-    if ((pids.size < pids.capacity / 8) && (pids.capacity > MIN_CAPACITY))
+    else
     {
-        size_t capacity = pids.capacity / 2;
-        if (capacity < MIN_CAPACITY)
-            capacity = MIN_CAPACITY;
+        for (JOB *last = last_job; (last != NULL) && (job == NULL); last = last->prev)
+        {
+            job = (last->shell == getpid()) ? last : NULL;
+        }
+    }
 
-        resize_pids_capacity(capacity);
+    if (job == NULL)
+    {
+        fprintf(stderr, "%s: %s: no such job\n", t->argv[0],
+            (t->argc > 1) ? t->argv[1] : "current");
+        return EXIT_FAILURE;
     }
+
+    printf("%s\n", job->command);
+    fflush(stdout);
+    return wait_job(job);
 }
 
+/**
+ * @brief Forgets every job, e.g. for a script run in a copy of the shell,
+ * which has none of its own. The jobs' tokens are the shell's to give back.
+ */
+void background_reset(void)
+{
+    while (first_job != NULL)
+    {
+        remove_job(first_job);
+    }
+}
 
+/**
+ * @brief Handles terminating all background processes. Each gives back
+ * its jobserver token once it is reaped, not while it may still run.
+ */
+void background_exit(void)
+{
+    for (JOB *job = first_job; job != NULL; job = job->next)
+    {
+        if ((job->shell == getpid()) && (job->state == JOB_RUNNING))
+        {
+            kill(job->pid, SIGTERM);
+        }
+    }
+
+    reap_running(false);
+}
 
+/**
+ * @brief Waits, as the shell exits, for its jobs still holding a jobserver
+ * token, so that every token it took goes back to the jobserver. Jobs
+ * without a token are left running.
+ */
+void background_release(void)
+{
+    if (background_holding())
+    {
+        reap_running(true);
+    }
+}
+
+/**
+ * @brief Checks if any job holds a token from the jobserver's pipe, which
+ * the shell must give back before it is replaced by a command.
+ *
+ * @return True if a job holds a token.
+ */
+bool background_holding(void)
+{
+    return (holder == getpid()) && (nheld > 0);
+}
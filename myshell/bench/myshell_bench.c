@@ -0,0 +1,1078 @@
+/**
+ * @file    myshell_bench.c
+ * @author  Joshua Ng
+ * @brief   Benchmarks for myshell's performance sensitive paths. Each
+ *          result is also recorded, and written as JSON with --json FILE,
+ *          so that runs can be compared.
+ * @date    2026-10-18
+ */
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/wait.h>
+
+extern char **environ;
+
+/**
+ * @brief The resident memory the spawn benchmark grows to, to mimic a
+ * shell that has grown its heap.
+ */
+#define SPAWN_RSS_MB        100
+#define SPAWN_ITERATIONS    2000
+#define SPAWN_COMMAND       "/bin/true"
+
+/**
+ * @brief The number of times the script benchmark calls a trivial script.
+ */
+#define SCRIPT_CALLS        10000
+#define SCRIPT_BODY         "cd .\n"
+
+/**
+ * @brief The number of test and echo calls of the builtins benchmark.
+ */
+#define BUILTIN_CALLS       100000
+
+/**
+ * @brief The number of command substitutions of the substitution
+ * benchmark.
+ */
+#define SUBSTITUTION_CALLS  100000
+
+/**
+ * @brief The number of lines of the script the cache benchmark runs.
+ */
+#define CACHE_LINES         50000
+
+/**
+ * @brief The number of /bin/true commands the true benchmark runs.
+ */
+#define TRUE_CALLS          2000
+
+/**
+ * @brief The data streamed through cat | cat | cat, a sparse file, so
+ * that its reads cost no disk.
+ */
+#define PIPELINE_MB         1024
+
+/**
+ * @brief The number of lines of the parser benchmark's synthetic script.
+ */
+#define PARSER_LINES        200000
+
+/**
+ * @brief The number of times the startup benchmark runs a trivial script.
+ */
+#define STARTUP_RUNS        200
+
+/**
+ * @brief The number of background jobs the reap benchmark starts.
+ */
+#define REAP_JOBS           2000
+
+/**
+ * @brief The number of ;-separated true builtins on the sequence
+ * benchmark's one line.
+ */
+#define SEQUENCE_COMMANDS   100000
+
+/**
+ * @brief The depth of the loop benchmark's nested for loops, each over
+ * the ten digits, for 10^LOOP_DEPTH iterations of its body.
+ */
+#define LOOP_DEPTH          6
+
+/**
+ * @brief The number of subshells of builtins the subshell benchmark runs.
+ */
+#define SUBSHELL_COUNT      10000
+
+/**
+ * @brief The number of background jobs the idle benchmark starts, which
+ * finish after its input goes quiet, and how long it is measured quiet for.
+ */
+#define IDLE_JOBS           200
+#define IDLE_COMMAND        "/bin/sleep 0.2"
+#define IDLE_MSEC           500
+
+/**
+ * @brief The most results recorded.
+ */
+#define MAX_RESULTS         64
+
+/**
+ * @brief The shell to benchmark, overridden by the MYSHELL environment
+ * variable.
+ */
+#ifndef MYSHELL_PATH
+#define MYSHELL_PATH        "./myshell"
+#endif
+
+/**
+ * @brief A result, recorded to be written as JSON.
+ */
+typedef struct
+{
+    const char  *benchmark;
+    const char  *metric;
+    double      value;
+    const char  *unit;
+} RESULT;
+
+static RESULT results[MAX_RESULTS];
+static int nresults = 0;
+
+/**
+ * @brief Records a result.
+ *
+ * @param benchmark The benchmark's name.
+ * @param metric    What was measured.
+ * @param value     The measurement.
+ * @param unit      The unit of the measurement.
+ */
+static void record(const char *benchmark, const char *metric, double value,
+    const char *unit)
+{
+    if (nresults < MAX_RESULTS)
+    {
+        results[nresults++] = (RESULT) {benchmark, metric, value, unit};
+    }
+}
+
+/**
+ * @brief Writes the results recorded as JSON.
+ *
+ * @param path  The file to write.
+ */
+static void write_json(const char *path)
+{
+    FILE *fp = fopen(path, "w");
+
+    if (fp == NULL)
+    {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+
+    fprintf(fp, "{\n  \"results\": [\n");
+
+    for (int i = 0; i < nresults; i++)
+    {
+        fprintf(fp, "    {\"benchmark\": \"%s\", \"metric\": \"%s\", "
+            "\"value\": %.6g, \"unit\": \"%s\"}%s\n", results[i].benchmark,
+            results[i].metric, results[i].value, results[i].unit,
+            (i + 1 < nresults) ? "," : "");
+    }
+
+    fprintf(fp, "  ]\n}\n");
+    fclose(fp);
+}
+
+/**
+ * @brief Reads the monotonic clock.
+ *
+ * @return The time in seconds.
+ */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Launches a command the way myshell used to, fork then execv.
+ *
+ * @param argv  The command's argument vector.
+ */
+static void launch_fork(char *argv[])
+{
+    pid_t pid = fork();
+
+    if (pid == 0)
+    {
+        execv(argv[0], argv);
+        _exit(EXIT_FAILURE);
+    }
+
+    waitpid(pid, NULL, 0);
+}
+
+/**
+ * @brief Launches a command the way myshell does, with posix_spawn.
+ *
+ * @param argv  The command's argument vector.
+ */
+static void launch_spawn(char *argv[])
+{
+    pid_t pid;
+
+    if (posix_spawn(&pid, argv[0], NULL, NULL, argv, environ) == 0)
+    {
+        waitpid(pid, NULL, 0);
+    }
+}
+
+/**
+ * @brief Times a launch function.
+ *
+ * @param launch    The launch function.
+ * @param argv      The command's argument vector.
+ * @return The mean latency per launch in microseconds.
+ */
+static double time_launch(void (*launch)(char *[]), char *argv[])
+{
+    double start = now();
+
+    for (int i = 0; i < SPAWN_ITERATIONS; i++)
+    {
+        launch(argv);
+    }
+
+    return (now() - start) * 1e6 / SPAWN_ITERATIONS;
+}
+
+/**
+ * @brief Compares fork+execv against posix_spawn latency from a process
+ * with SPAWN_RSS_MB of resident memory.
+ */
+static void bench_spawn(void)
+{
+    size_t size = (size_t) SPAWN_RSS_MB << 20;
+    char *heap = malloc(size);
+
+    if (heap == NULL)
+    {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    memset(heap, 1, size);  // Touch every page so it is resident.
+    char *argv[] = {SPAWN_COMMAND, NULL};
+
+    double forked = time_launch(launch_fork, argv);
+    double spawned = time_launch(launch_spawn, argv);
+
+    printf("spawn: %s with %d MB RSS, %d iterations\n",
+        SPAWN_COMMAND, SPAWN_RSS_MB, SPAWN_ITERATIONS);
+    printf("  fork+execv   %8.1f usec\n", forked);
+    printf("  posix_spawn  %8.1f usec\n", spawned);
+    record("spawn", "fork+execv", forked, "usec");
+    record("spawn", "posix_spawn", spawned, "usec");
+    free(heap);
+}
+
+/**
+ * @brief Writes a file.
+ *
+ * @param path      The file's path.
+ * @param text      The text to write.
+ * @param count     The number of times to write the text.
+ */
+static void write_file(const char *path, const char *text, int count)
+{
+    FILE *fp = fopen(path, "w");
+
+    if (fp == NULL)
+    {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        fputs(text, fp);
+    }
+
+    fclose(fp);
+}
+
+/**
+ * @brief Runs the shell, with its arguments, its stdin read from a file,
+ * and its stdout discarded.
+ *
+ * @param argv      The shell's argument vector.
+ * @param input     The path of the shell's input.
+ * @return The time taken in seconds.
+ */
+static double time_command(char *argv[], const char *input)
+{
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, input, O_RDONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null",
+        O_WRONLY, 0);
+
+    double start = now();
+    pid_t pid;
+
+    if (posix_spawn(&pid, argv[0], &actions, NULL, argv, environ) != 0)
+    {
+        perror(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    waitpid(pid, NULL, 0);
+    posix_spawn_file_actions_destroy(&actions);
+    return now() - start;
+}
+
+/**
+ * @brief Runs the shell with its stdin read from a file, and its stdout
+ * discarded.
+ *
+ * @param shell     The shell's path.
+ * @param input     The path of the shell's input.
+ * @return The time taken in seconds.
+ */
+static double time_shell(char *shell, const char *input)
+{
+    char *argv[] = {shell, NULL};
+    return time_command(argv, input);
+}
+
+/**
+ * @brief Gets the real path of the shell to benchmark.
+ *
+ * @return A memory allocated path.
+ */
+static char *shell_path(void)
+{
+    char *shell = getenv("MYSHELL");
+    shell = realpath((shell != NULL) ? shell : MYSHELL_PATH, NULL);
+
+    if (shell == NULL)
+    {
+        perror(MYSHELL_PATH);
+        exit(EXIT_FAILURE);
+    }
+
+    return shell;
+}
+
+/**
+ * @brief Makes and enters a temporary directory.
+ *
+ * @param directory     The directory's template, replaced by its path.
+ */
+static void enter_temporary(char *directory)
+{
+    if ((mkdtemp(directory) == NULL) || (chdir(directory) != 0))
+    {
+        perror(directory);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * @brief Compares calling a trivial script in a forked copy of the shell
+ * against re-executing the shell binary with the script as its input,
+ * which is how myshell used to run scripts.
+ */
+static void bench_script(void)
+{
+    char *shell = shell_path();
+    char directory[] = "/tmp/myshell_bench.XXXXXX";
+    enter_temporary(directory);
+
+    char reexec[PATH_MAX + 32];
+    snprintf(reexec, sizeof(reexec), "%s < trivial.sh\n", shell);
+    write_file("trivial.sh", SCRIPT_BODY, 1);
+    write_file("inprocess.in", "./trivial.sh\n", SCRIPT_CALLS);
+    write_file("reexec.in", reexec, SCRIPT_CALLS);
+
+    double forked = time_shell(shell, "inprocess.in");
+    double executed = time_shell(shell, "reexec.in");
+
+    printf("script: %s, %d calls of a trivial script\n", shell, SCRIPT_CALLS);
+    printf("  re-exec      %8.1f usec/call  %8.3f sec\n",
+        executed * 1e6 / SCRIPT_CALLS, executed);
+    printf("  in-process   %8.1f usec/call  %8.3f sec\n",
+        forked * 1e6 / SCRIPT_CALLS, forked);
+    record("script", "re-exec", executed * 1e6 / SCRIPT_CALLS, "usec/call");
+    record("script", "in-process", forked * 1e6 / SCRIPT_CALLS, "usec/call");
+
+    unlink("trivial.sh");
+    unlink("inprocess.in");
+    unlink("reexec.in");
+    rmdir(directory);
+    free(shell);
+}
+
+/**
+ * @brief Compares a script of test and echo calls run with the builtins
+ * against the same script calling the test and echo binaries.
+ */
+static void bench_builtins(void)
+{
+    char *shell = shell_path();
+    char directory[] = "/tmp/myshell_bench.XXXXXX";
+    enter_temporary(directory);
+
+    const char *names[] = {"builtins", "binaries"};
+    const char *scripts[][2] =
+    {
+        {"test -n word && [ 1 -lt 2 ]\n", "echo word\n"},
+        {"/usr/bin/test -n word && /usr/bin/[ 1 -lt 2 ]\n", "/bin/echo word\n"},
+    };
+
+    printf("builtins: %s, %d test and echo calls\n", shell, BUILTIN_CALLS);
+
+    for (int i = 0; i < 2; i++)
+    {
+        FILE *fp = fopen("calls.in", "w");
+
+        if (fp == NULL)
+        {
+            perror("calls.in");
+            exit(EXIT_FAILURE);
+        }
+
+        // Each test line calls test twice.
+        for (int call = 0; call < BUILTIN_CALLS; call += 3)
+        {
+            fputs(scripts[i][0], fp);
+            fputs(scripts[i][1], fp);
+        }
+
+        fclose(fp);
+        double elapsed = time_shell(shell, "calls.in");
+        printf("  %-10s %8.2f usec/call  %8.3f sec\n", names[i],
+            elapsed * 1e6 / BUILTIN_CALLS, elapsed);
+        record("builtins", names[i], elapsed * 1e6 / BUILTIN_CALLS, "usec/call");
+    }
+
+    unlink("calls.in");
+    rmdir(directory);
+    free(shell);
+}
+
+/**
+ * @brief Compares command substitutions of the pwd and echo builtins,
+ * which run in the shell, against substitutions of their binaries, each a
+ * forked child.
+ */
+static void bench_substitution(void)
+{
+    char *shell = shell_path();
+    char directory[] = "/tmp/myshell_bench.XXXXXX";
+    enter_temporary(directory);
+
+    const char *names[] = {"builtins", "binaries"};
+    const char *lines[] =
+    {
+        "true $(pwd) $(echo word)\n",
+        "true $(/bin/pwd) $(/bin/echo word)\n",
+    };
+
+    printf("substitution: %s, %d pwd and echo substitutions\n", shell,
+        SUBSTITUTION_CALLS);
+
+    for (int i = 0; i < 2; i++)
+    {
+        // The binaries fork, so they run a hundredth as many.
+        int calls = (i == 0) ? SUBSTITUTION_CALLS : SUBSTITUTION_CALLS / 100;
+        write_file("calls.in", lines[i], calls / 2);
+        double elapsed = time_shell(shell, "calls.in");
+        printf("  %-10s %8.2f usec/call  %8.3f sec for %d\n", names[i],
+            elapsed * 1e6 / calls, elapsed, calls);
+        record("substitution", names[i], elapsed * 1e6 / calls, "usec/call");
+    }
+
+    unlink("calls.in");
+    rmdir(directory);
+    free(shell);
+}
+
+/**
+ * @brief Runs a script, whose first command writes to stdout, and times
+ * the first command and the whole script.
+ *
+ * @param argv      The shell's argument vector.
+ * @param first     Set to the time to the first command in seconds.
+ * @return The time taken in seconds.
+ */
+static double time_script(char *argv[], double *first)
+{
+    int fd[2];
+
+    if (pipe(fd) != 0)
+    {
+        perror("pipe");
+        exit(EXIT_FAILURE);
+    }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fd[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addclose(&actions, fd[0]);
+
+    double start = now();
+    pid_t pid;
+
+    if (posix_spawn(&pid, argv[0], &actions, NULL, argv, environ) != 0)
+    {
+        perror(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    close(fd[1]);
+    char buffer[256];
+    *first = 0;
+
+    while (read(fd[0], buffer, sizeof(buffer)) > 0)
+    {
+        *first = (*first == 0) ? now() - start : *first;
+    }
+
+    waitpid(pid, NULL, 0);
+    double total = now() - start;
+    close(fd[0]);
+    posix_spawn_file_actions_destroy(&actions);
+    return total;
+}
+
+/**
+ * @brief Compares running a large script parsed, parsed and cached, and
+ * from its cache.
+ */
+static void bench_cache(void)
+{
+    char *shell = shell_path();
+    char directory[] = "/tmp/myshell_bench.XXXXXX";
+    enter_temporary(directory);
+    setenv("XDG_CACHE_HOME", directory, 1);
+
+    FILE *fp = fopen("large.sh", "w");
+
+    if (fp == NULL)
+    {
+        perror("large.sh");
+        exit(EXIT_FAILURE);
+    }
+
+    fputs("/bin/echo first\n", fp);
+
+    for (int i = 1; i < CACHE_LINES; i++)
+    {
+        fprintf(fp, "cd . && cd ./ || cd %d > /dev/null # comment %d\n", i, i);
+    }
+
+    fclose(fp);
+
+    const char *names[] = {"no cache", "cold", "warm"};
+    char *nocache[] = {shell, "--no-cache", "large.sh", NULL};
+    char *cached[] = {shell, "large.sh", NULL};
+
+    printf("cache: %s, %d line script\n", shell, CACHE_LINES);
+
+    for (int i = 0; i < 3; i++)
+    {
+        double first;
+        double total = time_script((i == 0) ? nocache : cached, &first);
+        printf("  %-10s first command %8.2f msec  total %8.2f msec\n",
+            names[i], first * 1e3, total * 1e3);
+        record("cache", names[i], total * 1e3, "msec");
+    }
+
+    system("rm -rf myshell");
+    unlink("large.sh");
+    rmdir(directory);
+    free(shell);
+}
+
+/**
+ * @brief Measures the latency of an external command run by the shell,
+ * from a script of /bin/true commands.
+ */
+static void bench_true(void)
+{
+    char *shell = shell_path();
+    char directory[] = "/tmp/myshell_bench.XXXXXX";
+    enter_temporary(directory);
+
+    write_file("calls.in", SPAWN_COMMAND "\n", TRUE_CALLS);
+    double elapsed = time_shell(shell, "calls.in");
+
+    printf("true: %s, %d %s commands\n", shell, TRUE_CALLS, SPAWN_COMMAND);
+    printf("  latency      %8.1f usec/command\n", elapsed * 1e6 / TRUE_CALLS);
+    record("true", "latency", elapsed * 1e6 / TRUE_CALLS, "usec");
+
+    unlink("calls.in");
+    rmdir(directory);
+    free(shell);
+}
+
+/**
+ * @brief Measures the throughput of a pipeline of three cats, streaming
+ * PIPELINE_MB of a sparse file.
+ */
+static void bench_pipeline(void)
+{
+    char *shell = shell_path();
+    char directory[] = "/tmp/myshell_bench.XXXXXX";
+    enter_temporary(directory);
+
+    off_t size = (off_t) PIPELINE_MB << 20;
+    int fd = open("data", O_WRONLY | O_CREAT | O_TRUNC, 0600);
+
+    if ((fd == -1) || (ftruncate(fd, size) != 0))
+    {
+        perror("data");
+        exit(EXIT_FAILURE);
+    }
+
+    close(fd);
+    write_file("pipeline.in", "cat data | cat | cat > /dev/null\n", 1);
+    double elapsed = time_shell(shell, "pipeline.in");
+
+    printf("pipeline: %s, cat | cat | cat of %d MB\n", shell, PIPELINE_MB);
+    printf("  throughput   %8.2f GB/s  %8.3f sec\n", size / elapsed / 1e9, elapsed);
+    record("pipeline", "throughput", size / elapsed / 1e9, "GB/s");
+
+    unlink("data");
+    unlink("pipeline.in");
+    rmdir(directory);
+    free(shell);
+}
+
+/**
+ * @brief Measures the parser's throughput, from a synthetic script read
+ * by parse_shellcmd(), which the shell run with -n parses but does not
+ * execute.
+ */
+static void bench_parser(void)
+{
+    char *shell = shell_path();
+    char directory[] = "/tmp/myshell_bench.XXXXXX";
+    enter_temporary(directory);
+
+    const char *lines[] =
+    {
+        "cd /tmp && ls -l src include | sort -r > listing.txt\n",
+        "echo \"quoted $HOME words\" 'single quoted' escaped\\ word ; true\n",
+        "(cd build || exit 1) && make -j 4 all >> build.log &\n",
+        "X=value Y=\"two words\" command arg1 arg2 < input.txt\n",
+        "diff <(sort a.txt) <(sort b.txt) || echo $(date) ${PWD} # comment\n",
+        "cp src/*.c src/**/*.h backup/ ; wc -l [a-m]*.txt\n",
+    };
+    size_t nlines = sizeof(lines) / sizeof(lines[0]);
+    FILE *fp = fopen("synthetic.sh", "w");
+
+    if (fp == NULL)
+    {
+        perror("synthetic.sh");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < PARSER_LINES; i++)
+    {
+        fputs(lines[i % nlines], fp);
+    }
+
+    fclose(fp);
+    char *argv[] = {shell, "-n", NULL};
+    double elapsed = time_command(argv, "synthetic.sh");
+
+    printf("parser: %s -n, %d line synthetic script\n", shell, PARSER_LINES);
+    printf("  throughput   %8.0f lines/sec  %8.3f sec\n",
+        PARSER_LINES / elapsed, elapsed);
+    record("parser", "throughput", PARSER_LINES / elapsed, "lines/sec");
+
+    unlink("synthetic.sh");
+    rmdir(directory);
+    free(shell);
+}
+
+/**
+ * @brief Measures the startup time of the shell running a trivial script
+ * named on its command-line.
+ */
+static void bench_startup(void)
+{
+    char *shell = shell_path();
+    char directory[] = "/tmp/myshell_bench.XXXXXX";
+    enter_temporary(directory);
+    setenv("XDG_CACHE_HOME", directory, 1);
+
+    write_file("trivial.sh", SCRIPT_BODY, 1);
+    char *argv[] = {shell, "trivial.sh", NULL};
+    double elapsed = 0;
+
+    for (int i = 0; i < STARTUP_RUNS; i++)
+    {
+        elapsed += time_command(argv, "/dev/null");
+    }
+
+    printf("startup: %s trivial.sh, %d runs\n", shell, STARTUP_RUNS);
+    printf("  startup      %8.3f msec/run\n", elapsed * 1e3 / STARTUP_RUNS);
+    record("startup", "script", elapsed * 1e3 / STARTUP_RUNS, "msec");
+
+    system("rm -rf myshell");
+    unlink("trivial.sh");
+    rmdir(directory);
+    free(shell);
+}
+
+/**
+ * @brief Measures the rate at which the shell starts and reaps background
+ * jobs, from a script of /bin/true jobs, then wait.
+ */
+static void bench_reap(void)
+{
+    char *shell = shell_path();
+    char directory[] = "/tmp/myshell_bench.XXXXXX";
+    enter_temporary(directory);
+
+    FILE *fp = fopen("jobs.in", "w");
+
+    if (fp == NULL)
+    {
+        perror("jobs.in");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < REAP_JOBS; i++)
+    {
+        fputs(SPAWN_COMMAND " &\n", fp);
+    }
+
+    fputs("wait\n", fp);
+    fclose(fp);
+    double elapsed = time_shell(shell, "jobs.in");
+
+    printf("reap: %s, %d background jobs\n", shell, REAP_JOBS);
+    printf("  rate         %8.0f jobs/sec  %8.3f sec\n", REAP_JOBS / elapsed, elapsed);
+    record("reap", "rate", REAP_JOBS / elapsed, "jobs/sec");
+
+    unlink("jobs.in");
+    rmdir(directory);
+    free(shell);
+}
+
+/**
+ * @brief Measures a line of SEQUENCE_COMMANDS ;-separated true builtins,
+ * a command-tree as deep as it has commands.
+ */
+static void bench_sequence(void)
+{
+    char *shell = shell_path();
+    char directory[] = "/tmp/myshell_bench.XXXXXX";
+    enter_temporary(directory);
+
+    FILE *fp = fopen("sequence.in", "w");
+
+    if (fp == NULL)
+    {
+        perror("sequence.in");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < SEQUENCE_COMMANDS; i++)
+    {
+        fputs((i > 0) ? " ; true" : "true", fp);
+    }
+
+    fputc('\n', fp);
+    fclose(fp);
+    double elapsed = time_shell(shell, "sequence.in");
+
+    printf("sequence: %s, %d ;-separated commands on one line\n", shell,
+        SEQUENCE_COMMANDS);
+    printf("  line         %8.1f msec  %8.3f usec/command\n", elapsed * 1e3,
+        elapsed * 1e6 / SEQUENCE_COMMANDS);
+    record("sequence", "line", elapsed * 1e3, "msec");
+
+    unlink("sequence.in");
+    rmdir(directory);
+    free(shell);
+}
+
+/**
+ * @brief Measures 10^LOOP_DEPTH iterations of a loop body, a builtin,
+ * from nested for loops, run without parsing the body again.
+ */
+static void bench_loop(void)
+{
+    char *shell = shell_path();
+    char directory[] = "/tmp/myshell_bench.XXXXXX";
+    enter_temporary(directory);
+
+    FILE *fp = fopen("loop.in", "w");
+
+    if (fp == NULL)
+    {
+        perror("loop.in");
+        exit(EXIT_FAILURE);
+    }
+
+    int iterations = 1;
+
+    for (int i = 0; i < LOOP_DEPTH; i++)
+    {
+        fprintf(fp, "for d%d in 0 1 2 3 4 5 6 7 8 9; do ", i);
+        iterations *= 10;
+    }
+
+    fprintf(fp, "test $d%d != x", LOOP_DEPTH - 1);
+
+    for (int i = 0; i < LOOP_DEPTH; i++)
+    {
+        fputs("; done", fp);
+    }
+
+    fputc('\n', fp);
+    fclose(fp);
+    double elapsed = time_shell(shell, "loop.in");
+
+    printf("loop: %s, %d iterations of test\n", shell, iterations);
+    printf("  loop         %8.1f msec  %8.3f usec/iteration\n", elapsed * 1e3,
+        elapsed * 1e6 / iterations);
+    record("loop", "iterations", elapsed * 1e3, "msec");
+
+    unlink("loop.in");
+    rmdir(directory);
+    free(shell);
+}
+
+/**
+ * @brief Measures SUBSHELL_COUNT subshells that change directory and print
+ * it, redirected, run in the shell itself without a fork.
+ */
+static void bench_subshell(void)
+{
+    char *shell = shell_path();
+    char directory[] = "/tmp/myshell_bench.XXXXXX";
+    enter_temporary(directory);
+
+    FILE *fp = fopen("subshell.in", "w");
+
+    if (fp == NULL)
+    {
+        perror("subshell.in");
+        exit(EXIT_FAILURE);
+    }
+
+    int count = 1;
+
+    for (int i = 0; count < SUBSHELL_COUNT; i++)
+    {
+        fprintf(fp, "for d%d in 0 1 2 3 4 5 6 7 8 9; do ", i);
+        count *= 10;
+    }
+
+    fputs("( cd /; D=$d0; pwd ) > /dev/null", fp);
+
+    for (int i = 1; i < count; i *= 10)
+    {
+        fputs("; done", fp);
+    }
+
+    fputc('\n', fp);
+    fclose(fp);
+    double elapsed = time_shell(shell, "subshell.in");
+
+    printf("subshell: %s, %d of ( cd /; D=$d0; pwd ) > /dev/null\n", shell,
+        count);
+    printf("  subshell     %8.1f msec  %8.3f usec/subshell\n",
+        elapsed * 1e3, elapsed * 1e6 / count);
+    record("subshell", "subshells", elapsed * 1e3, "msec");
+
+    unlink("subshell.in");
+    rmdir(directory);
+    free(shell);
+}
+
+/**
+ * @brief Reads the CPU time a process has used, and the children it has
+ * not reaped, from /proc.
+ *
+ * @param pid       The process.
+ * @param children  Set to the children not reaped, or -1 if unknown.
+ * @return The CPU time in msec, or -1 if unknown.
+ */
+static double process_state(pid_t pid, int *children)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/task/%d/children", (int) pid,
+        (int) pid);
+    FILE *fp = fopen(path, "r");
+    int child;
+    *children = -1;
+
+    if (fp != NULL)
+    {
+        for (*children = 0; fscanf(fp, "%d", &child) == 1; (*children)++)
+        {
+            continue;
+        }
+        fclose(fp);
+    }
+
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int) pid);
+    fp = fopen(path, "r");
+    unsigned long utime, stime;
+
+    if ((fp == NULL) || (fscanf(fp, "%*d (%*[^)]) %*c %*d %*d %*d %*d %*d %*u "
+        "%*u %*u %*u %*u %lu %lu", &utime, &stime) != 2))
+    {
+        utime = stime = 0;
+        *children = (fp == NULL) ? *children : -1;
+    }
+
+    if (fp != NULL)
+    {
+        fclose(fp);
+    }
+
+    return (fp != NULL) ? (utime + stime) * 1e3 / sysconf(_SC_CLK_TCK) : -1;
+}
+
+/**
+ * @brief Measures a shell whose input, a pipe, goes quiet while its
+ * IDLE_JOBS background jobs finish: the jobs it has not reaped, and the
+ * CPU time it uses while it waits, which should be none.
+ */
+static void bench_idle(void)
+{
+    char *shell = shell_path();
+    int fds[2];
+
+    if (pipe(fds) == -1)
+    {
+        perror("pipe");
+        exit(EXIT_FAILURE);
+    }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fds[0], STDIN_FILENO);
+    posix_spawn_file_actions_addclose(&actions, fds[0]);
+    posix_spawn_file_actions_addclose(&actions, fds[1]);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null",
+        O_WRONLY, 0);
+
+    char *argv[] = {shell, NULL};
+    pid_t pid;
+
+    if (posix_spawn(&pid, shell, &actions, NULL, argv, environ) != 0)
+    {
+        perror(shell);
+        exit(EXIT_FAILURE);
+    }
+
+    posix_spawn_file_actions_destroy(&actions);
+    close(fds[0]);
+    FILE *fp = fdopen(fds[1], "w");
+
+    for (int i = 0; i < IDLE_JOBS; i++)
+    {
+        fputs(IDLE_COMMAND " &\n", fp);
+    }
+
+    fflush(fp);
+
+    // The jobs are started and finish, then the shell is measured quiet.
+    struct timespec quiet = {IDLE_MSEC / 1000, (IDLE_MSEC % 1000) * 1000000L};
+    int unreaped;
+    nanosleep(&quiet, NULL);
+    double before = process_state(pid, &unreaped);
+    nanosleep(&quiet, NULL);
+    double after = process_state(pid, &unreaped);
+
+    fclose(fp);
+    waitpid(pid, NULL, 0);
+
+    printf("idle: %s, %d background jobs, then %d msec without input\n",
+        shell, IDLE_JOBS, IDLE_MSEC);
+    printf("  unreaped     %8d jobs\n", unreaped);
+    printf("  cpu          %8.1f msec\n", after - before);
+    record("idle", "unreaped", unreaped, "jobs");
+    record("idle", "cpu", after - before, "msec");
+    free(shell);
+}
+
+/**
+ * @brief A named benchmark.
+ */
+typedef struct
+{
+    const char *name;
+    void (*run)(void);
+} BENCHMARK;
+
+static const BENCHMARK benchmarks[] =
+{
+    {"spawn", bench_spawn},
+    {"script", bench_script},
+    {"cache", bench_cache},
+    {"builtins", bench_builtins},
+    {"substitution", bench_substitution},
+    {"true", bench_true},
+    {"pipeline", bench_pipeline},
+    {"parser", bench_parser},
+    {"startup", bench_startup},
+    {"reap", bench_reap},
+    {"sequence", bench_sequence},
+    {"loop", bench_loop},
+    {"subshell", bench_subshell},
+    {"idle", bench_idle},
+};
+
+#define NBENCHMARKS (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+/**
+ * @brief Runs the named benchmarks, or all of them if none are named, and
+ * with --json FILE writes their results to FILE.
+ */
+int main(int argc, char *argv[])
+{
+    char *json = NULL;
+
+    if ((argc > 2) && (strcmp(argv[1], "--json") == 0))
+    {
+        json = argv[2];
+        argc -= 2;
+        argv += 2;
+    }
+
+    // The benchmarks change directory, so a relative file is named from here.
+    char file[PATH_MAX * 2];
+    char *cwd = ((json != NULL) && (json[0] != '/')) ? realpath(".", NULL) : NULL;
+
+    if (json != NULL)
+    {
+        snprintf(file, sizeof(file), "%s%s%s", (cwd != NULL) ? cwd : "",
+            (cwd != NULL) ? "/" : "", json);
+        free(cwd);
+    }
+
+    for (size_t i = 0; i < NBENCHMARKS; i++)
+    {
+        bool selected = (argc < 2);
+
+        for (int a = 1; a < argc; a++)
+        {
+            selected |= (strcmp(argv[a], benchmarks[i].name) == 0);
+        }
+
+        if (selected)
+        {
+            benchmarks[i].run();
+            fflush(stdout);
+        }
+    }
+
+    if (json != NULL)
+    {
+        write_json(file);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,712 @@
+/**
+ * @file    builtins.c
+ * @author  Joshua Ng
+ * @brief   Common utilities built into the shell: echo, true, false,
+ *          test (and [), pwd and printf. Scripts call these in their
+ *          conditions and loops, where a fork and exec each would cost
+ *          far more than the utility itself.
+ * @date    2026-10-18
+ */
+
+#include "builtins.h"
+#include "globals.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#if defined(__APPLE__)
+    #define st_mtim st_mtimespec
+#endif
+
+/**
+ * @brief The exit status of test for a malformed expression.
+ */
+#define TEST_ERROR 2
+
+/**
+ * @brief Handles the echo command. Prints its arguments separated by
+ * spaces, and a newline unless the first argument is -n.
+ *
+ * @param t     The echo shellcmd to handle.
+ * @return The exitstatus of the operation.
+ */
+int echo_shellcmd(SHELLCMD *t)
+{
+    bool newline = true;
+    int a = 1;
+
+    for (; (a < t->argc) && (strcmp(t->argv[a], "-n") == 0); a++)
+    {
+        newline = false;
+    }
+
+    for (int first = a; a < t->argc; a++)
+    {
+        if (a > first)
+        {
+            putchar(' ');
+        }
+
+        fputs(t->argv[a], stdout);
+    }
+
+    if (newline)
+    {
+        putchar('\n');
+    }
+
+    return ferror(stdout) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/**
+ * @brief Handles the true command.
+ *
+ * @param t     The true shellcmd to handle.
+ * @return EXIT_SUCCESS.
+ */
+int true_shellcmd(SHELLCMD *t)
+{
+    (void) t;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Handles the false command.
+ *
+ * @param t     The false shellcmd to handle.
+ * @return EXIT_FAILURE.
+ */
+int false_shellcmd(SHELLCMD *t)
+{
+    (void) t;
+    return EXIT_FAILURE;
+}
+
+/**
+ * @brief Handles the pwd command.
+ *
+ * @param t     The pwd shellcmd to handle.
+ * @return The exitstatus of the operation.
+ */
+int pwd_shellcmd(SHELLCMD *t)
+{
+    char cwd[PATH_MAX];
+
+    if (getcwd(cwd, sizeof(cwd)) == NULL)
+    {
+        print_command_error(t->argv[0], "");
+        return EXIT_FAILURE;
+    }
+
+    puts(cwd);
+    return EXIT_SUCCESS;
+}
+
+// ------------------------------- test ---------------------------------
+
+/**
+ * @brief The state of a test expression being evaluated.
+ */
+typedef struct
+{
+    char    **argv;     // The expression's arguments.
+    int     argc;
+    int     next;       // The next argument.
+    bool    error;      // True if the expression is malformed.
+    char    *name;      // The command's name, for errors.
+} TEST;
+
+static bool test_or(TEST *test);
+
+/**
+ * @brief Reports a malformed test expression.
+ *
+ * @param test      The expression.
+ * @param message   The error message.
+ * @param argument  The argument in error.
+ * @return false
+ */
+static bool test_error(TEST *test, const char *message, const char *argument)
+{
+    if (!test->error)
+    {
+        fprintf(stderr, "%s: %s%s\n", test->name, message, argument);
+    }
+
+    test->error = true;
+    return false;
+}
+
+/**
+ * @brief Takes the next argument of the expression.
+ *
+ * @param test  The expression.
+ * @return The argument, or NULL at the end.
+ */
+static char *test_take(TEST *test)
+{
+    return (test->next < test->argc) ? test->argv[test->next++] : NULL;
+}
+
+/**
+ * @brief Peeks at an argument of the expression.
+ *
+ * @param test      The expression.
+ * @param offset    The offset from the next argument.
+ * @return The argument, or NULL past the end.
+ */
+static char *test_peek(TEST *test, int offset)
+{
+    int a = test->next + offset;
+    return (a < test->argc) ? test->argv[a] : NULL;
+}
+
+/**
+ * @brief Converts an integer operand.
+ *
+ * @param test      The expression.
+ * @param string    The operand.
+ * @return The integer.
+ */
+static long test_integer(TEST *test, const char *string)
+{
+    char *end;
+    errno = 0;
+    long value = strtol(string, &end, 10);
+
+    if ((end == string) || (*end != '\0') || (errno != 0))
+    {
+        test_error(test, "integer expression expected: ", string);
+    }
+
+    return value;
+}
+
+/**
+ * @brief Evaluates a unary file or string primary.
+ *
+ * @param test      The expression.
+ * @param op        The operator, e.g. -f.
+ * @param operand   The operand.
+ * @return The truth of the primary.
+ */
+static bool test_unary(TEST *test, const char *op, const char *operand)
+{
+    switch (op[1])
+    {
+    case 'n': return (operand[0] != '\0');
+    case 'z': return (operand[0] == '\0');
+    case 't': return isatty((int) test_integer(test, operand));
+    case 'r': return (access(operand, R_OK) == 0);
+    case 'w': return (access(operand, W_OK) == 0);
+    case 'x': return (access(operand, X_OK) == 0);
+    default:  break;
+    }
+
+    struct stat sb;
+    bool is_link = (op[1] == 'h') || (op[1] == 'L');
+    bool exists = (is_link ? lstat(operand, &sb) : stat(operand, &sb)) == 0;
+
+    switch (op[1])
+    {
+    case 'e': return exists;
+    case 'f': return exists && S_ISREG(sb.st_mode);
+    case 'd': return exists && S_ISDIR(sb.st_mode);
+    case 'b': return exists && S_ISBLK(sb.st_mode);
+    case 'c': return exists && S_ISCHR(sb.st_mode);
+    case 'p': return exists && S_ISFIFO(sb.st_mode);
+    case 'S': return exists && S_ISSOCK(sb.st_mode);
+    case 'h':
+    case 'L': return exists && S_ISLNK(sb.st_mode);
+    case 's': return exists && (sb.st_size > 0);
+    case 'g': return exists && (sb.st_mode & S_ISGID);
+    case 'u': return exists && (sb.st_mode & S_ISUID);
+    case 'k': return exists && (sb.st_mode & S_ISVTX);
+    default:  return false;
+    }
+}
+
+/**
+ * @brief Checks if an argument is a unary operator.
+ *
+ * @param op    The argument.
+ * @return True if it is a unary operator.
+ */
+static bool is_unary(const char *op)
+{
+    return (op != NULL) && (op[0] == '-') && (op[1] != '\0') && (op[2] == '\0')
+        && (strchr("nztefdbcpShLsgukrwx", op[1]) != NULL);
+}
+
+/**
+ * @brief Checks if an argument is a binary operator.
+ *
+ * @param op    The argument.
+ * @return True if it is a binary operator.
+ */
+static bool is_binary(const char *op)
+{
+    static const char *binaries[] =
+    {
+        "=", "==", "!=", "<", ">", "-eq", "-ne", "-lt", "-le", "-gt", "-ge",
+        "-nt", "-ot", "-ef"
+    };
+
+    for (size_t i = 0; (op != NULL) && (i < sizeof(binaries) / sizeof(binaries[0])); i++)
+    {
+        if (strcmp(op, binaries[i]) == 0)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief Evaluates a binary primary.
+ *
+ * @param test  The expression.
+ * @param left  The left operand.
+ * @param op    The operator.
+ * @param right The right operand.
+ * @return The truth of the primary.
+ */
+static bool test_binary(TEST *test, const char *left, const char *op,
+    const char *right)
+{
+    if ((strcmp(op, "=") == 0) || (strcmp(op, "==") == 0))
+    {
+        return (strcmp(left, right) == 0);
+    }
+
+    if (strcmp(op, "!=") == 0)
+    {
+        return (strcmp(left, right) != 0);
+    }
+
+    if (op[0] != '-')
+    {
+        int order = strcmp(left, right);
+        return (op[0] == '<') ? (order < 0) : (order > 0);
+    }
+
+    if ((strcmp(op, "-nt") == 0) || (strcmp(op, "-ot") == 0)
+        || (strcmp(op, "-ef") == 0))
+    {
+        struct stat lsb, rsb;
+        bool lexists = (stat(left, &lsb) == 0);
+        bool rexists = (stat(right, &rsb) == 0);
+
+        if (op[1] == 'e')
+        {
+            return lexists && rexists
+                && (lsb.st_dev == rsb.st_dev) && (lsb.st_ino == rsb.st_ino);
+        }
+
+        // A file is newer than one that does not exist.
+        if (!lexists || !rexists)
+        {
+            return (op[1] == 'n') ? lexists : rexists;
+        }
+
+        struct timespec l = lsb.st_mtim, r = rsb.st_mtim;
+        int order = (l.tv_sec != r.tv_sec)
+            ? ((l.tv_sec > r.tv_sec) ? 1 : -1)
+            : ((l.tv_nsec > r.tv_nsec) - (l.tv_nsec < r.tv_nsec));
+        return (op[1] == 'n') ? (order > 0) : (order < 0);
+    }
+
+    long l = test_integer(test, left);
+    long r = test_integer(test, right);
+
+    switch ((op[1] << 8) | op[2])
+    {
+    case ('e' << 8) | 'q': return (l == r);
+    case ('n' << 8) | 'e': return (l != r);
+    case ('l' << 8) | 't': return (l < r);
+    case ('l' << 8) | 'e': return (l <= r);
+    case ('g' << 8) | 't': return (l > r);
+    default:               return (l >= r);
+    }
+}
+
+/**
+ * @brief Evaluates a primary: ( expression ), a unary or binary primary,
+ * or a string, which is true if not empty.
+ *
+ * @param test  The expression.
+ * @return The truth of the primary.
+ */
+static bool test_primary(TEST *test)
+{
+    char *arg = test_take(test);
+
+    if (arg == NULL)
+    {
+        return test_error(test, "argument expected", "");
+    }
+
+    if (is_binary(test_peek(test, 0)) && (test_peek(test, 1) != NULL))
+    {
+        char *op = test_take(test);
+        return test_binary(test, arg, op, test_take(test));
+    }
+
+    if ((strcmp(arg, "(") == 0) && (test_peek(test, 0) != NULL))
+    {
+        bool result = test_or(test);
+        char *close = test_take(test);
+
+        if ((close == NULL) || (strcmp(close, ")") != 0))
+        {
+            return test_error(test, "')' expected", "");
+        }
+
+        return result;
+    }
+
+    if (is_unary(arg) && (test_peek(test, 0) != NULL))
+    {
+        return test_unary(test, arg, test_take(test));
+    }
+
+    return (arg[0] != '\0');
+}
+
+/**
+ * @brief Evaluates a negation: ! expression, or a primary.
+ *
+ * @param test  The expression.
+ * @return The truth of the negation.
+ */
+static bool test_not(TEST *test)
+{
+    char *arg = test_peek(test, 0);
+
+    if ((arg != NULL) && (strcmp(arg, "!") == 0) && (test_peek(test, 1) != NULL))
+    {
+        test_take(test);
+        return !test_not(test);
+    }
+
+    return test_primary(test);
+}
+
+/**
+ * @brief Evaluates a conjunction: expression -a expression.
+ *
+ * @param test  The expression.
+ * @return The truth of the conjunction.
+ */
+static bool test_and(TEST *test)
+{
+    bool result = test_not(test);
+
+    while ((test_peek(test, 0) != NULL) && (strcmp(test_peek(test, 0), "-a") == 0))
+    {
+        test_take(test);
+        result = test_not(test) && result;
+    }
+
+    return result;
+}
+
+/**
+ * @brief Evaluates a disjunction: expression -o expression.
+ *
+ * @param test  The expression.
+ * @return The truth of the disjunction.
+ */
+static bool test_or(TEST *test)
+{
+    bool result = test_and(test);
+
+    while ((test_peek(test, 0) != NULL) && (strcmp(test_peek(test, 0), "-o") == 0))
+    {
+        test_take(test);
+        result = test_and(test) || result;
+    }
+
+    return result;
+}
+
+/**
+ * @brief Handles the test and [ commands.
+ *
+ * @param t     The test shellcmd to handle.
+ * @return EXIT_SUCCESS if the expression is true, EXIT_FAILURE if false,
+ * or TEST_ERROR if it is malformed.
+ */
+int test_shellcmd(SHELLCMD *t)
+{
+    TEST test = {.argv = t->argv + 1, .argc = t->argc - 1, .name = t->argv[0]};
+
+    if (strcmp(t->argv[0], "[") == 0)
+    {
+        if ((test.argc == 0) || (strcmp(t->argv[t->argc - 1], "]") != 0))
+        {
+            test_error(&test, "missing ']'", "");
+            return TEST_ERROR;
+        }
+
+        test.argc--;
+    }
+
+    if (test.argc == 0)
+    {
+        return EXIT_FAILURE;
+    }
+
+    bool result = test_or(&test);
+
+    if (!test.error && (test.next < test.argc))
+    {
+        test_error(&test, "too many arguments: ", test.argv[test.next]);
+    }
+
+    return test.error ? TEST_ERROR : (result ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+// ------------------------------ printf --------------------------------
+
+/**
+ * @brief Prints a backslash escape sequence.
+ *
+ * @param s     The sequence, after the backslash.
+ * @param stop  Set true by \c, which stops all output.
+ * @return The number of chars of the sequence.
+ */
+static int print_escape(const char *s, bool *stop)
+{
+    static const char escapes[] = "\\\\a\ab\bf\fn\nr\rt\tv\v\"\"''";
+
+    if (*s == 'c')
+    {
+        *stop = true;
+        return 1;
+    }
+
+    if ((*s >= '0') && (*s <= '7'))
+    {
+        // \0NNN as in %b, else \NNN, of at most three octal digits.
+        int skip = (*s == '0') ? 1 : 0;
+        int value = 0, n = skip;
+
+        while ((n < skip + 3) && (s[n] >= '0') && (s[n] <= '7'))
+        {
+            value = value * 8 + (s[n++] - '0');
+        }
+
+        putchar(value);
+        return n;
+    }
+
+    for (const char *e = escapes; *e != '\0'; e += 2)
+    {
+        if (*e == *s)
+        {
+            putchar(e[1]);
+            return 1;
+        }
+    }
+
+    putchar('\\');
+    return 0;
+}
+
+/**
+ * @brief Prints a string, interpreting its backslash escapes.
+ *
+ * @param s     The string.
+ * @param stop  Set true by \c, which stops all output.
+ */
+static void print_escaped(const char *s, bool *stop)
+{
+    while ((*s != '\0') && !*stop)
+    {
+        if (*s == '\\')
+        {
+            s++;
+            s += print_escape(s, stop);
+        }
+        else
+        {
+            putchar(*s++);
+        }
+    }
+}
+
+/**
+ * @brief Converts a numeric argument of printf. A leading quote gives the
+ * value of the following char.
+ *
+ * @param arg       The argument, or NULL if there are no more.
+ * @param valid     Set false if the argument is not a number.
+ * @return The number.
+ */
+static long long printf_integer(const char *arg, bool *valid)
+{
+    if (arg == NULL)
+    {
+        return 0;
+    }
+
+    if ((arg[0] == '\'') || (arg[0] == '"'))
+    {
+        return (unsigned char) arg[1];
+    }
+
+    char *end;
+    errno = 0;
+    long long value = strtoll(arg, &end, 0);
+
+    if ((end == arg) || (*end != '\0') || (errno != 0))
+    {
+        fprintf(stderr, "printf: %s: invalid number\n", arg);
+        *valid = false;
+    }
+
+    return value;
+}
+
+/**
+ * @brief Converts a floating point argument of printf.
+ *
+ * @param arg       The argument, or NULL if there are no more.
+ * @param valid     Set false if the argument is not a number.
+ * @return The number.
+ */
+static double printf_double(const char *arg, bool *valid)
+{
+    if (arg == NULL)
+    {
+        return 0;
+    }
+
+    char *end;
+    double value = strtod(arg, &end);
+
+    if ((end == arg) || (*end != '\0'))
+    {
+        fprintf(stderr, "printf: %s: invalid number\n", arg);
+        *valid = false;
+    }
+
+    return value;
+}
+
+/**
+ * @brief Handles the printf command. The format is reused while there
+ * are arguments left to convert.
+ *
+ * @param t     The printf shellcmd to handle.
+ * @return The exitstatus of the operation.
+ */
+int printf_shellcmd(SHELLCMD *t)
+{
+    if (t->argc < 2)
+    {
+        fprintf(stderr, "Usage: %s format [arguments]\n", t->argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const char *format = t->argv[1];
+    char **args = t->argv + 2;
+    bool valid = true;
+    bool stop = false;
+
+    do
+    {
+        char **first = args;
+
+        for (const char *f = format; (*f != '\0') && !stop; f++)
+        {
+            if (*f == '\\')
+            {
+                f += print_escape(f + 1, &stop);
+                continue;
+            }
+
+            if (*f != '%')
+            {
+                putchar(*f);
+                continue;
+            }
+
+            if (f[1] == '%')
+            {
+                putchar(*++f);
+                continue;
+            }
+
+            // Copy the conversion's flags, width and precision.
+            char spec[32] = "%";
+            size_t length = strspn(f + 1, "-+ #0123456789.");
+
+            if (length > sizeof(spec) - 4)
+            {
+                length = sizeof(spec) - 4;
+            }
+
+            memcpy(spec + 1, f + 1, length);
+            f += length + 1;
+            char conversion = *f;
+            char *arg = *args;
+            args += (arg != NULL);
+
+            switch (conversion)
+            {
+            case 'd':
+            case 'i':
+                memcpy(spec + length + 1, "ll", 2);
+                spec[length + 3] = conversion;
+                printf(spec, printf_integer(arg, &valid));
+                break;
+            case 'o':
+            case 'u':
+            case 'x':
+            case 'X':
+                memcpy(spec + length + 1, "ll", 2);
+                spec[length + 3] = conversion;
+                printf(spec, (unsigned long long) printf_integer(arg, &valid));
+                break;
+            case 'c':
+                spec[length + 1] = conversion;
+                printf(spec, (arg != NULL) ? arg[0] : '\0');
+                break;
+            case 'e':
+            case 'E':
+            case 'f':
+            case 'F':
+            case 'g':
+            case 'G':
+                spec[length + 1] = conversion;
+                printf(spec, printf_double(arg, &valid));
+                break;
+            case 's':
+                spec[length + 1] = conversion;
+                printf(spec, (arg != NULL) ? arg : "");
+                break;
+            case 'b':
+                print_escaped((arg != NULL) ? arg : "", &stop);
+                break;
+            default:
+                fprintf(stderr, "printf: %%%c: invalid conversion\n", conversion);
+                return EXIT_FAILURE;
+            }
+        }
+
+        // The format is reused only if it converted an argument.
+        if (args == first)
+        {
+            break;
+        }
+    }
+    while ((*args != NULL) && !stop);
+
+    return valid ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,608 @@
+/**
+ * @file    completion.c
+ * @author  Joshua Ng
+ * @brief   Completes command names, from a trie of the executables of the
+ *          PATH, and filenames, relative to the cwd.
+ * @date    2026-10-18
+ */
+
+#include "completion.h"
+#include "myshell.h"
+#include "globals.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#if defined(__APPLE__)
+    #define st_mtim st_mtimespec
+#endif
+
+/**
+ * The command names are kept in a trie of the executables of each PATH
+ * directory, and the builtins. It is built on the first completion, then
+ * kept up to date incrementally: each completion stats the directories,
+ * and only one that has been modified since it was listed is listed
+ * again, its names gone taken out of the trie and its new names put in.
+ * A name is counted once for each directory holding it, and each node
+ * counts the names below it, so a completion walks the prefix, then down
+ * while only one child still holds a name, and only the names listed are
+ * visited. Nodes are never freed, but reused if the names come back, and
+ * the trie is rebuilt if PATH changes.
+ */
+
+#define MIN_NODES       1024
+#define MIN_CAPACITY    16
+
+/**
+ * @brief A node of the trie. Its children are a list, in order of their
+ * bytes, so names are visited sorted.
+ */
+typedef struct
+{
+    uint32_t        child;      // The first child, or 0.
+    uint32_t        sibling;    // The next sibling, or 0.
+    uint32_t        count;      // The names at or below the node.
+    uint32_t        holders;    // The names ending at the node.
+    unsigned char   byte;
+} TRIENODE;
+
+/**
+ * @brief A directory of the PATH, and the executables it was listed with.
+ */
+typedef struct
+{
+    char            *name;
+    bool            listed;
+    dev_t           device;
+    ino_t           inode;
+    struct timespec mtime;
+    char            *names;     // The executables, each NUL terminated.
+    size_t          length;
+} TRIEDIR;
+
+static const char *builtins[] =
+{
+#define BUILTIN(name, command) name,
+#include "builtins.def"
+#undef BUILTIN
+};
+
+static TRIENODE     *nodes = NULL;      // The root is nodes[0].
+static size_t       nnodes = 0, nodes_capacity = 0;
+
+static char         *pathlist = NULL;   // The PATH the trie is for.
+static TRIEDIR      *directories = NULL;
+static size_t       ndirectories = 0;
+
+/**
+ * @brief Adds a name to the trie, or with a count of -1 takes it out.
+ *
+ * @param name      The name.
+ * @param count     1 to add the name, -1 to take it out.
+ */
+static void trie_add(const char *name, int count)
+{
+    uint32_t node = 0;
+    nodes[0].count += count;
+
+    for (const unsigned char *ch = (const unsigned char *) name; *ch; ch++)
+    {
+        // Find the child for the byte, or where in the list it goes.
+        uint32_t *link = &nodes[node].child;
+
+        while ((*link != 0) && (nodes[*link].byte < *ch))
+        {
+            link = &nodes[*link].sibling;
+        }
+
+        if ((*link == 0) || (nodes[*link].byte != *ch))
+        {
+            if (nnodes == nodes_capacity)
+            {
+                // The link points into the nodes, which move.
+                size_t at = (char *) link - (char *) nodes;
+                nodes_capacity *= 2;
+                nodes = realloc(nodes, nodes_capacity * sizeof(TRIENODE));
+                check_allocation(nodes);
+                link = (uint32_t *) ((char *) nodes + at);
+            }
+
+            TRIENODE *added = &nodes[nnodes];
+            *added = (TRIENODE) {.sibling = *link, .byte = *ch};
+            *link = nnodes++;
+        }
+
+        node = *link;
+        nodes[node].count += count;
+    }
+
+    nodes[node].holders += count;
+}
+
+/**
+ * @brief Compares two names, for qsort() and bsearch().
+ *
+ * @param a     The first name.
+ * @param b     The second name.
+ * @return Less than, equal to, or greater than zero, as a sorts before,
+ * with or after b.
+ */
+static int compare_names(const void *a, const void *b)
+{
+    return strcmp(*(const char *const *) a, *(const char *const *) b);
+}
+
+/**
+ * @brief Lists the executables of a directory into the trie, against the
+ * names it was last listed with: only the names new to it are stat'ed,
+ * and only the names new or gone change the trie.
+ *
+ * @param directory The directory.
+ */
+static void list_directory(TRIEDIR *directory)
+{
+    char *old = directory->names;
+    size_t nold = 0;
+
+    for (size_t i = 0; i < directory->length; i += strlen(old + i) + 1)
+    {
+        nold++;
+    }
+
+    const char **sorted = malloc((nold + 1) * sizeof(char *));
+    bool *kept = calloc(nold + 1, sizeof(bool));
+    check_allocation(sorted);
+    check_allocation(kept);
+
+    for (size_t i = 0, n = 0; n < nold; i += strlen(old + i) + 1)
+    {
+        sorted[n++] = old + i;
+    }
+
+    qsort(sorted, nold, sizeof(char *), compare_names);
+    directory->names = NULL;
+    directory->length = 0;
+
+    DIR *dir = opendir(directory->name);
+    size_t capacity = 0;
+    struct dirent *d;
+    struct stat info;
+
+    while ((dir != NULL) && ((d = readdir(dir)) != NULL))
+    {
+        const char *name = d->d_name;
+        const char **found = (d->d_name[0] == '.') ? NULL
+            : bsearch(&name, sorted, nold, sizeof(char *), compare_names);
+
+        if (found != NULL)
+        {
+            kept[found - sorted] = true;
+        }
+        else if ((d->d_name[0] == '.')
+            || (fstatat(dirfd(dir), d->d_name, &info, 0) == -1)
+            || !S_ISREG(info.st_mode) || !(info.st_mode & 0111))
+        {
+            continue;
+        }
+        else
+        {
+            trie_add(d->d_name, 1);
+        }
+
+        size_t size = strlen(d->d_name) + 1;
+
+        if (directory->length + size > capacity)
+        {
+            capacity = (capacity == 0) ? 4096 : 2 * capacity;
+            capacity += size;
+            directory->names = realloc(directory->names, capacity);
+            check_allocation(directory->names);
+        }
+
+        memcpy(directory->names + directory->length, d->d_name, size);
+        directory->length += size;
+    }
+
+    for (size_t n = 0; n < nold; n++)
+    {
+        if (!kept[n])
+        {
+            trie_add(sorted[n], -1);
+        }
+    }
+
+    if (dir != NULL)
+    {
+        closedir(dir);
+    }
+
+    free(sorted);
+    free(kept);
+    free(old);
+}
+
+/**
+ * @brief Takes a directory's executables out of the trie.
+ *
+ * @param directory The directory.
+ */
+static void forget_directory(TRIEDIR *directory)
+{
+    for (size_t i = 0; i < directory->length; i += strlen(directory->names + i) + 1)
+    {
+        trie_add(directory->names + i, -1);
+    }
+
+    free(directory->names);
+    directory->names = NULL;
+    directory->length = 0;
+}
+
+/**
+ * @brief Rebuilds the trie empty but for the builtins, and splits PATH
+ * into its directories, yet to be listed.
+ */
+static void rebuild(void)
+{
+    for (size_t i = 0; i < ndirectories; i++)
+    {
+        free(directories[i].name);
+        free(directories[i].names);
+    }
+
+    free(directories);
+    free(pathlist);
+    pathlist = strdup(PATH);
+    check_allocation(pathlist);
+
+    if (nodes == NULL)
+    {
+        nodes_capacity = MIN_NODES;
+        nodes = malloc(nodes_capacity * sizeof(TRIENODE));
+        check_allocation(nodes);
+    }
+
+    nodes[0] = (TRIENODE) {0};
+    nnodes = 1;
+
+    for (size_t i = 0; i < sizeof(builtins) / sizeof(builtins[0]); i++)
+    {
+        trie_add(builtins[i], 1);
+    }
+
+    // Like searchpath(), empty directory names are skipped.
+    char *copy = strdup(PATH);
+    check_allocation(copy);
+    size_t capacity = 1;
+
+    for (char *ch = copy; *ch; ch++)
+    {
+        capacity += (*ch == ':');
+    }
+
+    directories = calloc(capacity, sizeof(TRIEDIR));
+    check_allocation(directories);
+    ndirectories = 0;
+
+    for (char *dir = strtok(copy, COLON); dir; dir = strtok(NULL, COLON))
+    {
+        directories[ndirectories].name = strdup(dir);
+        check_allocation(directories[ndirectories++].name);
+    }
+
+    free(copy);
+}
+
+/**
+ * @brief Brings the trie up to date, listing again only the directories
+ * modified since they were listed. A relative directory, which follows
+ * the cwd, is listed again once the cwd is another directory.
+ */
+static void refresh(void)
+{
+    if ((pathlist == NULL) || (strcmp(pathlist, PATH) != 0))
+    {
+        rebuild();
+    }
+
+    for (size_t i = 0; i < ndirectories; i++)
+    {
+        TRIEDIR *directory = &directories[i];
+        struct stat info;
+        bool exists = (stat(directory->name, &info) == 0);
+        bool same = directory->listed && exists
+            && (info.st_dev == directory->device)
+            && (info.st_ino == directory->inode);
+
+        if ((same && (info.st_mtim.tv_sec == directory->mtime.tv_sec)
+                && (info.st_mtim.tv_nsec == directory->mtime.tv_nsec))
+            || (!directory->listed && !exists))
+        {
+            continue;
+        }
+
+        // A directory modified is listed again against its old names.
+        if (!same)
+        {
+            forget_directory(directory);
+        }
+        directory->listed = exists;
+
+        if (exists)
+        {
+            directory->device = info.st_dev;
+            directory->inode = info.st_ino;
+            directory->mtime = info.st_mtim;
+            list_directory(directory);
+        }
+    }
+}
+
+/**
+ * @brief Adds a candidate to a completion.
+ *
+ * @param c         The completion.
+ * @param head      The start of the candidate, e.g. its directory.
+ * @param length    The length of the start.
+ * @param tail      The rest of the candidate.
+ * @param directory True to end the candidate with a '/'.
+ */
+static void add_candidate(COMPLETIONS *c, const char *head, size_t length,
+    const char *tail, bool directory)
+{
+    size_t size = length + strlen(tail) + directory + 1;
+
+    if (c->count == c->capacity)
+    {
+        c->capacity = (c->capacity == 0) ? MIN_CAPACITY : 2 * c->capacity;
+        c->offsets = realloc(c->offsets, c->capacity * sizeof(size_t));
+        check_allocation(c->offsets);
+    }
+
+    if (c->length + size > c->pool_capacity)
+    {
+        c->pool_capacity = 2 * (c->pool_capacity + size);
+        c->pool = realloc(c->pool, c->pool_capacity);
+        check_allocation(c->pool);
+    }
+
+    char *candidate = c->pool + c->length;
+    memcpy(candidate, head, length);
+    strcpy(candidate + length, tail);
+
+    if (directory)
+    {
+        strcpy(candidate + size - 2, "/");
+    }
+
+    c->offsets[c->count++] = c->length;
+    c->length += size;
+}
+
+/**
+ * @brief Adds the names at or below a node of the trie to a completion,
+ * in order.
+ *
+ * @param c         The completion.
+ * @param node      The node.
+ * @param name      The name of the node, with room for PATH_MAX bytes.
+ * @param length    The length of the name.
+ */
+static void add_names(COMPLETIONS *c, uint32_t node, char *name, size_t length)
+{
+    if (nodes[node].holders > 0)
+    {
+        name[length] = '\0';
+        add_candidate(c, name, length, "", false);
+    }
+
+    for (uint32_t child = nodes[node].child; child != 0; child = nodes[child].sibling)
+    {
+        if ((nodes[child].count > 0) && (length + 1 < PATH_MAX))
+        {
+            name[length] = nodes[child].byte;
+            add_names(c, child, name, length + 1);
+        }
+    }
+}
+
+/**
+ * @brief Finds the only child of a node that still holds a name.
+ *
+ * @param node  The node.
+ * @return The child, or 0 if there is none or more than one.
+ */
+static uint32_t only_child(uint32_t node)
+{
+    uint32_t only = 0;
+
+    for (uint32_t child = nodes[node].child; child != 0; child = nodes[child].sibling)
+    {
+        if (nodes[child].count == 0)
+        {
+            continue;
+        }
+
+        if (only != 0)
+        {
+            return 0;
+        }
+        only = child;
+    }
+
+    return only;
+}
+
+/**
+ * @brief Completes a command name, from the executables of the PATH and
+ * the builtins. Unless they are listed, the only candidate is the prefix
+ * the names matched have in common, found without visiting them all.
+ *
+ * @param prefix    The start of the name.
+ * @param list      True to list every name matched.
+ * @param c         The completion, zeroed, to free with completion_free().
+ */
+void completion_commands(const char *prefix, bool list, COMPLETIONS *c)
+{
+    refresh();
+    uint32_t node = 0;
+
+    for (const unsigned char *ch = (const unsigned char *) prefix; *ch; ch++)
+    {
+        node = nodes[node].child;
+
+        while ((node != 0) && (nodes[node].byte != *ch))
+        {
+            node = nodes[node].sibling;
+        }
+
+        if ((node == 0) || (nodes[node].count == 0))
+        {
+            return;
+        }
+    }
+
+    char name[PATH_MAX];
+    size_t length = strlen(prefix);
+
+    if (length >= PATH_MAX)
+    {
+        return;
+    }
+
+    memcpy(name, prefix, length);
+
+    if (list)
+    {
+        add_names(c, node, name, length);
+        c->unique = (c->count == 1);
+        return;
+    }
+
+    for (uint32_t child; (nodes[node].holders == 0) && (length + 1 < PATH_MAX)
+        && ((child = only_child(node)) != 0); node = child)
+    {
+        name[length++] = nodes[child].byte;
+    }
+
+    // A name is held once by each directory it is in.
+    name[length] = '\0';
+    add_candidate(c, name, length, "", false);
+    c->unique = (nodes[node].holders == nodes[node].count);
+}
+
+static const char *sorted_pool;     // The pool of the candidates sorted.
+
+/**
+ * @brief Compares two candidates of a completion, for qsort().
+ *
+ * @param a     The offset of the first candidate.
+ * @param b     The offset of the second candidate.
+ * @return Less than, equal to, or greater than zero, as a sorts before,
+ * with or after b.
+ */
+static int compare_candidates(const void *a, const void *b)
+{
+    return strcmp(sorted_pool + *(const size_t *) a,
+        sorted_pool + *(const size_t *) b);
+}
+
+/**
+ * @brief Completes a filename, relative to the cwd unless it starts
+ * with '/'. Hidden files are only completed from a prefix starting '.'.
+ *
+ * @param prefix    The start of the filename.
+ * @param c         The completion, zeroed, to free with completion_free().
+ */
+void completion_files(const char *prefix, COMPLETIONS *c)
+{
+    const char *slash = strrchr(prefix, '/');
+    const char *base = (slash != NULL) ? slash + 1 : prefix;
+    size_t dirlength = base - prefix, baselength = strlen(base);
+    char path[PATH_MAX];
+
+    if (dirlength >= sizeof(path))
+    {
+        return;
+    }
+
+    memcpy(path, prefix, dirlength);
+    strcpy(path + dirlength, (dirlength == 0) ? "." : "");
+    DIR *dir = opendir(path);
+
+    if (dir == NULL)
+    {
+        return;
+    }
+
+    struct dirent *d;
+
+    while ((d = readdir(dir)) != NULL)
+    {
+        if ((strncmp(d->d_name, base, baselength) != 0)
+            || ((d->d_name[0] == '.') && (base[0] != '.'))
+            || (strcmp(d->d_name, ".") == 0) || (strcmp(d->d_name, "..") == 0))
+        {
+            continue;
+        }
+
+        // Only a symbolic link, or an entry of unknown type, is stat'ed.
+        bool directory = (d->d_type == DT_DIR);
+        struct stat info;
+
+        if (((d->d_type == DT_LNK) || (d->d_type == DT_UNKNOWN))
+            && (fstatat(dirfd(dir), d->d_name, &info, 0) == 0))
+        {
+            directory = S_ISDIR(info.st_mode);
+        }
+
+        add_candidate(c, prefix, dirlength, d->d_name, directory);
+    }
+
+    closedir(dir);
+    c->unique = (c->count == 1);
+    sorted_pool = c->pool;
+    qsort(c->offsets, c->count, sizeof(size_t), compare_candidates);
+}
+
+/**
+ * @brief Measures the prefix common to all the candidates of a
+ * completion, which being sorted is that of the first and the last.
+ *
+ * @param c     The completion.
+ * @return The length of the common prefix.
+ */
+size_t completion_common(const COMPLETIONS *c)
+{
+    if (c->count == 0)
+    {
+        return 0;
+    }
+
+    const char *first = completion_name(c, 0);
+    const char *last = completion_name(c, c->count - 1);
+    size_t length = 0;
+
+    while ((first[length] != '\0') && (first[length] == last[length]))
+    {
+        length++;
+    }
+
+    return length;
+}
+
+/**
+ * @brief Frees the candidates of a completion.
+ *
+ * @param c     The completion.
+ */
+void completion_free(COMPLETIONS *c)
+{
+    free(c->pool);
+    free(c->offsets);
+    *c = (COMPLETIONS) {0};
+}
@@ -0,0 +1,414 @@
+/**
+ * @file    eventloop.c
+ * @author  Joshua Ng
+ * @brief   Waits for the shell's events: input, terminated children,
+ *          control-C and a timer, all at once and without busy-waiting.
+ * @date    2026-10-18
+ */
+
+#include "eventloop.h"
+#include "globals.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#endif
+
+/**
+ * On Linux the shell waits in epoll, on the input, a signalfd and a
+ * timerfd. SIGCHLD, and SIGINT at an interactive shell, are blocked for
+ * good and read from the signalfd, so a signal that arrives while a
+ * command runs stays pending until the next wait, and is never lost.
+ * Elsewhere a handler writes each signal to a self-pipe, which is polled
+ * with the input until the timer's deadline.
+ *
+ * The events seen but not waited for are kept, for the next wait or take.
+ * The commands run get back the signal mask the shell started with.
+ */
+
+#define MAX_EVENTS      4
+#define SIGNALS_MAX     16      // The signals read at once.
+
+static bool         started = false;    // True once the fds are open.
+static bool         captured = false;   // True once original is set.
+static sigset_t     original;           // The mask of the commands run.
+static sigset_t     signals;            // The signals read as events.
+static unsigned     pending = 0;        // The events not yet waited for.
+static bool         armed = false;      // True while the timer runs.
+static int          watched = -1;       // The fd watched for input.
+static bool         always = false;     // True if it is always readable.
+
+#if defined(__linux__)
+static int          epfd = -1, sigfd = -1, timerfd = -1;
+#else
+static int          selfpipe[2] = {-1, -1};
+static struct timespec deadline;        // When the timer expires.
+#endif
+
+/**
+ * @brief Gets the signal mask the shell started with, which the commands
+ * it runs get back.
+ *
+ * @return The signal mask.
+ */
+const sigset_t *eventloop_sigmask(void)
+{
+    if (!captured)
+    {
+        check_error(sigprocmask(SIG_SETMASK, NULL, &original));
+        captured = true;
+    }
+
+    return &original;
+}
+
+#if defined(__linux__)
+/**
+ * @brief Adds a file descriptor to the epoll set.
+ *
+ * @param fd    The file descriptor.
+ * @return -1 if it cannot be added, else 0.
+ */
+static int watch_fd(int fd)
+{
+    struct epoll_event event = {.events = EPOLLIN, .data.fd = fd};
+    return epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &event);
+}
+#else
+/**
+ * @brief Handler for the signals read as events. It only writes the
+ * signal to the self-pipe, being async-signal-safe.
+ *
+ * @param signum    The signal.
+ */
+static void on_signal(int signum)
+{
+    int saved = errno;
+    char byte = (signum == SIGCHLD) ? 'c' : 'i';
+    (void) !write(selfpipe[1], &byte, 1);
+    errno = saved;
+}
+#endif
+
+/**
+ * @brief Starts reading SIGCHLD, and SIGINT at an interactive shell, as
+ * events, unless already started. A forked child of the shell starts
+ * again, reading SIGCHLD alone, so control-C ends it.
+ */
+void eventloop_init(void)
+{
+    if (started)
+    {
+        return;
+    }
+
+    eventloop_sigmask();
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGCHLD);
+
+    if (interactive && (getpid() == shellpid))
+    {
+        sigaddset(&signals, SIGINT);
+    }
+
+#if defined(__linux__)
+    check_error(sigprocmask(SIG_BLOCK, &signals, NULL));
+    sigfd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    check_error(sigfd);
+    timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    check_error(timerfd);
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    check_error(epfd);
+    check_error(watch_fd(sigfd));
+    check_error(watch_fd(timerfd));
+#else
+    check_error(pipe(selfpipe));
+
+    for (int i = 0; i < 2; i++)
+    {
+        check_error(fcntl(selfpipe[i], F_SETFD, FD_CLOEXEC));
+        check_error(fcntl(selfpipe[i], F_SETFL, O_NONBLOCK));
+    }
+
+    struct sigaction action = {.sa_handler = on_signal};
+    action.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    sigemptyset(&action.sa_mask);
+    check_error(sigaction(SIGCHLD, &action, NULL));
+
+    if (sigismember(&signals, SIGINT))
+    {
+        check_error(sigaction(SIGINT, &action, NULL));
+    }
+#endif
+
+    started = true;
+}
+
+#if !defined(__linux__)
+/**
+ * @brief Gets the time left until the timer expires.
+ *
+ * @return The milliseconds left, or -1 if the timer is not running.
+ */
+static int remaining(void)
+{
+    if (!armed)
+    {
+        return -1;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long msec = (deadline.tv_sec - now.tv_sec) * 1000
+        + (deadline.tv_nsec - now.tv_nsec) / 1000000;
+    return (msec > 0) ? (int) msec : 0;
+}
+#endif
+
+/**
+ * @brief Collects the signals and the timer's expiry, without waiting.
+ */
+static void collect(void)
+{
+#if defined(__linux__)
+    struct signalfd_siginfo info[SIGNALS_MAX];
+    ssize_t n;
+
+    do
+    {
+        n = read(sigfd, info, sizeof(info));
+
+        for (ssize_t i = 0; i < n / (ssize_t) sizeof(info[0]); i++)
+        {
+            pending |= (info[i].ssi_signo == SIGCHLD)
+                ? EVENT_CHILD : EVENT_INTERRUPT;
+        }
+    }
+    while (n == sizeof(info));
+
+    uint64_t expirations;
+
+    if (armed && (read(timerfd, &expirations, sizeof(expirations)) > 0))
+    {
+        pending |= EVENT_TIMER;
+        armed = false;
+    }
+#else
+    char bytes[64];
+    ssize_t n;
+
+    while ((n = read(selfpipe[0], bytes, sizeof(bytes))) > 0)
+    {
+        for (ssize_t i = 0; i < n; i++)
+        {
+            pending |= (bytes[i] == 'c') ? EVENT_CHILD : EVENT_INTERRUPT;
+        }
+    }
+
+    if (remaining() == 0)
+    {
+        pending |= EVENT_TIMER;
+        armed = false;
+    }
+#endif
+}
+
+/**
+ * @brief Watches a file descriptor for input, in place of the last.
+ * A regular file, which epoll cannot watch, is always readable.
+ *
+ * @param fd    The file descriptor, or -1 for none.
+ */
+static void watch(int fd)
+{
+    if (fd == watched)
+    {
+        return;
+    }
+
+    pending &= ~EVENT_INPUT;
+    always = false;
+
+#if defined(__linux__)
+    if (watched != -1)
+    {
+        // It may have been closed since, and so removed already.
+        (void) epoll_ctl(epfd, EPOLL_CTL_DEL, watched, NULL);
+    }
+
+    if ((fd != -1) && (watch_fd(fd) == -1))
+    {
+        if ((errno != EPERM) && (errno != EEXIST))
+        {
+            check_error(-1);
+        }
+
+        always = (errno == EPERM);
+    }
+#endif
+
+    watched = fd;
+}
+
+/**
+ * @brief Waits for any of the events. The events that happened meanwhile
+ * but were not waited for are kept, for a later wait or take.
+ *
+ * @param fd        The file descriptor to wait on for EVENT_INPUT.
+ * @param events    The events to wait for.
+ * @return The events waited for that have happened.
+ */
+unsigned eventloop_wait(int fd, unsigned events)
+{
+    eventloop_init();
+    watch((events & EVENT_INPUT) ? fd : -1);
+
+    for (;;)
+    {
+        collect();
+
+        if ((events & EVENT_INPUT) && always)
+        {
+            pending |= EVENT_INPUT;
+        }
+
+        if (pending & events)
+        {
+            break;
+        }
+
+#if defined(__linux__)
+        struct epoll_event ready[MAX_EVENTS];
+        int n = epoll_wait(epfd, ready, MAX_EVENTS, -1);
+
+        if ((n == -1) && (errno != EINTR))
+        {
+            check_error(-1);
+        }
+
+        for (int i = 0; i < n; i++)
+        {
+            // The signals and the timer are read by collect().
+            if (ready[i].data.fd == watched)
+            {
+                pending |= EVENT_INPUT;
+            }
+        }
+#else
+        struct pollfd pfds[2] =
+        {
+            {.fd = selfpipe[0], .events = POLLIN},
+            {.fd = watched, .events = POLLIN}
+        };
+
+        if ((poll(pfds, (watched != -1) ? 2 : 1, remaining()) == -1)
+            && (errno != EINTR))
+        {
+            check_error(-1);
+        }
+
+        if ((watched != -1) && (pfds[1].revents != 0))
+        {
+            pending |= EVENT_INPUT;
+        }
+#endif
+    }
+
+    unsigned happened = pending & events;
+    pending &= ~happened;
+    return happened;
+}
+
+/**
+ * @brief Takes any of the events that have happened, without waiting.
+ *
+ * @param events    The events to take.
+ * @return True if any of the events had happened.
+ */
+bool eventloop_take(unsigned events)
+{
+    if (!started)
+    {
+        return false;
+    }
+
+    collect();
+    bool happened = (pending & events) != 0;
+    pending &= ~events;
+    return happened;
+}
+
+/**
+ * @brief Starts the timer, which expires once, or stops it.
+ *
+ * @param msec  The milliseconds until it expires, or 0 to stop it.
+ */
+void eventloop_timer(int msec)
+{
+    eventloop_init();
+    pending &= ~EVENT_TIMER;
+    armed = (msec > 0);
+
+#if defined(__linux__)
+    struct itimerspec spec =
+    {
+        .it_value = {.tv_sec = msec / 1000, .tv_nsec = (msec % 1000) * 1000000L}
+    };
+
+    check_error(timerfd_settime(timerfd, 0, &spec, NULL));
+#else
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += msec / 1000;
+    deadline.tv_nsec += (msec % 1000) * 1000000L;
+
+    if (deadline.tv_nsec >= 1000000000L)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+#endif
+}
+
+/**
+ * @brief Gives up the event loop inherited by a forked child of the
+ * shell, whose signals are not its own, and gets back the signal mask the
+ * shell started with. The child starts its own, if it needs one.
+ */
+void eventloop_forked(void)
+{
+    if (!started)
+    {
+        return;
+    }
+
+#if defined(__linux__)
+    close(epfd);
+    close(sigfd);
+    close(timerfd);
+    epfd = sigfd = timerfd = -1;
+#else
+    signal(SIGCHLD, SIG_DFL);
+
+    if (sigismember(&signals, SIGINT))
+    {
+        signal(SIGINT, SIG_DFL);
+    }
+
+    close(selfpipe[0]);
+    close(selfpipe[1]);
+    selfpipe[0] = selfpipe[1] = -1;
+#endif
+
+    check_error(sigprocmask(SIG_SETMASK, &original, NULL));
+    started = armed = always = false;
+    watched = -1;
+    pending = 0;
+}
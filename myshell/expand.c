@@ -0,0 +1,710 @@
+/**
+ * @file    expand.c
+ * @author  Joshua Ng
+ * @brief   Expands the words of a command before it is executed.
+ * @date    2026-10-18
+ */
+
+#include "expand.h"
+#include "globals.h"
+#include "internal.h"
+#include "parser.h"
+#include "shellscript.h"
+#include "variables.h"
+#include "wildcard.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/**
+ * $( cmd ) is replaced by the output of cmd, less its trailing newlines.
+ * The output is read whole into a buffer of its own, grown geometrically,
+ * and kept until the command has executed: the buffer is split into
+ * fields in place, at blanks, unless the word was quoted, and the fields
+ * point into it. Only a field joined with other text is copied.
+ *
+ * $NAME is replaced by a copy of the variable's value, in the arena, not
+ * the value itself, which the command may free by setting the variable.
+ *
+ * cmd runs in a forked child, like a subshell, unless it is a single
+ * builtin with no effect on the shell, e.g. echo or pwd, which runs in
+ * the shell itself, its output written to a temporary file.
+ */
+
+#define CAPTURE_MIN     256
+#define BLANKS          " \t\n"
+
+/**
+ * @brief Describes the read and write file descriptors ends.
+ */
+enum FILEDESCRIPTOR
+{
+    READ_END = 0,
+    WRITE_END = 1
+};
+
+/**
+ * @brief The fields a word expands to.
+ */
+typedef struct
+{
+    char    **fields;
+    size_t  nfields, capacity;
+    char    *field;     // The field being joined, or NULL.
+    size_t  length;
+    bool    wildcards;  // True if the field has wildcards to expand.
+    bool    noglob;     // True if they are as written, e.g. NAME=*.
+} FIELDS;
+
+/**
+ * @brief Checks if a word has any expansions.
+ *
+ * @param word  The word, or NULL.
+ * @return True if the word is to be expanded.
+ */
+static bool expandable(const char *word)
+{
+    return (word != NULL) && (strpbrk(word, EXPAND_MARKERS) != NULL);
+}
+
+/**
+ * @brief Starts a process substitution, its command connected through a
+ * pipe whose other end the command being expanded opens as /dev/fd/N.
+ *
+ * @param e     The expansion.
+ * @param word  The word: EXPAND_PROCSUB, < or >, the command, EXPAND_END.
+ * @return The /dev/fd/N path, allocated from the expansion's arena.
+ */
+static char *process_substitution(EXPANSION *e, char *word)
+{
+    bool input = (word[1] == '<');  // The command reads the output of cmd.
+    char *text = word + 2;
+    char *end = strchr(text, EXPAND_END);
+    size_t length = (end != NULL) ? (size_t) (end - text) : strlen(text);
+
+    int fd[2];
+    check_error(pipe(fd));
+    check_error(fcntl(fd[READ_END], F_SETFD, FD_CLOEXEC));
+    check_error(fcntl(fd[WRITE_END], F_SETFD, FD_CLOEXEC));
+    fflush(stdout);
+    pid_t pid = shell_fork();
+
+    if (pid == 0)
+    {
+        // The earlier substitutions' pipes are not this child's.
+        for (size_t i = 0; i < e->nprocsubs; i++)
+        {
+            close(e->fds[i]);
+        }
+
+        check_error(dup2(fd[input ? WRITE_END : READ_END],
+            input ? STDOUT_FILENO : STDIN_FILENO));
+        close(fd[READ_END]);
+        close(fd[WRITE_END]);
+        shell_exit(shellscript_buffer(text, length));
+    }
+
+    close(fd[input ? WRITE_END : READ_END]);
+
+    if (e->nprocsubs == e->capacity)
+    {
+        e->capacity = (e->capacity == 0) ? 4 : 2 * e->capacity;
+        e->pids = realloc(e->pids, e->capacity * sizeof(*e->pids));
+        e->fds = realloc(e->fds, e->capacity * sizeof(*e->fds));
+        check_allocation(e->pids);
+        check_allocation(e->fds);
+    }
+
+    e->pids[e->nprocsubs] = pid;
+    e->fds[e->nprocsubs++] = fd[input ? READ_END : WRITE_END];
+
+    char *path = arena_alloc(&e->arena, 32);
+    snprintf(path, 32, "/dev/fd/%d", fd[input ? READ_END : WRITE_END]);
+    return path;
+}
+
+/**
+ * @brief Keeps a command substitution's output until expand_free().
+ *
+ * @param e         The expansion.
+ * @param capture   The memory allocated output.
+ */
+static void keep_capture(EXPANSION *e, char *capture)
+{
+    if (e->ncaptures == e->capturecapacity)
+    {
+        e->capturecapacity = (e->capturecapacity == 0) ? 4 : 2 * e->capturecapacity;
+        e->captures = realloc(e->captures, e->capturecapacity * sizeof(*e->captures));
+        check_allocation(e->captures);
+    }
+
+    e->captures[e->ncaptures++] = capture;
+}
+
+/**
+ * @brief Reads a file descriptor to its end, into a buffer grown by
+ * doubling.
+ *
+ * @param fd        The file descriptor.
+ * @param length    Set to the length read.
+ * @return The memory allocated buffer, with room for a '\0'.
+ */
+static char *read_all(int fd, size_t *length)
+{
+    size_t capacity = CAPTURE_MIN;
+    char *capture = malloc(capacity);
+    check_allocation(capture);
+    *length = 0;
+
+    for (;;)
+    {
+        if (*length + 1 == capacity)
+        {
+            capacity *= 2;
+            capture = realloc(capture, capacity);
+            check_allocation(capture);
+        }
+
+        ssize_t n = read(fd, capture + *length, capacity - *length - 1);
+
+        if ((n == -1) && (errno == EINTR))
+        {
+            continue;
+        }
+
+        if (n <= 0)
+        {
+            return capture;
+        }
+
+        *length += n;
+    }
+}
+
+/**
+ * @brief Checks if a builtin can run in the shell itself, in place of a
+ * subshell, having no effect on the shell.
+ *
+ * @param t     The command.
+ * @return True if the command is such a builtin.
+ */
+static bool pure_builtin(SHELLCMD *t)
+{
+    if ((t == NULL) || (t->type != CMD_COMMAND))
+    {
+        return false;
+    }
+
+    switch (parse_cmd(t->argv[0]))
+    {
+    case COMMAND_ECHO:
+    case COMMAND_TRUE:
+    case COMMAND_FALSE:
+    case COMMAND_TEST:
+    case COMMAND_PWD:
+    case COMMAND_PRINTF:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/**
+ * @brief Runs a command substitution's command in the shell itself, if
+ * it is a pure builtin. The file its output is written to, and the
+ * buffer it is parsed from, are reused, but a substitution within it is
+ * forked.
+ *
+ * @param text      The command's text.
+ * @param length    The length of the text.
+ * @param output    Set to the memory allocated output, if it ran.
+ * @param size      Set to the length of the output.
+ * @return True if the command ran.
+ */
+static bool capture_builtin(const char *text, size_t length, char **output,
+    size_t *size)
+{
+    static bool capturing = false;
+    static int capture = -1;
+    static ARENA arena;
+    static char *buffer;
+    static size_t capacity;
+
+    if (capturing)
+    {
+        return false;
+    }
+
+    // The text is tokenized in place, and ends its last line.
+    if (capacity < length + 1)
+    {
+        capacity = 2 * (length + 1);
+        buffer = realloc(buffer, capacity);
+        check_allocation(buffer);
+    }
+
+    memcpy(buffer, text, length);
+    buffer[length] = '\n';
+    size_t offset = 0;
+    size_t rejected = parse_rejected();
+    SHELLCMD *t = parse_shellcmd_buffer(buffer, length + 1, &offset, &arena);
+
+    // A syntax error, already reported, runs nothing.
+    if (parse_rejected() != rejected)
+    {
+        *size = 0;
+        *output = malloc(1);
+        check_allocation(*output);
+        return true;
+    }
+
+    if ((offset != length + 1) || !pure_builtin(t))
+    {
+        arena_reset(&arena);
+        return false;
+    }
+
+    if (capture == -1)
+    {
+        FILE *fp = tmpfile();
+        check_allocation(fp);
+        capture = fcntl(fileno(fp), F_DUPFD_CLOEXEC, 10);
+        check_error(capture);
+        fclose(fp);
+    }
+
+    fflush(stdout);
+    int saved = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 10);
+    check_error(saved);
+    check_error(dup2(capture, STDOUT_FILENO));
+
+    capturing = true;
+    execute_shellcmd(t);
+    fflush(stdout);
+    capturing = false;
+
+    check_error(dup2(saved, STDOUT_FILENO));
+    close(saved);
+    arena_reset(&arena);
+
+    off_t end = lseek(capture, 0, SEEK_CUR);
+    check_error(end);
+    *size = end;
+    *output = malloc(*size + 1);
+    check_allocation(*output);
+
+    if (pread(capture, *output, *size, 0) != end)
+    {
+        *size = 0;
+    }
+
+    check_error(ftruncate(capture, 0));
+    check_error(lseek(capture, 0, SEEK_SET));
+    return true;
+}
+
+/**
+ * @brief Runs a command substitution's command and reads its output.
+ *
+ * @param e         The expansion.
+ * @param text      The command's text, ending at EXPAND_END.
+ * @param length    Set to the length of the output.
+ * @return The memory allocated output, less its trailing newlines.
+ */
+static char *command_substitution(EXPANSION *e, char *text, size_t *length)
+{
+    char *end = strchr(text, EXPAND_END);
+    size_t textlength = (end != NULL) ? (size_t) (end - text) : strlen(text);
+    char *capture;
+
+    if (!capture_builtin(text, textlength, &capture, length))
+    {
+        int fd[2];
+        check_error(pipe(fd));
+        check_error(fcntl(fd[READ_END], F_SETFD, FD_CLOEXEC));
+        check_error(fcntl(fd[WRITE_END], F_SETFD, FD_CLOEXEC));
+        fflush(stdout);
+        pid_t pid = shell_fork();
+
+        if (pid == 0)
+        {
+            for (size_t i = 0; i < e->nprocsubs; i++)
+            {
+                close(e->fds[i]);
+            }
+
+            check_error(dup2(fd[WRITE_END], STDOUT_FILENO));
+            close(fd[READ_END]);
+            close(fd[WRITE_END]);
+            shell_exit(shellscript_buffer(text, textlength));
+        }
+
+        close(fd[WRITE_END]);
+        capture = read_all(fd[READ_END], length);
+        close(fd[READ_END]);
+        shell_wait(pid, "$( )");
+    }
+
+    while ((*length > 0) && (capture[*length - 1] == '\n'))
+    {
+        (*length)--;
+    }
+
+    capture[*length] = '\0';
+    keep_capture(e, capture);
+    return capture;
+}
+
+/**
+ * @brief Adds a finished field.
+ *
+ * @param f         The fields.
+ * @param field     The field.
+ */
+static void add_field(FIELDS *f, char *field)
+{
+    if (f->nfields == f->capacity)
+    {
+        f->capacity = (f->capacity == 0) ? 4 : 2 * f->capacity;
+        f->fields = realloc(f->fields, f->capacity * sizeof(*f->fields));
+        check_allocation(f->fields);
+    }
+
+    f->fields[f->nfields++] = field;
+}
+
+/**
+ * @brief Adds text to the field being joined. Text that ends a field
+ * on its own, with a '\0', is not copied.
+ *
+ * @param e         The expansion, whose arena holds joined fields.
+ * @param f         The fields.
+ * @param text      The text.
+ * @param length    The length of the text.
+ */
+static void join_field(EXPANSION *e, FIELDS *f, char *text, size_t length)
+{
+    if ((f->field == NULL) && (text[length] == '\0'))
+    {
+        f->field = text;
+        f->length = length;
+        return;
+    }
+
+    char *field = arena_alloc(&e->arena, f->length + length + 1);
+
+    if (f->field != NULL)
+    {
+        memcpy(field, f->field, f->length);
+    }
+
+    memcpy(field + f->length, text, length);
+    f->length += length;
+    field[f->length] = '\0';
+    f->field = field;
+}
+
+/**
+ * @brief Ends the field being joined, if any. A field with wildcards is
+ * replaced by the paths it matches, or else kept as written.
+ *
+ * @param e     The expansion, whose arena holds the paths.
+ * @param f     The fields.
+ */
+static void end_field(EXPANSION *e, FIELDS *f)
+{
+    if (f->field == NULL)
+    {
+        return;
+    }
+
+    char **paths = NULL;
+    size_t npaths = (f->wildcards && !f->noglob)
+        ? wildcard_expand(f->field, &e->arena, &paths)
+        : 0;
+
+    for (size_t i = 0; i < npaths; i++)
+    {
+        add_field(f, paths[i]);
+    }
+
+    if (npaths == 0)
+    {
+        add_field(f, f->wildcards ? wildcard_literal(f->field, &e->arena) : f->field);
+    }
+
+    free(paths);
+    f->field = NULL;
+    f->length = 0;
+    f->wildcards = false;
+}
+
+/**
+ * @brief Splits an expansion into fields, at blanks, in place: its own
+ * copy, a command substitution's output or a variable's value. The first
+ * is joined to the text before it, and the last is left to be joined to
+ * the text after it.
+ *
+ * @param e         The expansion.
+ * @param f         The fields.
+ * @param output    The expansion.
+ */
+static void split_fields(EXPANSION *e, FIELDS *f, char *output)
+{
+    char *s = output;
+
+    while (*s != '\0')
+    {
+        size_t blanks = strspn(s, BLANKS);
+
+        if (blanks > 0)
+        {
+            end_field(e, f);
+            s += blanks;
+            continue;
+        }
+
+        size_t length = strcspn(s, BLANKS);
+        bool last = (s[length] == '\0');
+
+        if (!last)
+        {
+            s[length] = '\0';
+        }
+
+        join_field(e, f, s, length);
+        s += length + !last;
+
+        if (!last)
+        {
+            end_field(e, f);
+        }
+    }
+}
+
+/**
+ * @brief Expands a word into fields. A variable's value is copied once,
+ * to the expansion's arena, and split there in place.
+ *
+ * @param e         The expansion.
+ * @param f         The fields, to add to.
+ * @param word      The word.
+ * @param quoted    True if the word is not to be split, e.g. NAME=value.
+ */
+static void expand_word(EXPANSION *e, FIELDS *f, char *word, bool quoted)
+{
+    if (!expandable(word))
+    {
+        add_field(f, word);
+        return;
+    }
+
+    f->noglob = quoted;
+
+    if (word[0] == EXPAND_PROCSUB)
+    {
+        add_field(f, process_substitution(e, word));
+        return;
+    }
+
+    static const char markers[] =
+        {EXPAND_VARIABLE, EXPAND_QUOTED, EXPAND_COMMAND, '\0'};
+    bool inquotes = false;  // Toggled by each EXPAND_QUOTED.
+    bool anyquotes = quoted;
+    char *s = word;
+
+    while (*s != '\0')
+    {
+        size_t length = strcspn(s, markers);
+
+        if (length > 0)
+        {
+            f->wildcards |= wildcard_marked(s, length);
+            join_field(e, f, s, length);
+            s += length;
+            continue;
+        }
+
+        if (*s == EXPAND_QUOTED)
+        {
+            inquotes = !inquotes;
+            anyquotes = true;
+            s++;
+            continue;
+        }
+
+        if (*s == EXPAND_VARIABLE)
+        {
+            size_t n = variable_name(s + 1);
+            const char *value = variable_get(s + 1, n);
+            s += 1 + n + (s[1 + n] == EXPAND_END);
+
+            // The command may set the variable, e.g. export X=y $X, and
+            // free the value while its words are in use.
+            char *copy = arena_strdup(&e->arena, (value != NULL) ? value : "");
+
+            if (quoted || inquotes)
+            {
+                join_field(e, f, copy, strlen(copy));
+            }
+            else
+            {
+                split_fields(e, f, copy);
+            }
+            continue;
+        }
+
+        size_t size;
+        char *output = command_substitution(e, s + 1, &size);
+        char *end = strchr(s, EXPAND_END);
+        s = (end != NULL) ? end + 1 : s + strlen(s);
+
+        if (quoted || inquotes)
+        {
+            join_field(e, f, output, size);
+        }
+        else
+        {
+            split_fields(e, f, output);
+        }
+    }
+
+    // A quoted word is a field, even if empty.
+    if (anyquotes && (f->field == NULL))
+    {
+        join_field(e, f, "", 0);
+    }
+
+    end_field(e, f);
+}
+
+/**
+ * @brief Expands a redirection's file, which must be a single field.
+ *
+ * @param e     The expansion.
+ * @param word  The file, or NULL.
+ * @param file  Set to the expanded file.
+ * @return False if the file is ambiguous.
+ */
+static bool expand_file(EXPANSION *e, char *word, char **file)
+{
+    *file = word;
+
+    if (!expandable(word))
+    {
+        return true;
+    }
+
+    FIELDS f = {0};
+    expand_word(e, &f, word, false);
+    *file = (f.nfields == 1) ? f.fields[0] : NULL;
+    free(f.fields);
+
+    if (*file == NULL)
+    {
+        fprintf(stderr, "%s: ambiguous redirect\n", name0);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Expands the words of a command, and its redirections, in place
+ * of its own until expand_free(). Commands without expansions are left
+ * as they are.
+ *
+ * @param t     The command.
+ * @param e     Set to the expansion.
+ * @return True if the command was expanded without errors.
+ */
+bool expand_shellcmd(SHELLCMD *t, EXPANSION *e)
+{
+    *e = (EXPANSION) {.argc = t->argc, .argv = t->argv,
+        .infile = t->infile, .outfile = t->outfile};
+
+    // The leading NAME=value words are assignments, not the command.
+    while ((e->nassignments < t->argc)
+        && variable_assignment(t->argv[e->nassignments]))
+    {
+        e->nassignments++;
+    }
+
+    bool any = (e->nassignments > 0)
+        || expandable(t->infile) || expandable(t->outfile);
+
+    for (int a = 0; (a < t->argc) && !any; a++)
+    {
+        any = expandable(t->argv[a]);
+    }
+
+    if (!any)
+    {
+        return true;
+    }
+
+    FIELDS f = {0};
+
+    for (int a = 0; a < t->argc; a++)
+    {
+        expand_word(e, &f, t->argv[a], a < e->nassignments);
+    }
+
+    // An assignment is a single field, the command's words follow them.
+    add_field(&f, NULL);
+    e->assignments = arena_alloc(&e->arena, f.nfields * sizeof(*t->argv));
+    memcpy(e->assignments, f.fields, f.nfields * sizeof(*t->argv));
+    t->argv = e->assignments + e->nassignments;
+    t->argc = f.nfields - 1 - e->nassignments;
+    free(f.fields);
+
+    if (!expand_file(e, e->infile, &t->infile) || !expand_file(e, e->outfile, &t->outfile))
+    {
+        return false;
+    }
+
+    // The command inherits the substitutions' pipes, once all are started.
+    for (size_t i = 0; i < e->nprocsubs; i++)
+    {
+        check_error(fcntl(e->fds[i], F_SETFD, 0));
+    }
+
+    return true;
+}
+
+/**
+ * @brief Restores the command's own words, closes the process
+ * substitutions' pipes and waits for their commands.
+ *
+ * @param t     The command.
+ * @param e     The expansion.
+ */
+void expand_free(SHELLCMD *t, EXPANSION *e)
+{
+    t->argc = e->argc;
+    t->argv = e->argv;
+    t->infile = e->infile;
+    t->outfile = e->outfile;
+
+    for (size_t i = 0; i < e->nprocsubs; i++)
+    {
+        close(e->fds[i]);
+    }
+
+    for (size_t i = 0; i < e->nprocsubs; i++)
+    {
+        shell_wait(e->pids[i], "( )");
+    }
+
+    for (size_t i = 0; i < e->ncaptures; i++)
+    {
+        free(e->captures[i]);
+    }
+
+    free(e->pids);
+    free(e->fds);
+    free(e->captures);
+    arena_free(&e->arena);
+}
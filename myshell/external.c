@@ -7,64 +7,191 @@
 
 #include "external.h"
 #include "globals.h"
-#include "filepaths.h"
-#include "searchpath.h"
+#include "redirection.h"
+#include "pathcache.h"
 #include "shellscript.h"
+#include "background.h"
+#include "variables.h"
+#include "eventloop.h"
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <signal.h>
+#include <spawn.h>
 
 /**
- * @brief Executes a shell command.
- * 
+ * @brief Reports a command that could not be spawned.
+ *
+ * @param t         The shell command.
+ * @param error     The error returned by posix_spawn.
+ * @return The exit status.
+ */
+static int external_failed(SHELLCMD *t, int error)
+{
+    // Replay the redirections in the parent to report which file failed to
+    // open, if any.
+    struct REDIRECTION* redirection = redirection_shellcmd(t);
+
+    if (redirection == NULL)
+    {
+        return EXIT_FAILURE;
+    }
+
+    fprintf(stderr, "%s: %s: %s", name0, strerror(error), t->argv[0]);
+    free_redirection_shellcmd(t, redirection);
+    return EXIT_FAILURE;
+}
+
+/**
+ * @brief Executes a command in place of this process, which would exit
+ * after it anyway. Returns only if the command could not be executed.
+ *
+ * @param t         The shell command.
+ * @param filepath  The command's resolved path.
+ * @return The exit status.
+ */
+static int external_exec(SHELLCMD *t, const char *filepath)
+{
+    struct REDIRECTION* redirection = redirection_shellcmd(t);
+
+    if (redirection == NULL)
+    {
+        return EXIT_FAILURE;
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+
+    // The command gets back the signals the shell reads as events.
+    sigset_t shell;
+    check_error(sigprocmask(SIG_SETMASK, eventloop_sigmask(), &shell));
+
+    char *filename = strrchr(filepath, '/');
+    char *old_argv0 = t->argv[0];
+    t->argv[0] = (filename != NULL) ? filename + 1 : t->argv[0];
+    execve(filepath, t->argv, variables_environ());
+    t->argv[0] = old_argv0;
+    sigprocmask(SIG_SETMASK, &shell, NULL);
+
+    int error = errno;
+    free_redirection_shellcmd(t, redirection);
+
+    if (error == ENOEXEC)
+    {
+        return shellscript_shellcmd(t, filepath);
+    }
+
+    fprintf(stderr, "%s: %s: %s", name0, strerror(error), t->argv[0]);
+    return EXIT_FAILURE;
+}
+
+/**
+ * @brief Executes a shell command. The command is resolved in the parent,
+ * through the PATH cache, and launched with posix_spawn, which avoids
+ * copying the shell's page tables, and its redirections are applied in the
+ * child as spawn file actions. It gets the signal mask the shell started
+ * with.
+ *
  * @param t     The shell command.
  * @return The exit status.
  */
 int external_shellcmd(SHELLCMD *t)
 {
-    pid_t fpid = fork();
-    check_error(fpid);
-    int exitstatus = EXIT_SUCCESS;
+    const char *filepath = t->argv[0];
+    bool script;
 
-    if (fpid == 0)
+    // Scripts for this shell run in a copy of it, without an exec. Only a
+    // command's first lookup on PATH, or a .sh path, reads its #! line;
+    // any other script is exec'd, or fails with ENOEXEC if it has none.
+    if (strchr(filepath, '/') == NULL)
     {
-        char *filepath = t->argv[0];
-        char *filepath0 = NULL;
+        const char *found = pathcache_lookup(filepath);
+        script = (found != NULL) && pathcache_script(filepath);
+        filepath = (found != NULL) ? found : filepath;
+    }
+    else
+    {
+        script = shellscript_named(filepath) && shellscript_detect(filepath);
+    }
 
-        if (strchr(filepath, '/') == NULL)
-        {
-            filepath0 = searchpath(PATH, filepath);
-            if (filepath0 != NULL)
-            {
-                filepath = filepath0;
-            }
-        }
+    if (script)
+    {
+        return shellscript_shellcmd(t, filepath);
+    }
 
-        char* filename = get_filename(filepath);
-        char* old_argv0 = t->argv[0];
-        t->argv[0] = filename;
-        execv(filepath, t->argv);
-        t->argv[0] = old_argv0;
-        char *error_message = strdup(strerror(errno));
-        exitstatus = shellscript_shellcmd(t);
+    // The last command of a process that exits after it needs no child,
+    // unless the shell must first give back its jobs' jobserver tokens.
+    if (finalcommand && !background_holding())
+    {
+        return external_exec(t, filepath);
+    }
+
+    posix_spawn_file_actions_t actions;
+    errno = posix_spawn_file_actions_init(&actions);
+    check_error(-errno);
+    redirection_spawn_actions(t, &actions);
+
+    posix_spawnattr_t attributes;
+    errno = posix_spawnattr_init(&attributes);
+    check_error(-errno);
+    posix_spawnattr_setsigmask(&attributes, eventloop_sigmask());
+    posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETSIGMASK);
 
-        if (exitstatus == EXIT_FAILURE)
+    char *filename = strrchr(filepath, '/');
+    char *old_argv0 = t->argv[0];
+    t->argv[0] = (filename != NULL) ? filename + 1 : t->argv[0];
+
+    pid_t fpid;
+    int error = posix_spawn(&fpid, filepath, &actions, &attributes, t->argv,
+        variables_environ());
+    t->argv[0] = old_argv0;
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attributes);
+
+    if (error == ENOEXEC)
+    {
+        return shellscript_shellcmd(t, filepath);
+    }
+
+    if (error != 0)
+    {
+        return external_failed(t, error);
+    }
+
+    return shell_wait(fpid, t->argv[0]);
+}
+
+/**
+ * @brief Handles the exec command. exec cmd args replaces the shell with
+ * the command, exec alone keeps its redirections for the shell.
+ *
+ * @param t     The exec shellcmd.
+ * @return The exit status, if the command could not be executed.
+ */
+int exec_shellcmd(SHELLCMD *t)
+{
+    if (t->argc == 1)
+    {
+        struct REDIRECTION* redirection = redirection_shellcmd(t);
+
+        if (redirection == NULL)
         {
-            fprintf(stderr, "%s: %s: %s", name0, error_message, t->argv[0]);
+            return EXIT_FAILURE;
         }
 
-        free(filepath0);
-        free(filename);
-        free(error_message);
-        exit(exitstatus);
+        keep_redirection_shellcmd(redirection);
+        return EXIT_SUCCESS;
     }
 
-    int status;                 // Declare a variable to store the child's status
-    waitpid(fpid, &status, 0);  // Wait for the child process and get its status 
-    exitstatus = WIFEXITED(status) 
-        ? WEXITSTATUS(status)   // The child exited normally, update with child's exit status.
-        : EXIT_FAILURE;         // The child failed to exit normally.
-
+    // The jobs' tokens go back before the shell is replaced.
+    background_release();
+    t->argc--;
+    t->argv++;
+    finalcommand = true;
+    int exitstatus = external_shellcmd(t);
+    finalcommand = false;
+    t->argc++;
+    t->argv--;
     return exitstatus;
 }
@@ -6,9 +6,16 @@
  */
 
 #include "myshell.h"
+#include "globals.h"
+#include "eventloop.h"
+#include "timing.h"
+#include "background.h"
 #include <stdlib.h>
 #include <errno.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
 
 /**
  * CITS2002 Project 2 2017
@@ -20,6 +27,11 @@ char    *HOME, *PATH, *CDPATH;
 char    *name0      = NULL;     // the program's name
 char    *argv0      = NULL;     // the program's path    
 bool    interactive = false;
+bool    pipefail    = false;    // set -o pipefail
+bool    scriptcache = true;     // --no-cache to disable
+bool    noexec      = false;    // -n, commands are parsed, not executed
+bool    finalcommand = false;   // may exec in place, the process exits next
+pid_t   shellpid    = 0;
 
 // ------------------------------------------------------------------------
 
@@ -59,6 +71,78 @@ void check_error0(int result, char *file, const char *func, int line)
     }
 }
 
+/**
+ * @brief Forks a child of the shell. The child gives up the event loop,
+ * the parent's SIGCHLDs are not its to reap.
+ * 
+ * @return The pid of the child in the parent, 0 in the child.
+ */
+pid_t shell_fork(void)
+{
+    pid_t fpid = fork();
+    check_error(fpid);
+
+    if (fpid == 0)
+    {
+        eventloop_forked();
+    }
+
+    return fpid;
+}
+
+/**
+ * @brief Waits for a child of the shell. The child is reaped with wait4,
+ * so its resource usage can be recorded for the time builtin.
+ * 
+ * @param pid       The pid of the child.
+ * @param command   The child's command, as reported by time.
+ * @return The exit status of the child.
+ */
+int shell_wait(pid_t pid, const char *command)
+{
+    int status = 0;
+    struct rusage usage;
+
+    // The child may have been reaped while the shell waited for another.
+    while (!background_claim(pid, &status, &usage)
+        && (wait4(pid, &status, 0, &usage) == -1))
+    {
+        if (errno != EINTR)
+        {
+            return EXIT_FAILURE;
+        }
+    }
+
+    int exitstatus = WIFEXITED(status)
+        ? WEXITSTATUS(status)   // The child exited normally.
+        : EXIT_FAILURE;         // The child failed to exit normally.
+
+    timing_record(pid, command, exitstatus, &usage);
+    return exitstatus;
+}
+
+/**
+ * @brief Exits the shell, or a forked child of the shell. A child must
+ * not run the stdio exit handling: that would seek the shared stdin back
+ * to the parent's unread input, which the parent would then read again.
+ * Jobs still holding a jobserver token are waited for, to give it back.
+ * 
+ * @param exitstatus    The exit status.
+ */
+void shell_exit(int exitstatus)
+{
+    background_release();
+
+    if (getpid() == shellpid)
+    {
+        exit(exitstatus);
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+    _exit(exitstatus);
+}
+
 /**
  * @brief Helper function to print the command errors.
  * 
@@ -98,88 +182,168 @@ static void print_redirection(SHELLCMD *t)
 }
 
 /**
- * @brief Helper function to print the shell comand.
+ * @brief What is left to print of a command-tree, a node or some text.
+ */
+typedef struct
+{
+    SHELLCMD    *t;
+    const char  *text;      // If not NULL, printed then t's redirection.
+} PRINTSTEP;
+
+/**
+ * @brief Pushes what is left to print of a command-tree.
+ * 
+ * @param stack     The stack.
+ * @param n         The number of steps on the stack.
+ * @param capacity  The capacity of the stack.
+ * @param t         The node to print.
+ * @param text      The text to print instead, if not NULL, followed by
+ *                  the node's redirection.
+ */
+static void push_print(PRINTSTEP **stack, size_t *n, size_t *capacity,
+    SHELLCMD *t, const char *text)
+{
+    if (*n == *capacity)
+    {
+        *capacity = (*capacity == 0) ? 64 : *capacity * 2;
+        *stack = realloc(*stack, *capacity * sizeof(**stack));
+        check_allocation(*stack);
+    }
+
+    (*stack)[(*n)++] = (PRINTSTEP){.t = t, .text = text};
+}
+
+/**
+ * @brief Helper function to print the shell comand. The tree is walked
+ * with a stack, not recursively, as a line of many commands is deep.
  * 
  * @param t  The shell command to print.
  */
 void print_shellcmd0(SHELLCMD *t)
 {
-    printf("[");
+    static const char *operators[] = {"", "; ", "&& ", "|| ", "", "| ", "& "};
+    PRINTSTEP *stack = NULL;
+    size_t n = 0, capacity = 0;
 
-    if(t == NULL) 
-    {
-        printf("nullcmd ");
-        return;
-    }
+    // The steps are pushed in reverse, to be popped in order.
+    push_print(&stack, &n, &capacity, t, NULL);
 
-    switch (t->type) 
-    {
-    case CMD_COMMAND:
+    while (n > 0)
     {
-        for(int a=0 ; a<t->argc ; a++)
+        PRINTSTEP step = stack[--n];
+        t = step.t;
+
+        if (step.text != NULL)
         {
-            printf("%s ", t->argv[a]);
+            printf("%s", step.text);
+
+            if (t != NULL)
+            {
+                print_redirection(t);
+            }
+            continue;
         }
 
-        print_redirection(t);
-        
-        if (t->left != NULL)
+        printf("[");
+
+        if(t == NULL) 
         {
-            print_shellcmd0(t->left);
+            printf("nullcmd ");
+            continue;
+        }
+
+        switch (t->type) 
+        {
+        case CMD_COMMAND:
+        {
+            for(int a=0 ; a<t->argc ; a++)
+            {
+                printf("%s ", t->argv[a]);
+            }
+
+            print_redirection(t);
+            push_print(&stack, &n, &capacity, NULL, "]");
+            
+            if (t->left != NULL)
+            {
+                push_print(&stack, &n, &capacity, t->left, NULL);
+            }
+            break;
+        }
+        case CMD_SUBSHELL:
+        {
+            printf("( "); 
+            push_print(&stack, &n, &capacity, NULL, "]");
+            push_print(&stack, &n, &capacity, t, ") ");
+            push_print(&stack, &n, &capacity, t->left, NULL);
+            break;
+        }
+        case CMD_IF:
+        {
+            printf("if ");
+            push_print(&stack, &n, &capacity, NULL, "fi ]");
+            push_print(&stack, &n, &capacity, t->right, NULL);
+            push_print(&stack, &n, &capacity, t->left, NULL);
+            break;
+        }
+        case CMD_THEN:
+        {
+            printf("then ");
+            push_print(&stack, &n, &capacity, NULL, "]");
+
+            if (t->right != NULL)
+            {
+                push_print(&stack, &n, &capacity, t->right, NULL);
+                push_print(&stack, &n, &capacity, NULL, "else ");
+            }
+
+            push_print(&stack, &n, &capacity, t->left, NULL);
+            break;
+        }
+        case CMD_WHILE:
+        {
+            printf("while ");
+            push_print(&stack, &n, &capacity, NULL, "done ]");
+            push_print(&stack, &n, &capacity, t->right, NULL);
+            push_print(&stack, &n, &capacity, NULL, "do ");
+            push_print(&stack, &n, &capacity, t->left, NULL);
+            break;
+        }
+        case CMD_FOR:
+        {
+            printf("for %s in ", t->argv[0]);
+
+            for(int a=1 ; a<t->argc ; a++)
+            {
+                printf("%s ", t->argv[a]);
+            }
+
+            printf("do ");
+            push_print(&stack, &n, &capacity, NULL, "done ]");
+            push_print(&stack, &n, &capacity, t->left, NULL);
+            break;
+        }
+        case CMD_SEMICOLON:
+        case CMD_AND:
+        case CMD_OR:
+        case CMD_PIPE:
+        case CMD_BACKGROUND:
+        {
+            push_print(&stack, &n, &capacity, NULL, "]");
+            push_print(&stack, &n, &capacity, t->right, NULL);
+            push_print(&stack, &n, &capacity, NULL, operators[t->type]);
+            push_print(&stack, &n, &capacity, t->left, NULL);
+            break;
+        }
+        default:
+        {
+            fprintf(stderr, "%s: invalid CMDTYPE in print_shellcmd0()\n", 
+                name0);
+            exit(EXIT_FAILURE);
+            break;
+        }
         }
-        break;
-    }
-    case CMD_SEMICOLON:
-    {
-        print_shellcmd0(t->left); 
-        printf("; "); 
-        print_shellcmd0(t->right);
-        break;
-    }
-    case CMD_AND:
-    {
-        print_shellcmd0(t->left); 
-        printf("&& "); 
-        print_shellcmd0(t->right);
-        break;
-    }
-    case CMD_OR:
-    {
-        print_shellcmd0(t->left); 
-        printf("|| "); 
-        print_shellcmd0(t->right);
-        break;
-    }
-    case CMD_SUBSHELL:
-    {
-        printf("( "); 
-        print_shellcmd0(t->left); 
-        printf(") ");
-        print_redirection(t);
-        break;
-    }
-    case CMD_PIPE:
-    {
-        print_shellcmd0(t->left); 
-        printf("| "); 
-        print_shellcmd0(t->right);
-        break;
-    }
-    case CMD_BACKGROUND:
-    {
-        print_shellcmd0(t->left); 
-        printf("& "); 
-        print_shellcmd0(t->right);
-        break;
-    }
-    default:
-    {
-        fprintf(stderr, "%s: invalid CMDTYPE in print_shellcmd0()\n", 
-            name0);
-        exit(EXIT_FAILURE);
-        break;
-    }
     }
 
-    printf("]");
+    free(stack);
 }
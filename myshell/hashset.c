@@ -111,6 +111,38 @@ bool hashset_contains(const HASHSET *set, const void *element)
     return false;
 }
 
+/**
+ * @brief Find the element in the set with the same key as a given element.
+ *
+ * This function does not allocate, free, or modify any elements.
+ *
+ * @param set Pointer to the HASHSET.
+ * @param element Pointer to an element holding the key to find.
+ * @return The element in the set with an equal key, or NULL if not found.
+ */
+void *hashset_find(const HASHSET *set, const void *element)
+{
+    const size_t i = set->interface.hash(element) % set->capacity;
+
+    for (size_t j = 0; j < set->capacity; j++)
+    {
+        const size_t index = (i + j) % set->capacity;
+        void *const hashset_element = set->elements[index];
+
+        if (hashset_element == NULL)
+        {
+            break;
+        }
+
+        if (set->interface.equals(hashset_element, element))
+        {
+            return hashset_element;
+        }
+    }
+
+    return NULL;
+}
+
 /**
  * @brief Insert an element into the set.
  *
@@ -0,0 +1,695 @@
+/**
+ * @file    history.c
+ * @author  Joshua Ng
+ * @brief   The persistent command history: an append-only log, mapped into
+ *          memory, with a trigram index for searching it.
+ * @date    2026-10-18
+ */
+
+#include "history.h"
+#include "globals.h"
+#include "variables.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+/**
+ * The history is a log, $HISTFILE or ~/.myshell_history, of one line per
+ * command. Each line is appended with a single write() to a file opened
+ * with O_APPEND, so shells sharing the log never interleave their lines.
+ * The log is mapped, not read, when the shell starts, so starting takes
+ * as long with a million entries as with none, and is walked backwards
+ * from its end.
+ *
+ * Searches use an index, the log's name with .idx appended, of where each
+ * trigram (three consecutive bytes) occurs. A trigram hashes to one of
+ * INDEX_BUCKETS buckets, each a list of the offsets of the entries holding
+ * it, most recent first. Only the entries in the bucket of the query's
+ * rarest trigram are compared with the query. The index covers the log up
+ * to a length, and the entries after it are searched directly. It is
+ * rebuilt as the shell exits, once the log has grown past it by an eighth,
+ * and renamed into place, so other shells see the old index or the new.
+ */
+
+#define HISTORY_FILE    ".myshell_history"
+#define INDEX_SUFFIX    ".idx"
+#define INDEX_MAGIC     "myshellh"
+#define INDEX_VERSION   1
+#define INDEX_BITS      16
+#define INDEX_BUCKETS   (1u << INDEX_BITS)
+#define REINDEX_MIN     (64 * 1024)     // The least growth worth reindexing.
+
+typedef struct
+{
+    char        magic[8];
+    uint32_t    version;
+    uint32_t    nbuckets;
+    uint64_t    device;
+    uint64_t    inode;
+    uint64_t    indexed;        // The length of the log indexed.
+    uint64_t    npostings;
+} INDEXHEADER;
+
+// The header is followed by uint32_t starts[nbuckets + 1], where each
+// bucket's postings begin, then the uint32_t postings themselves.
+
+static char         *logfile = NULL;    // NULL if there is no history.
+static int          logfd = -1;
+static struct stat  logstat;
+static const char   *logtext = NULL;    // The mapped log,
+static size_t       mapped = 0;         // and its length.
+
+static char         *index_mapping = NULL;
+static size_t       index_size = 0;
+static size_t       indexed = 0;        // The length of the log indexed.
+static const uint32_t *starts = NULL, *postings = NULL;
+
+static char         *last = NULL;       // The last entry, not repeated.
+static size_t       last_length = 0;
+
+/**
+ * @brief Hashes the trigram at the start of a string to its bucket.
+ *
+ * @param s     The string, of at least 3 bytes.
+ * @return The bucket.
+ */
+static uint32_t trigram_bucket(const char *s)
+{
+    uint32_t trigram = ((uint32_t) (unsigned char) s[0] << 16)
+        | ((uint32_t) (unsigned char) s[1] << 8) | (unsigned char) s[2];
+    return (trigram * 2654435761u) >> (32 - INDEX_BITS);
+}
+
+/**
+ * @brief Maps the log again if it has grown, e.g. by another shell.
+ */
+static void remap(void)
+{
+    struct stat sb;
+
+    if ((logfd == -1) || (fstat(logfd, &sb) == -1)
+        || ((size_t) sb.st_size == mapped))
+    {
+        return;
+    }
+
+    if (logtext != NULL)
+    {
+        munmap((void *) logtext, mapped);
+        logtext = NULL;
+        mapped = 0;
+    }
+
+    if (sb.st_size > 0)
+    {
+        void *mapping = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, logfd, 0);
+
+        if (mapping != MAP_FAILED)
+        {
+            logtext = mapping;
+            mapped = sb.st_size;
+        }
+    }
+
+    // A log cut short, e.g. emptied, is no longer the log indexed.
+    if (mapped < indexed)
+    {
+        indexed = 0;
+    }
+}
+
+/**
+ * @brief Maps the log's index, if it is valid for the log.
+ */
+static void open_index(void)
+{
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s%s", logfile, INDEX_SUFFIX);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    if (fd == -1)
+    {
+        return;
+    }
+
+    struct stat sb;
+    void *mapping = MAP_FAILED;
+
+    if ((fstat(fd, &sb) == 0) && ((size_t) sb.st_size >= sizeof(INDEXHEADER)))
+    {
+        mapping = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+
+    if (mapping == MAP_FAILED)
+    {
+        return;
+    }
+
+    const INDEXHEADER *header = mapping;
+    size_t expected = sizeof(INDEXHEADER) + ((size_t) INDEX_BUCKETS + 1
+        + header->npostings) * sizeof(uint32_t);
+
+    if ((memcmp(header->magic, INDEX_MAGIC, sizeof(header->magic)) != 0)
+        || (header->version != INDEX_VERSION)
+        || (header->nbuckets != INDEX_BUCKETS)
+        || (header->device != (uint64_t) logstat.st_dev)
+        || (header->inode != (uint64_t) logstat.st_ino)
+        || (header->indexed > mapped)
+        || ((header->indexed > 0) && (logtext[header->indexed - 1] != '\n'))
+        || (expected != (size_t) sb.st_size))
+    {
+        munmap(mapping, sb.st_size);
+        return;
+    }
+
+    index_mapping = mapping;
+    index_size = sb.st_size;
+    indexed = header->indexed;
+    starts = (const uint32_t *) (header + 1);
+    postings = starts + INDEX_BUCKETS + 1;
+}
+
+/**
+ * @brief Opens the history of an interactive shell. The log and its index
+ * are mapped, not read, so this takes as long however long the log is.
+ */
+void history_open(void)
+{
+    const char *histfile = variable_get("HISTFILE", 8);
+    char path[PATH_MAX];
+
+    if ((histfile != NULL) && (*histfile != '\0'))
+    {
+        snprintf(path, sizeof(path), "%s", histfile);
+    }
+    else
+    {
+        snprintf(path, sizeof(path), "%s/%s", HOME, HISTORY_FILE);
+    }
+
+    logfd = open(path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+
+    if ((logfd == -1) || (fstat(logfd, &logstat) == -1))
+    {
+        fprintf(stderr, "%s: history unavailable: ", name0);
+        perror(path);
+        logfd = -1;
+        return;
+    }
+
+    logfile = strdup(path);
+    check_allocation(logfile);
+    remap();
+    open_index();
+
+    // The last entry is not added again, even by the next session.
+    HISTORY_ENTRY entry;
+
+    if (history_entry_before(mapped, &entry))
+    {
+        last = strndup(entry.text, entry.length);
+        check_allocation(last);
+        last_length = entry.length;
+    }
+
+    atexit(history_close);
+}
+
+/**
+ * @brief Appends a line read from the terminal to the history, unless it
+ * is blank or repeats the last entry.
+ *
+ * @param line      The line, with or without its newline.
+ * @param length    The length of the line.
+ */
+void history_add(const char *line, size_t length)
+{
+    if (logfd == -1)
+    {
+        return;
+    }
+
+    if ((length > 0) && (line[length - 1] == '\n'))
+    {
+        length--;
+    }
+
+    if ((strspn(line, " \t") >= length) || (memchr(line, '\0', length) != NULL)
+        || ((length == last_length) && (memcmp(line, last, length) == 0)))
+    {
+        return;
+    }
+
+    // One write, so that the line is appended whole, whoever else appends.
+    struct iovec record[2] =
+    {
+        {.iov_base = (void *) line, .iov_len = length},
+        {.iov_base = "\n", .iov_len = 1}
+    };
+
+    if (writev(logfd, record, 2) == -1)
+    {
+        return;
+    }
+
+    free(last);
+    last = strndup(line, length);
+    check_allocation(last);
+    last_length = length;
+}
+
+/**
+ * @brief Gets the end of the history, the offset before which its most
+ * recent entry is found.
+ *
+ * @return The length of the log.
+ */
+size_t history_end(void)
+{
+    remap();
+    return mapped;
+}
+
+/**
+ * @brief Gets the entry that starts at an offset.
+ *
+ * @param offset    The offset, of the start of an entry.
+ * @param entry     Set to the entry.
+ */
+static void entry_at(size_t offset, HISTORY_ENTRY *entry)
+{
+    const char *end = memchr(logtext + offset, '\n', mapped - offset);
+    entry->text = logtext + offset;
+    entry->length = (end != NULL) ? (size_t) (end - entry->text) : mapped - offset;
+    entry->offset = offset;
+}
+
+/**
+ * @brief Gets the entry before an offset, walking the history backwards.
+ *
+ * @param offset    The offset, of an entry or the end of the history.
+ * @param entry     Set to the entry before it.
+ * @return False if there is none.
+ */
+bool history_entry_before(size_t offset, HISTORY_ENTRY *entry)
+{
+    if (offset > mapped)
+    {
+        offset = mapped;
+    }
+
+    if (offset == 0)
+    {
+        return false;
+    }
+
+    size_t end = (logtext[offset - 1] == '\n') ? offset - 1 : offset;
+    size_t start = end;
+
+    while ((start > 0) && (logtext[start - 1] != '\n'))
+    {
+        start--;
+    }
+
+    entry->text = logtext + start;
+    entry->length = end - start;
+    entry->offset = start;
+    return true;
+}
+
+/**
+ * @brief Gets the entry after another, walking the history forwards.
+ *
+ * @param offset    The offset of an entry.
+ * @param entry     Set to the entry after it.
+ * @return False if there is none.
+ */
+bool history_entry_after(size_t offset, HISTORY_ENTRY *entry)
+{
+    if (offset >= mapped)
+    {
+        return false;
+    }
+
+    entry_at(offset, entry);
+    offset += entry->length + 1;
+
+    if (offset >= mapped)
+    {
+        return false;
+    }
+
+    entry_at(offset, entry);
+    return true;
+}
+
+/**
+ * @brief Checks if an entry holds a query.
+ *
+ * @param entry     The entry.
+ * @param query     The query.
+ * @param length    The length of the query.
+ * @return True if the query is found in the entry.
+ */
+static bool contains(const HISTORY_ENTRY *entry, const char *query, size_t length)
+{
+    const char *p = entry->text, *end = entry->text + entry->length;
+
+    if (length == 0)
+    {
+        return true;
+    }
+
+    while (((size_t) (end - p) >= length)
+        && ((p = memchr(p, query[0], end - p - length + 1)) != NULL))
+    {
+        if (memcmp(p, query, length) == 0)
+        {
+            return true;
+        }
+        p++;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Searches entries, most recent first, for one holding the query.
+ *
+ * @param query     The query.
+ * @param length    The length of the query.
+ * @param from      The offset before which to search.
+ * @param to        The offset to search back to.
+ * @param entry     Set to the entry found.
+ * @return True if an entry is found.
+ */
+static bool search_entries(const char *query, size_t length, size_t from,
+    size_t to, HISTORY_ENTRY *entry)
+{
+    while ((from > to) && history_entry_before(from, entry))
+    {
+        if (contains(entry, query, length))
+        {
+            return true;
+        }
+        from = entry->offset;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Searches the history, most recent first, for an entry holding
+ * the query, e.g. for a reverse incremental search.
+ *
+ * @param query     The query.
+ * @param before    The offset before which to search, e.g. history_end(),
+ *                  or the offset of the entry last found.
+ * @param entry     Set to the entry found.
+ * @return True if an entry is found.
+ */
+bool history_search(const char *query, size_t before, HISTORY_ENTRY *entry)
+{
+    size_t length = strlen(query);
+    remap();
+
+    if (before > mapped)
+    {
+        before = mapped;
+    }
+
+    // A query without a trigram, or a log without an index, is scanned.
+    if ((length < 3) || (indexed == 0))
+    {
+        return search_entries(query, length, before, 0, entry);
+    }
+
+    if ((before > indexed) && search_entries(query, length, before, indexed, entry))
+    {
+        return true;
+    }
+
+    // Only the entries holding the query's rarest trigram can hold it.
+    uint32_t rarest = trigram_bucket(query);
+
+    for (size_t i = 1; i + 3 <= length; i++)
+    {
+        uint32_t bucket = trigram_bucket(query + i);
+
+        if (starts[bucket + 1] - starts[bucket] < starts[rarest + 1] - starts[rarest])
+        {
+            rarest = bucket;
+        }
+    }
+
+    for (uint32_t p = starts[rarest]; p < starts[rarest + 1]; p++)
+    {
+        if (postings[p] >= before)
+        {
+            continue;
+        }
+
+        entry_at(postings[p], entry);
+
+        if (contains(entry, query, length))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief Posts each entry of the log once to the bucket of each of its
+ * trigrams, counting the postings of each bucket, or else filling them in.
+ *
+ * @param length    The length of the log to index.
+ * @param counts    Counts each bucket's postings, or NULL to fill them in.
+ * @param ends      Where each bucket's postings end, filled backwards.
+ * @param table     The postings filled in.
+ * @return The number of postings.
+ */
+static size_t post_entries(size_t length, uint32_t *counts, uint32_t *ends,
+    uint32_t *table)
+{
+    // The entry last posted to each bucket, plus one, not posted again.
+    uint32_t *stamps = calloc(INDEX_BUCKETS, sizeof(uint32_t));
+    check_allocation(stamps);
+    size_t npostings = 0;
+    HISTORY_ENTRY entry;
+
+    for (size_t offset = 0; offset < length; offset += entry.length + 1)
+    {
+        entry_at(offset, &entry);
+
+        for (size_t i = 0; i + 3 <= entry.length; i++)
+        {
+            uint32_t bucket = trigram_bucket(entry.text + i);
+
+            if (stamps[bucket] == offset + 1)
+            {
+                continue;
+            }
+
+            stamps[bucket] = offset + 1;
+            npostings++;
+
+            if (counts != NULL)
+            {
+                counts[bucket]++;
+            }
+            else
+            {
+                table[--ends[bucket]] = offset;
+            }
+        }
+    }
+
+    free(stamps);
+    return npostings;
+}
+
+/**
+ * @brief Rebuilds the index of the log. Its offsets are 32 bits, so a log
+ * beyond 4 GiB is indexed to there, and searched directly after it.
+ */
+static void reindex(void)
+{
+    size_t length = (mapped < UINT32_MAX) ? mapped : UINT32_MAX;
+
+    while ((length > 0) && (logtext[length - 1] != '\n'))
+    {
+        length--;
+    }
+
+    uint32_t *counts = calloc(INDEX_BUCKETS, sizeof(uint32_t));
+    check_allocation(counts);
+
+    size_t npostings = post_entries(length, counts, NULL, NULL);
+    size_t size = sizeof(INDEXHEADER)
+        + ((size_t) INDEX_BUCKETS + 1 + npostings) * sizeof(uint32_t);
+
+    char path[PATH_MAX], temp[PATH_MAX + 32];
+    snprintf(path, sizeof(path), "%s%s", logfile, INDEX_SUFFIX);
+    snprintf(temp, sizeof(temp), "%s.%ld", path, (long) getpid());
+    int fd = open(temp, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    void *mapping = MAP_FAILED;
+
+    if ((fd != -1) && (npostings <= UINT32_MAX) && (ftruncate(fd, size) == 0))
+    {
+        mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+
+    if (mapping != MAP_FAILED)
+    {
+        INDEXHEADER *header = mapping;
+        uint32_t *table = (uint32_t *) (header + 1);
+
+        // Each bucket is filled from its end, so it lists the latest first.
+        table[0] = 0;
+        for (uint32_t b = 0; b < INDEX_BUCKETS; b++)
+        {
+            table[b + 1] = table[b] + counts[b];
+        }
+
+        memcpy(counts, table + 1, INDEX_BUCKETS * sizeof(uint32_t));
+        post_entries(length, NULL, counts, table + INDEX_BUCKETS + 1);
+
+        memcpy(header->magic, INDEX_MAGIC, sizeof(header->magic));
+        header->version = INDEX_VERSION;
+        header->nbuckets = INDEX_BUCKETS;
+        header->device = logstat.st_dev;
+        header->inode = logstat.st_ino;
+        header->indexed = length;
+        header->npostings = npostings;
+        munmap(mapping, size);
+    }
+
+    if ((fd != -1) && ((close(fd) == -1) || (mapping == MAP_FAILED)
+        || (rename(temp, path) == -1)))
+    {
+        unlink(temp);
+    }
+
+    free(counts);
+}
+
+/**
+ * @brief Closes the history as the shell exits, first reindexing it if it
+ * has grown past its index by an eighth.
+ */
+void history_close(void)
+{
+    if ((logfd == -1) || (getpid() != shellpid))
+    {
+        return;
+    }
+
+    remap();
+
+    if ((mapped - indexed >= REINDEX_MIN) && (mapped - indexed >= indexed / 8))
+    {
+        reindex();
+    }
+
+    if (index_mapping != NULL)
+    {
+        munmap(index_mapping, index_size);
+        index_mapping = NULL;
+    }
+
+    if (logtext != NULL)
+    {
+        munmap((void *) logtext, mapped);
+        logtext = NULL;
+    }
+
+    close(logfd);
+    logfd = -1;
+    free(logfile);
+    free(last);
+    logfile = last = NULL;
+}
+
+/**
+ * @brief Counts the entries before an offset.
+ *
+ * @param offset    The offset, of an entry.
+ * @return The number of entries before it.
+ */
+static size_t count_entries(size_t offset)
+{
+    size_t n = 0;
+    const char *p = logtext, *end = logtext + offset;
+
+    while ((p < end) && ((p = memchr(p, '\n', end - p)) != NULL))
+    {
+        n++;
+        p++;
+    }
+
+    return n;
+}
+
+/**
+ * @brief Handles the history command. Lists the history, or its last N
+ * entries, numbered, or with -s lists the entries holding a string, the
+ * most recent first.
+ *
+ * @param t     The history shellcmd to handle.
+ * @return The exitstatus of the operation.
+ */
+int history_shellcmd(SHELLCMD *t)
+{
+    HISTORY_ENTRY entry;
+    size_t end = history_end();
+
+    if ((t->argc == 3) && (strcmp(t->argv[1], "-s") == 0))
+    {
+        int exitstatus = EXIT_FAILURE;
+
+        while (history_search(t->argv[2], end, &entry))
+        {
+            printf("%.*s\n", (int) entry.length, entry.text);
+            end = entry.offset;
+            exitstatus = EXIT_SUCCESS;
+        }
+
+        return exitstatus;
+    }
+
+    char *rest = NULL;
+    long n = (t->argc == 2) ? strtol(t->argv[1], &rest, 10) : LONG_MAX;
+
+    if ((t->argc > 2) || (n < 0) || ((rest != NULL) && (*rest != '\0')))
+    {
+        fprintf(stderr, "Usage: %s [N] | -s string\n", t->argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // Walk back N entries, then list them forwards.
+    size_t start = end;
+
+    for (long i = 0; (i < n) && history_entry_before(start, &entry); i++)
+    {
+        start = entry.offset;
+    }
+
+    size_t number = count_entries(start);
+
+    for (size_t offset = start; offset < end; offset += entry.length + 1)
+    {
+        entry_at(offset, &entry);
+        printf("%5zu  %.*s\n", ++number, (int) entry.length, entry.text);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,43 @@
+#pragma once
+/**
+ * @file    arena.h
+ * @author  Joshua Ng
+ * @brief   A bump allocator whose allocations are released together.
+ * @date    2026-10-18
+ */
+
+#include <stddef.h>
+
+struct ARENA_CHUNK;
+
+/**
+ * @brief An arena of memory chunks. Allocations bump a pointer through
+ * the current chunk and are all released at once by rewinding it. The
+ * chunks are kept for reuse until the arena is freed.
+ */
+typedef struct
+{
+    struct ARENA_CHUNK *head;       // The first chunk.
+    struct ARENA_CHUNK *current;    // The chunk being allocated from.
+    size_t used;                    // Bytes used of the current chunk.
+
+    size_t allocations;             // Number of arena allocations.
+    size_t mallocs;                 // Number of chunks malloc'ed.
+} ARENA;
+
+/**
+ * @brief A position in an arena to rewind to.
+ */
+typedef struct
+{
+    struct ARENA_CHUNK *chunk;
+    size_t used;
+} ARENA_MARK;
+
+void*       arena_alloc     (ARENA *arena, size_t size);
+void*       arena_calloc    (ARENA *arena, size_t size);
+char*       arena_strdup    (ARENA *arena, const char *string);
+ARENA_MARK  arena_mark      (ARENA *arena);
+void        arena_rewind    (ARENA *arena, ARENA_MARK mark);
+void        arena_reset     (ARENA *arena);
+void        arena_free      (ARENA *arena);
@@ -7,6 +7,19 @@
  */
 
 #include "myshell.h"
+#include <sys/resource.h>
 
-int background_shellcmd(SHELLCMD *t);
+int  background_shellcmd(SHELLCMD *t);
+void background_reap(void);
+void background_notify(void);
+pid_t background_wait(int *status, struct rusage *usage);
+void background_unowned(pid_t pid, int status, const struct rusage *usage);
+bool background_claim(pid_t pid, int *status, struct rusage *usage);
+int  background_token(void);
 void background_exit(void);
+void background_release(void);
+bool background_holding(void);
+void background_reset(void);
+int  jobs_shellcmd(SHELLCMD *t);
+int  wait_shellcmd(SHELLCMD *t);
+int  fg_shellcmd(SHELLCMD *t);
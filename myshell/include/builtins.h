@@ -0,0 +1,38 @@
+#pragma once
+/**
+ * @file    builtins.h
+ * @author  Joshua Ng
+ * @brief   Common utilities built into the shell, so that they run
+ *          without a fork and exec.
+ * @date    2026-10-18
+ */
+
+#include "myshell.h"
+#include <stdint.h>
+
+/**
+ * @brief Hashes a builtin's name (FNV-1a, seeded). The builtin table is
+ * generated with a seed and size under which no two names collide.
+ *
+ * @param name  The name to hash.
+ * @param seed  The seed.
+ * @return The hash of the name.
+ */
+static inline uint32_t builtin_hash(const char *name, uint32_t seed)
+{
+    uint32_t hash = 2166136261u ^ seed;
+
+    for (const char *ch = name; *ch != '\0'; ch++)
+    {
+        hash = (hash ^ (unsigned char) *ch) * 16777619u;
+    }
+
+    return hash;
+}
+
+int echo_shellcmd   (SHELLCMD *t);
+int true_shellcmd   (SHELLCMD *t);
+int false_shellcmd  (SHELLCMD *t);
+int test_shellcmd   (SHELLCMD *t);
+int pwd_shellcmd    (SHELLCMD *t);
+int printf_shellcmd (SHELLCMD *t);
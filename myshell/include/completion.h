@@ -0,0 +1,42 @@
+#pragma once
+/**
+ * @file    completion.h
+ * @author  Joshua Ng
+ * @brief   Completes command names, from a trie of the executables of the
+ *          PATH, and filenames, relative to the cwd.
+ * @date    2026-10-18
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief The candidates of a completion, sorted. Each is a whole word,
+ * including the directories a filename is completed in, and a directory
+ * ends with a '/'.
+ */
+typedef struct
+{
+    char    *pool;          // The candidates, each NUL terminated,
+    size_t  *offsets;       // starting at these offsets of the pool.
+    size_t  count, capacity;
+    size_t  length, pool_capacity;
+    bool    unique;         // True if only one word is matched.
+} COMPLETIONS;
+
+/**
+ * @brief Gets a candidate of a completion.
+ *
+ * @param c     The completion.
+ * @param i     The index of the candidate.
+ * @return The candidate.
+ */
+static inline const char *completion_name(const COMPLETIONS *c, size_t i)
+{
+    return c->pool + c->offsets[i];
+}
+
+void    completion_commands (const char *prefix, bool list, COMPLETIONS *c);
+void    completion_files    (const char *prefix, COMPLETIONS *c);
+size_t  completion_common   (const COMPLETIONS *c);
+void    completion_free     (COMPLETIONS *c);
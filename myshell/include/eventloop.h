@@ -0,0 +1,29 @@
+#pragma once
+/**
+ * @file    eventloop.h
+ * @author  Joshua Ng
+ * @brief   Waits for the shell's events: input, terminated children,
+ *          control-C and a timer, all at once and without busy-waiting.
+ * @date    2026-10-18
+ */
+
+#include <stdbool.h>
+#include <signal.h>
+
+/**
+ * @brief The events waited for, as bits.
+ */
+typedef enum
+{
+    EVENT_INPUT     = 1 << 0,   // The file descriptor waited on is readable.
+    EVENT_CHILD     = 1 << 1,   // A child has terminated, SIGCHLD.
+    EVENT_INTERRUPT = 1 << 2,   // Control-C, SIGINT, at an interactive shell.
+    EVENT_TIMER     = 1 << 3    // The timer has expired.
+} EVENT;
+
+void            eventloop_init      (void);
+unsigned        eventloop_wait      (int fd, unsigned events);
+bool            eventloop_take      (unsigned events);
+void            eventloop_timer     (int msec);
+void            eventloop_forked    (void);
+const sigset_t  *eventloop_sigmask  (void);
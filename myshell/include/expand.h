@@ -0,0 +1,49 @@
+#pragma once
+/**
+ * @file    expand.h
+ * @author  Joshua Ng
+ * @brief   Expands the words of a command before it is executed.
+ * @date    2026-10-18
+ */
+
+#include "myshell.h"
+#include "arena.h"
+
+/**
+ * The parser leaves the expansions in the words, marked by control chars
+ * that do not occur in commands, and they are expanded each time the
+ * command is executed, so that a cached or repeated command-tree is never
+ * expanded in advance.
+ */
+#define EXPAND_VARIABLE '\x01'  // $NAME: NAME, or ${NAME}: NAME, EXPAND_END
+#define EXPAND_QUOTED   '\x02'  // Starts a "quoted" word, not to be split.
+#define EXPAND_COMMAND  '\x03'  // $( cmd ): cmd, EXPAND_END
+#define EXPAND_PROCSUB  '\x04'  // <( cmd ) or >( cmd ): <, or >, cmd, EXPAND_END
+#define EXPAND_END      '\x05'  // Ends the command of a substitution.
+#define EXPAND_STAR     '\x06'  // An unquoted *, ? or [, a wildcard.
+#define EXPAND_QUESTION '\x0e'
+#define EXPAND_BRACKET  '\x0f'
+
+#define EXPAND_MARKERS  "\x01\x03\x04\x06\x0e\x0f"
+
+/**
+ * @brief The expansions of a command, undone by expand_free() once it has
+ * executed.
+ */
+typedef struct
+{
+    int     argc;           // The command's own words, restored after.
+    char    **argv;
+    char    *infile, *outfile;
+    char    **assignments;  // The command's leading NAME=value words.
+    int     nassignments;
+    ARENA   arena;          // Allocates the expanded words.
+    pid_t   *pids;          // The process substitutions' children
+    int     *fds;           // and the ends of their pipes kept.
+    size_t  nprocsubs, capacity;
+    char    **captures;     // The command substitutions' output, which
+    size_t  ncaptures, capturecapacity;     // the words point into.
+} EXPANSION;
+
+bool expand_shellcmd    (SHELLCMD *t, EXPANSION *e);
+void expand_free        (SHELLCMD *t, EXPANSION *e);
@@ -9,3 +9,4 @@
 #include "myshell.h"
 
 int external_shellcmd(SHELLCMD *);
+int exec_shellcmd(SHELLCMD *);
@@ -33,3 +33,6 @@ void check_error0(int result, char *file, const char *func, int line);
 
 
 void print_command_error(char *file, char *argv);
+pid_t shell_fork(void);
+int shell_wait(pid_t pid, const char *command);
+void shell_exit(int exitstatus);
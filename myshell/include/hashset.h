@@ -60,6 +60,7 @@ typedef struct {
 
 void **hashset_resize(HASHSET *set, void **elements, size_t capacity);
 bool hashset_contains(const HASHSET *set, const void *element);
+void *hashset_find(const HASHSET *set, const void *element);
 
 /**
  * @brief Result type for insertion and removal operations.
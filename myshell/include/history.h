@@ -0,0 +1,32 @@
+#pragma once
+/**
+ * @file    history.h
+ * @author  Joshua Ng
+ * @brief   The persistent command history: an append-only log, mapped into
+ *          memory, with a trigram index for searching it.
+ * @date    2026-10-18
+ */
+
+#include "myshell.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief An entry of the history. Its text points into the mapped log,
+ * and is valid until the history is next searched or walked.
+ */
+typedef struct
+{
+    const char  *text;      // Not terminated.
+    size_t      length;
+    size_t      offset;     // Where the entry starts in the log.
+} HISTORY_ENTRY;
+
+void    history_open        (void);
+void    history_add         (const char *line, size_t length);
+size_t  history_end         (void);
+bool    history_entry_before(size_t offset, HISTORY_ENTRY *entry);
+bool    history_entry_after (size_t offset, HISTORY_ENTRY *entry);
+bool    history_search      (const char *query, size_t before, HISTORY_ENTRY *entry);
+void    history_close       (void);
+int     history_shellcmd    (SHELLCMD *t);
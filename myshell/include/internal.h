@@ -13,10 +13,30 @@ typedef enum
     COMMAND_EXECUTE = 0,
     COMMAND_CD,
     COMMAND_EXIT,
-    COMMAND_TIME
+    COMMAND_TIME,
+    COMMAND_SET,
+    COMMAND_HASH,
+    COMMAND_ECHO,
+    COMMAND_TRUE,
+    COMMAND_FALSE,
+    COMMAND_TEST,
+    COMMAND_PWD,
+    COMMAND_PRINTF,
+    COMMAND_JOBS,
+    COMMAND_WAIT,
+    COMMAND_FG,
+    COMMAND_EXEC,
+    COMMAND_PARALLEL,
+    COMMAND_EXPORT,
+    COMMAND_HISTORY
 } COMMAND;
 
 COMMAND parse_cmd       (char*);
 int     exit_shellcmd   (SHELLCMD *, int);
 int     cd_shellcmd     (SHELLCMD *);
 int     time_shellcmd   (SHELLCMD *);
+bool    timed_pipeline  (SHELLCMD *);
+int     time_pipeline_shellcmd(SHELLCMD *);
+int     set_shellcmd    (SHELLCMD *);
+int     hash_shellcmd   (SHELLCMD *);
+int     export_shellcmd (SHELLCMD *);
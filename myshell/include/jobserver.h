@@ -0,0 +1,20 @@
+#pragma once
+/**
+ * @file    jobserver.h
+ * @author  Joshua Ng
+ * @brief   Takes part in the GNU make jobserver protocol, so that the
+ *          shell's jobs share make's limit on concurrent jobs.
+ * @date    2026-10-18
+ */
+
+#include <stdbool.h>
+
+#define JOBSERVER_NONE      (-1)    // No token was taken, or none is free.
+#define JOBSERVER_IMPLICIT  (-2)    // The token every process holds.
+
+void jobserver_init     (void);
+void jobserver_create   (long njobs);
+bool jobserver_active   (void);
+int  jobserver_fd       (void);
+int  jobserver_acquire  (void);
+void jobserver_release  (int token);
@@ -0,0 +1,17 @@
+#pragma once
+/**
+ * @file    lineedit.h
+ * @author  Joshua Ng
+ * @brief   Reads the lines typed at an interactive shell, with editing,
+ *          history and completion, and the lines of any other input as
+ *          they arrive.
+ * @date    2026-10-18
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+ssize_t lineedit_read   (const char *prompt, char **buffer, size_t *capacity);
+ssize_t lineedit_getline(char **buffer, size_t *capacity);
+bool    lineedit_closed (void);
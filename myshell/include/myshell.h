@@ -9,6 +9,7 @@
 
 #include <stdbool.h>
 #include <stdio.h>
+#include <sys/types.h>
 
 //  Written by Chris.McDonald@uwa.edu.au, October 2017
 
@@ -33,21 +34,30 @@ typedef enum
     CMD_OR,           // as in   cmd1 || cmd2    
     CMD_SUBSHELL,     // as in   ( cmds )
     CMD_PIPE,         // as in   cmd1 |  cmd2    
-    CMD_BACKGROUND    // as in   cmd1 &
+    CMD_BACKGROUND,   // as in   cmd1 &
+    CMD_IF,           // as in   if cmds ; then cmds ; else cmds ; fi
+    CMD_THEN,         // the then cmds and else cmds of an if
+    CMD_WHILE,        // as in   while cmds ; do cmds ; done
+    CMD_FOR           // as in   for name in words ; do cmds ; done
 } CMDTYPE;
 
 typedef struct sc 
 {
     CMDTYPE type;       // the type of the node, &&, ||, etc
 
-    int     argc;       // the number of args iff type == CMD_COMMAND
-    char    **argv;     // the NULL terminated argument vector
+    int     argc;       // the number of args iff CMD_COMMAND or CMD_FOR
+    char    **argv;     // the NULL terminated argument vector, or of
+                        // a CMD_FOR, its name then its words
 
     char    *infile;    // as in    cmd <  infile
     char    *outfile;   // as in    cmd >  outfile
     bool    append;     // true iff cmd >> outfile
 
     struct sc *left, *right;    // pointers to left and right sub-shellcmds
+
+    // if: left is the condition, right the CMD_THEN, whose left is the
+    // then cmds, right the else cmds. while: left is the condition, right
+    // the body. for: left is the body.
 } SHELLCMD;
 
 int execute_shellcmd(SHELLCMD *);
@@ -78,4 +88,9 @@ extern char *CDPATH;
 extern char *name0;         // The name of the shell, typically myshell
 extern char *argv0;         // The path of the shell
 extern bool interactive;    // True if myshell is connected to a 'terminal'
+extern bool pipefail;       // True if a pipeline fails when any stage fails
+extern bool scriptcache;    // True if parsed scripts are cached
+extern bool noexec;         // True if commands are parsed, not executed
+extern bool finalcommand;   // True if the command is the last of its process
+extern pid_t shellpid;      // The pid of the shell, not of its forked children
 
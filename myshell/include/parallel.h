@@ -0,0 +1,11 @@
+#pragma once
+/**
+ * @file    parallel.h
+ * @author  Joshua Ng
+ * @brief   Runs a command over a list of arguments, N at a time.
+ * @date    2026-10-18
+ */
+
+#include "myshell.h"
+
+int parallel_shellcmd(SHELLCMD *t);
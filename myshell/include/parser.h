@@ -8,6 +8,9 @@
  */
 
 #include "myshell.h"
+#include "arena.h"
 
-SHELLCMD *parse_shellcmd(FILE *_fp);
-void free_shellcmd(SHELLCMD *t);
+SHELLCMD *parse_shellcmd(FILE *_fp, ARENA *arena);
+SHELLCMD *parse_shellcmd_buffer(char *buffer, size_t length, size_t *offset,
+    ARENA *arena);
+size_t parse_rejected(void);
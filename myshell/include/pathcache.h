@@ -0,0 +1,15 @@
+#pragma once
+/**
+ * @file    pathcache.h
+ * @author  Joshua Ng
+ * @brief   Caches the PATH lookup of command names.
+ * @date    2026-10-18
+ */
+
+#include <stdbool.h>
+
+const char* pathcache_lookup    (const char* name);
+bool        pathcache_script    (const char* name);
+void        pathcache_revalidate(void);
+void        pathcache_clear     (void);
+void        pathcache_print     (void);
@@ -0,0 +1,54 @@
+#pragma once
+/**
+ * @file    program.h
+ * @author  Joshua Ng
+ * @brief   Lowers a command-tree to a flat array of instructions, with
+ *          explicit jumps for &&, ||, if, while and for, to be run by a
+ *          loop.
+ * @date    2026-10-18
+ */
+
+#include "myshell.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief The operations of an instruction.
+ */
+typedef enum
+{
+    OP_EXECUTE = 0,     // runs a command, a subshell or a pipeline
+    OP_BACKGROUND,      // runs a command-tree in the background
+    OP_JUMP_FAILURE,    // jumps if the last command failed
+    OP_JUMP_SUCCESS,    // jumps if the last command succeeded
+    OP_JUMP,            // jumps
+    OP_SUCCEED,         // succeeds, as an if without an else
+    OP_LOOP,            // starts a while, or a for, expanding its words
+    OP_WHILE,           // ends the loop, jumping, if its condition failed
+    OP_FOR,             // sets the for's next word, or ends the loop
+    OP_LOOP_END         // jumps back to the start of the loop
+} OPCODE;
+
+/**
+ * @brief An instruction of a program.
+ */
+typedef struct
+{
+    OPCODE      op;
+    bool        final;      // True if no command can run after this one.
+    SHELLCMD    *cmd;       // The command of OP_EXECUTE, OP_BACKGROUND
+                            // and OP_LOOP.
+    size_t      target;     // The instruction jumped to.
+} INSTRUCTION;
+
+/**
+ * @brief A program of instructions. Programs are appended to it, so one
+ * may run while another is lowered, e.g. for time or $( ).
+ */
+typedef struct
+{
+    INSTRUCTION *code;
+    size_t      count, capacity;
+} PROGRAM;
+
+size_t program_lower(PROGRAM *program, SHELLCMD *t, bool final);
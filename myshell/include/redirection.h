@@ -7,9 +7,22 @@
  */
 
 #include "myshell.h"
+#include <spawn.h>
+
+/**
+ * @brief A redirection: the file to open onto a file descriptor.
+ */
+typedef struct
+{
+    int         fd;
+    const char  *file;
+    int         flags;
+} REDIRECT;
 
 struct REDIRECTION;
 
-int redirection(char* file, int flags, int fd_old);
+bool redirection_apply(SHELLCMD *t);
 struct REDIRECTION* redirection_shellcmd(SHELLCMD *t);
 void free_redirection_shellcmd(SHELLCMD *t, struct REDIRECTION *r);
+void keep_redirection_shellcmd(struct REDIRECTION *r);
+void redirection_spawn_actions(SHELLCMD *t, posix_spawn_file_actions_t *actions);
@@ -0,0 +1,40 @@
+#pragma once
+/**
+ * @file    scriptcache.h
+ * @author  Joshua Ng
+ * @brief   Caches the parsed command-trees of shell scripts.
+ * @date    2026-10-18
+ */
+
+#include "myshell.h"
+#include "arena.h"
+#include <stdint.h>
+#include <sys/stat.h>
+
+/**
+ * @brief A script's cache file, either mapped to be executed from or
+ * being recorded as the script is parsed.
+ */
+typedef struct
+{
+    char        *file;          // The cache file's path, or NULL if none.
+    uint64_t    size;           // The script's size,
+    int64_t     mtime_sec;      // modification time,
+    int64_t     mtime_nsec;
+    uint64_t    hash;           // and content hash.
+
+    char        *mapping;       // The mapped cache file, if a hit.
+    size_t      mapping_size;
+    char        *data;          // The command-tree records.
+    size_t      length;
+    size_t      capacity;       // The capacity of data being recorded.
+    size_t      offset;         // The next record to execute.
+    uint32_t    nstatements;
+} SCRIPTCACHE;
+
+bool        scriptcache_open    (SCRIPTCACHE *cache, const char *path,
+                                    const char *script, const struct stat *sb);
+SHELLCMD*   scriptcache_next    (SCRIPTCACHE *cache, ARENA *arena);
+void        scriptcache_add     (SCRIPTCACHE *cache, SHELLCMD *t);
+void        scriptcache_store   (SCRIPTCACHE *cache);
+void        scriptcache_close   (SCRIPTCACHE *cache);
@@ -8,4 +8,8 @@
 
 #include "myshell.h"
 
-int shellscript_shellcmd(SHELLCMD *t);
+bool shellscript_detect(const char *path);
+bool shellscript_named(const char *path);
+int shellscript_run(const char *path);
+int shellscript_buffer(char *buffer, size_t length);
+int shellscript_shellcmd(SHELLCMD *t, const char *path);
@@ -0,0 +1,51 @@
+#pragma once
+/**
+ * @file    timing.h
+ * @author  Joshua Ng
+ * @brief   Resource accounting of timed commands, for the time builtin.
+ * @date    2026-10-18
+ */
+
+#include <stddef.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+
+/**
+ * @brief The output formats of the time builtin.
+ */
+typedef enum
+{
+    TIMING_TEXT = 0,    // A table, for people.
+    TIMING_KV,          // key=value lines.
+    TIMING_JSON         // A JSON object.
+} TIMING_FORMAT;
+
+/**
+ * @brief The resources used by one child, e.g. a stage of a pipeline.
+ */
+typedef struct
+{
+    pid_t           pid;
+    const char      *command;
+    int             exitstatus;
+    struct rusage   usage;
+} TIMING_STAGE;
+
+/**
+ * @brief A timed command. The children waited for while it runs are
+ * recorded as its stages, and the shell's own usage, for builtins, apart.
+ */
+typedef struct TIMING
+{
+    struct TIMING   *outer;     // The timing this one is nested in.
+    struct timespec start;
+    struct rusage   self;       // The shell's usage at the start, then used.
+    TIMING_STAGE    *stages;
+    size_t          nstages, capacity;
+} TIMING;
+
+void timing_begin   (TIMING *timing);
+void timing_record  (pid_t pid, const char *command, int exitstatus,
+                        const struct rusage *usage);
+void timing_end     (TIMING *timing, int exitstatus, TIMING_FORMAT format);
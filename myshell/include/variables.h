@@ -0,0 +1,24 @@
+#pragma once
+/**
+ * @file    variables.h
+ * @author  Joshua Ng
+ * @brief   The shell's variables, and the environment of the commands it
+ *          runs, made of its exported variables.
+ * @date    2026-10-18
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+void        variables_init      (char **envp);
+size_t      variable_name       (const char *s);
+bool        variable_assignment (const char *word);
+const char* variable_get        (const char *name, size_t length);
+void        variable_set        (const char *assignment, bool exported);
+void        variable_export     (const char *name);
+size_t      variables_assign    (char **assignments, int n, bool temporary);
+void        variables_restore   (size_t mark);
+size_t      variables_save      (void);
+void        variables_rollback  (size_t mark);
+void        variables_reset     (void);
+char**      variables_environ   (void);
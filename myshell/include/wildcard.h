@@ -0,0 +1,17 @@
+#pragma once
+/**
+ * @file    wildcard.h
+ * @author  Joshua Ng
+ * @brief   Expands the wildcards of a word, *, ?, [...] and **, into the
+ *          paths they match.
+ * @date    2026-10-18
+ */
+
+#include "arena.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+bool    wildcard_marked     (const char *word, size_t length);
+char*   wildcard_literal    (const char *pattern, ARENA *arena);
+size_t  wildcard_expand     (const char *pattern, ARENA *arena, char ***paths);
+void    wildcard_revalidate (void);
@@ -10,51 +10,42 @@
 #include "globals.h"
 #include "filepaths.h"
 #include "searchpath.h"
-#include "simplemap.h"
+#include "pathcache.h"
+#include "builtins.h"
+#include "timing.h"
+#include "pipeline.h"
+#include "variables.h"
 #include <stdlib.h>
 #include <string.h>
-#include <sys/time.h>
 #include <unistd.h>
 
 /**
- * @brief Parser for internal command enums.
+ * @brief An entry of the builtin table.
  */
-typedef struct SIMPLEMAP* CMDPARSER;
-
-/**
- * @brief Get the cmd parser object.
- * 
- * @return A static cmd parser object.
- */
-static CMDPARSER get_cmd_parser(void) 
+typedef struct
 {
-    static CMDPARSER map;
-
-    if (map == NULL)
-    {
-        map = simplemap_create();
-        simplemap_insert(map, "cd", (int) COMMAND_CD);
-        simplemap_insert(map, "exit", (int) COMMAND_EXIT);
-        simplemap_insert(map, "time", (int) COMMAND_TIME);
-    }
+    const char  *name;
+    COMMAND     command;
+} BUILTIN_ENTRY;
 
-    return map;
-}
+// The table is generated from builtins.def by gen_builtins, at build time.
+#include "builtin_table.h"
 
 /**
- * @brief Looks up a string command and returns command enum.
+ * @brief Looks up a string command and returns command enum. The builtin
+ * table is a perfect hash, so one comparison decides.
  * 
  * @param command   The string command to lookup.
  * @return The requested command enum.
  */
 COMMAND parse_cmd(char* command)
 {
-    CMDPARSER cmd_parser = get_cmd_parser();
-    int index = simplemap_search(cmd_parser, command);
+    const BUILTIN_ENTRY *entry =
+        &builtin_table[builtin_hash(command, BUILTIN_SEED) % BUILTIN_SLOTS];
 
-    if (index != -1)
+    if ((entry->name != NULL) && (strcmp(entry->name, command) == 0))
     {
-        return (COMMAND) simplemap_getvalue(cmd_parser, index);
+        return entry->command;
     }
     
     return COMMAND_EXECUTE;
@@ -80,7 +71,8 @@ int exit_shellcmd(SHELLCMD *t, int exitstatus)
         }
     }
 
-    exit(exitstatus);
+    shell_exit(exitstatus);
+    return exitstatus;
 }
 
 /**
@@ -121,46 +113,224 @@ int cd_shellcmd(SHELLCMD *t)
 }
 
 /**
- * @brief Handles the time command.
+ * @brief Parses the options of the time command, i.e. --format=.
+ *
+ * @param t         The time shellcmd.
+ * @param format    Set to the output format.
+ * @return The number of words of the time command, or -1 on error.
+ */
+static int time_options(SHELLCMD *t, TIMING_FORMAT *format)
+{
+    *format = TIMING_TEXT;
+
+    if ((t->argc < 2) || (strncmp(t->argv[1], "--format=", 9) != 0))
+    {
+        return 1;
+    }
+
+    const char *name = t->argv[1] + 9;
+
+    if (strcmp(name, "kv") == 0)
+    {
+        *format = TIMING_KV;
+    }
+    else if (strcmp(name, "json") == 0)
+    {
+        *format = TIMING_JSON;
+    }
+    else if (strcmp(name, "text") != 0)
+    {
+        fprintf(stderr, "%s: time: unknown format: %s\n", name0, name);
+        return -1;
+    }
+
+    return 2;
+}
+
+/**
+ * @brief Handles the time command. Reports the wall clock time of the
+ * command, and the usage of each child it waited for, to stderr.
+ * time --format=kv or --format=json prints the same for scripts to read.
  * 
  * @param t     The time shellcmd to handle.
  * @return The exitstatus of the operation. 
  */
 int time_shellcmd(SHELLCMD *t)
 {
-    if ((t->argc == 1) && (t->left == NULL))
+    TIMING_FORMAT format;
+    int skip = time_options(t, &format);
+
+    if (skip < 0)
     {
-        fprintf(stderr, "\n 0 msec\n");
-        return EXIT_SUCCESS;
+        return EXIT_FAILURE;
     }
 
-    struct timeval start;
-    struct timeval end;
-    long elapsed = 0;
+    TIMING timing;
     int exitstatus = EXIT_SUCCESS;
+    timing_begin(&timing);
 
-    check_error(gettimeofday(&start, NULL));
-
-    if (t->argc > 1)
+    if (t->argc > skip)
     {
-        t->argc--;
-        t->argv++;
+        t->argc -= skip;
+        t->argv += skip;
         exitstatus = execute_shellcmd(t);
-        t->argc++;
-        t->argv--;
+        t->argc += skip;
+        t->argv -= skip;
     }
     else if (t->left != NULL)
     {
         exitstatus = execute_shellcmd(t->left);
     }
 
-    check_error(gettimeofday(&end, NULL));
+    timing_end(&timing, exitstatus, format);
+    return exitstatus;
+}
+
+/**
+ * @brief Checks if a pipeline is timed, i.e. its first stage is a time
+ * command with a command to time.
+ *
+ * @param t     The pipeline shellcmd.
+ * @return True if the pipeline is timed.
+ */
+bool timed_pipeline(SHELLCMD *t)
+{
+    SHELLCMD *first = t->left;
+    TIMING_FORMAT format;
+
+    return (first != NULL) && (first->type == CMD_COMMAND)
+        && (first->argc > 0) && (parse_cmd(first->argv[0]) == COMMAND_TIME)
+        && (first->argc > time_options(first, &format));
+}
+
+/**
+ * @brief Times a whole pipeline, time cmd1 | cmd2, with a row per stage.
+ *
+ * @param t     The pipeline shellcmd, its first stage starting with time.
+ * @return The exitstatus of the pipeline.
+ */
+int time_pipeline_shellcmd(SHELLCMD *t)
+{
+    SHELLCMD *first = t->left;
+    TIMING_FORMAT format;
+    int skip = time_options(first, &format);
+
+    if (skip < 0)
+    {
+        return EXIT_FAILURE;
+    }
+
+    TIMING timing;
+    timing_begin(&timing);
+    first->argc -= skip;
+    first->argv += skip;
+    int exitstatus = pipeline_shellcmd(t);
+    first->argc += skip;
+    first->argv -= skip;
+    timing_end(&timing, exitstatus, format);
+    return exitstatus;
+}
 
-    // Take difference in time in milliseconds.
-    elapsed = (end.tv_sec - start.tv_sec) * 1000000;
-    elapsed += end.tv_usec - start.tv_usec;
-    elapsed /= 1000;
+/**
+ * @brief Handles the set command. Supports setting and clearing shell
+ * options, i.e. set -o pipefail, set +o pipefail. Without an option name
+ * prints the current options.
+ *
+ * @param t     The set shellcmd to handle.
+ * @return The exitstatus of the operation.
+ */
+int set_shellcmd(SHELLCMD *t)
+{
+    if (t->argc < 3)
+    {
+        printf("pipefail\t%s\n", pipefail ? "on" : "off");
+        fflush(stdout);
+        return EXIT_SUCCESS;
+    }
+
+    bool enable = (strcmp(t->argv[1], "-o") == 0);
+
+    if ((!enable && (strcmp(t->argv[1], "+o") != 0))
+        || (strcmp(t->argv[2], "pipefail") != 0))
+    {
+        fprintf(stderr, "%s: %s %s: invalid option\n",
+            t->argv[0], t->argv[1], t->argv[2]);
+        return EXIT_FAILURE;
+    }
+
+    pipefail = enable;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Handles the hash command. Without arguments prints the cached
+ * PATH lookups, with -r forgets them, else looks up each name.
+ *
+ * @param t     The hash shellcmd to handle.
+ * @return The exitstatus of the operation.
+ */
+int hash_shellcmd(SHELLCMD *t)
+{
+    int exitstatus = EXIT_SUCCESS;
+
+    if (t->argc == 1)
+    {
+        pathcache_print();
+        return exitstatus;
+    }
+
+    if (strcmp(t->argv[1], "-r") == 0)
+    {
+        pathcache_clear();
+        return exitstatus;
+    }
+
+    for (int a = 1; a < t->argc; a++)
+    {
+        if ((strchr(t->argv[a], '/') == NULL)
+            && (pathcache_lookup(t->argv[a]) == NULL))
+        {
+            fprintf(stderr, "%s: %s: not found\n", t->argv[0], t->argv[a]);
+            exitstatus = EXIT_FAILURE;
+        }
+    }
+
+    return exitstatus;
+}
+
+/**
+ * @brief Handles the export command. Exports each variable named, or
+ * assigned as NAME=value, else prints the exported variables.
+ *
+ * @param t     The export shellcmd to handle.
+ * @return The exitstatus of the operation.
+ */
+int export_shellcmd(SHELLCMD *t)
+{
+    int exitstatus = EXIT_SUCCESS;
+
+    if (t->argc == 1)
+    {
+        for (char **e = variables_environ(); *e != NULL; e++)
+        {
+            printf("export %s\n", *e);
+        }
+        return exitstatus;
+    }
+
+    for (int a = 1; a < t->argc; a++)
+    {
+        size_t length = variable_name(t->argv[a]);
+
+        if ((length == 0) || ((t->argv[a][length] != '\0') && (t->argv[a][length] != '=')))
+        {
+            fprintf(stderr, "%s: %s: not a valid name\n", t->argv[0], t->argv[a]);
+            exitstatus = EXIT_FAILURE;
+            continue;
+        }
+
+        variable_export(t->argv[a]);
+    }
 
-    check_error(fprintf(stderr, "\n %ld msec\n", elapsed));
     return exitstatus;
 }
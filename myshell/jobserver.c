@@ -0,0 +1,221 @@
+/**
+ * @file    jobserver.c
+ * @author  Joshua Ng
+ * @brief   Takes part in the GNU make jobserver protocol, so that the
+ *          shell's jobs share make's limit on concurrent jobs.
+ * @date    2026-10-18
+ */
+
+#include "jobserver.h"
+#include "globals.h"
+#include "variables.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+/**
+ * make passes the jobserver down in MAKEFLAGS, as
+ * --jobserver-auth=fifo:PATH (make 4.4), or as --jobserver-auth=R,W or
+ * --jobserver-fds=R,W, the ends of a pipe. The pipe holds a token, a
+ * byte, for each job that may run besides the one every process may run
+ * without a token. A job takes a token before it starts and writes it
+ * back when it is done.
+ *
+ * The implicit token, that every process holds, goes to its first job.
+ * Tokens are only ever taken without blocking, so the shell can wait for
+ * its own jobs to finish, and give back their tokens, meanwhile. The read
+ * end is opened anew where possible, its own open file description made
+ * non-blocking without affecting make's.
+ */
+
+static int  readfd  = -1;
+static int  writefd = -1;
+static bool shared  = false;    // True if reads must poll the shared fd.
+static bool implicit = false;   // True if the implicit token is taken.
+
+/**
+ * @brief Checks if a file descriptor is open.
+ *
+ * @param fd    The file descriptor.
+ * @return True if fd is open.
+ */
+static bool fd_open(int fd)
+{
+    return (fd >= 0) && (fcntl(fd, F_GETFD) != -1);
+}
+
+/**
+ * @brief Uses a jobserver pipe.
+ *
+ * @param r     The pipe's read end.
+ * @param w     The pipe's write end.
+ */
+static void jobserver_pipe(int r, int w)
+{
+    char path[32];
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", r);
+    readfd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    shared = (readfd == -1);
+    readfd = shared ? r : readfd;
+    writefd = w;
+}
+
+/**
+ * @brief Uses the jobserver named by a --jobserver-auth value.
+ *
+ * @param auth  The value, ending at a space or the end of MAKEFLAGS.
+ */
+static void jobserver_open(const char *auth)
+{
+    if (strncmp(auth, "fifo:", 5) == 0)
+    {
+        size_t length = strcspn(auth + 5, " ");
+        char *path = strndup(auth + 5, length);
+        check_allocation(path);
+
+        // One descriptor of our own reads and writes tokens.
+        readfd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+        writefd = readfd;
+        free(path);
+        return;
+    }
+
+    int r, w;
+    if ((sscanf(auth, "%d,%d", &r, &w) != 2) || !fd_open(r) || !fd_open(w))
+    {
+        return;     // make did not pass the pipe to this command.
+    }
+
+    jobserver_pipe(r, w);
+}
+
+/**
+ * @brief Finds a jobserver in MAKEFLAGS, if the shell was run by make.
+ */
+void jobserver_init(void)
+{
+    const char *makeflags = getenv("MAKEFLAGS");
+    const char *options[] = {"--jobserver-auth=", "--jobserver-fds="};
+
+    for (size_t i = 0; (makeflags != NULL) && (i < 2) && (readfd == -1); i++)
+    {
+        const char *auth = strstr(makeflags, options[i]);
+
+        if (auth != NULL)
+        {
+            jobserver_open(auth + strlen(options[i]));
+        }
+    }
+}
+
+/**
+ * @brief Creates a jobserver for njobs concurrent jobs, for the shell and
+ * the commands it runs, e.g. make, when the shell is run with -j.
+ *
+ * @param njobs     The number of concurrent jobs.
+ */
+void jobserver_create(long njobs)
+{
+    int fd[2];
+    check_error(pipe(fd));
+
+    // The shell's own job needs no token.
+    for (long i = 1; i < njobs; i++)
+    {
+        check_error(write(fd[1], "+", 1));
+    }
+
+    char makeflags[64];
+    snprintf(makeflags, sizeof(makeflags), " -j%ld --jobserver-auth=%d,%d",
+        njobs, fd[0], fd[1]);
+    char assignment[80];
+    snprintf(assignment, sizeof(assignment), "MAKEFLAGS=%s", makeflags);
+    variable_set(assignment, true);
+
+    jobserver_pipe(fd[0], fd[1]);
+}
+
+/**
+ * @brief Checks if there is a jobserver.
+ *
+ * @return True if jobs must take a token.
+ */
+bool jobserver_active(void)
+{
+    return readfd != -1;
+}
+
+/**
+ * @brief Gets the file descriptor to poll for a free token.
+ *
+ * @return The jobserver's read end, or -1.
+ */
+int jobserver_fd(void)
+{
+    return readfd;
+}
+
+/**
+ * @brief Takes a token, if one is free, without blocking.
+ *
+ * @return The token, JOBSERVER_IMPLICIT, or JOBSERVER_NONE if none is free.
+ */
+int jobserver_acquire(void)
+{
+    if (!implicit)
+    {
+        implicit = true;
+        return JOBSERVER_IMPLICIT;
+    }
+
+    if (shared)
+    {
+        // Another process may take the token first, then the read blocks
+        // until the next is free.
+        struct pollfd pfd = {.fd = readfd, .events = POLLIN};
+
+        if (poll(&pfd, 1, 0) != 1)
+        {
+            return JOBSERVER_NONE;
+        }
+    }
+
+    unsigned char token;
+    ssize_t n;
+
+    while (((n = read(readfd, &token, 1)) == -1) && (errno == EINTR))
+    {
+        continue;
+    }
+
+    return (n == 1) ? token : JOBSERVER_NONE;
+}
+
+/**
+ * @brief Gives a token back.
+ *
+ * @param token     The token, or JOBSERVER_NONE if none was taken.
+ */
+void jobserver_release(int token)
+{
+    if (token == JOBSERVER_IMPLICIT)
+    {
+        implicit = false;
+        return;
+    }
+
+    if ((token < 0) || (writefd == -1))
+    {
+        return;
+    }
+
+    unsigned char byte = (unsigned char) token;
+
+    while ((write(writefd, &byte, 1) == -1) && (errno == EINTR))
+    {
+        continue;
+    }
+}
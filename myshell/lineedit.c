@@ -0,0 +1,982 @@
+/**
+ * @file    lineedit.c
+ * @author  Joshua Ng
+ * @brief   Reads the lines typed at an interactive shell, with editing,
+ *          history and completion, and the lines of any other input as
+ *          they arrive.
+ * @date    2026-10-18
+ */
+
+#include "lineedit.h"
+#include "globals.h"
+#include "history.h"
+#include "completion.h"
+#include "background.h"
+#include "eventloop.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+
+/**
+ * The terminal is put in raw mode while a line is read, and back in its
+ * own mode for the commands run. The keys are read as many as are waiting
+ * at once, and the line is redrawn once they have all been handled, with
+ * a single write, so a paste is not redrawn for each of its chars. A line
+ * wider than the terminal scrolls sideways to keep the cursor in view.
+ *
+ * Tab completes the word before the cursor: a command name, from the
+ * executables of the PATH, in the first word of a command, else a
+ * filename. A second Tab lists the candidates, if they have no longer
+ * prefix in common. Up and down walk the history, and control-R searches
+ * it backwards as the query is typed.
+ *
+ * The keys are waited for in the event loop, with the shell's children.
+ * A job that finishes while a line is edited is notified at once, above
+ * the line, which is then redrawn. A lone escape key, not followed by the
+ * rest of a sequence within ESCAPE_MSEC, is ignored.
+ *
+ * Input that is not typed at a terminal is read in blocks, as it arrives,
+ * and split into lines, the jobs being reaped while the shell waits.
+ */
+
+#define KEY_CTRL(c)     ((c) & 0x1f)
+#define KEY_ESCAPE      27
+#define KEY_BACKSPACE   127
+#define WORD_BREAKS     " \t;|&<>()"
+#define COMMAND_BREAKS  ";|&("
+#define SPECIAL_CHARS   " \t\\'\"$&|;<>()*?[#~"     // Escaped as completed.
+#define LIST_MAX        100     // The most candidates listed unasked.
+#define QUERY_MAX       256
+#define AT_BOTTOM       SIZE_MAX
+#define ESCAPE_MSEC     100     // The wait for the rest of a sequence.
+#define KEY_TIMEOUT     -2      // No key came before the timer expired.
+#define INPUT_BLOCK     4096    // The input not typed, read at once.
+
+/**
+ * @brief The line being edited.
+ */
+typedef struct
+{
+    char        **buffer;       // The caller's buffer, as for getline().
+    size_t      *capacity;
+    size_t      length, cursor;
+    const char  *prompt;        // The last line of the prompt.
+    size_t      prompt_length;
+    size_t      columns;
+    bool        dirty;          // True if the line is to be redrawn.
+    size_t      history;        // The entry shown, or AT_BOTTOM.
+    char        *saved;         // The line typed, while an entry is shown.
+    size_t      saved_length;
+} LINE;
+
+static bool             closed = false;     // True once input has ended.
+static unsigned char    keys[256];          // Keys read, not yet handled.
+static size_t           nkeys = 0, next_key = 0;
+static char             *output = NULL;     // A redraw, written at once.
+static size_t           output_length = 0, output_capacity = 0;
+static char             *ahead = NULL;      // Input read past the line.
+static size_t           nahead = 0, next_ahead = 0;
+
+/**
+ * @brief Checks if input has ended, with control-D on an empty line, or
+ * at the end of the input not typed.
+ *
+ * @return True if input has ended.
+ */
+bool lineedit_closed(void)
+{
+    return closed;
+}
+
+/**
+ * @brief Adds to the output to write.
+ *
+ * @param s         The chars to add.
+ * @param length    The number of chars.
+ */
+static void append(const char *s, size_t length)
+{
+    if (output_length + length > output_capacity)
+    {
+        output_capacity = 2 * (output_length + length);
+        output = realloc(output, output_capacity);
+        check_allocation(output);
+    }
+
+    memcpy(output + output_length, s, length);
+    output_length += length;
+}
+
+/**
+ * @brief Writes the output.
+ */
+static void flush_output(void)
+{
+    for (size_t written = 0; written < output_length; )
+    {
+        ssize_t n = write(STDOUT_FILENO, output + written, output_length - written);
+
+        if ((n == -1) && (errno != EINTR))
+        {
+            break;
+        }
+        written += (n > 0) ? (size_t) n : 0;
+    }
+
+    output_length = 0;
+}
+
+/**
+ * @brief Redraws the prompt and the visible part of the line, then puts
+ * the cursor in place.
+ *
+ * @param l     The line.
+ */
+static void redraw(LINE *l)
+{
+    size_t width = (l->columns > l->prompt_length + 1)
+        ? l->columns - l->prompt_length - 1 : 1;
+    size_t start = (l->cursor > width) ? l->cursor - width : 0;
+    size_t visible = (l->length - start < width) ? l->length - start : width;
+    char move[32];
+
+    append("\r", 1);
+    append(l->prompt, l->prompt_length);
+    append(*l->buffer + start, visible);
+    append("\x1b[0K\r", 5);
+
+    if (l->prompt_length + l->cursor - start > 0)
+    {
+        int n = snprintf(move, sizeof(move), "\x1b[%zuC",
+            l->prompt_length + l->cursor - start);
+        append(move, n);
+    }
+
+    flush_output();
+    l->dirty = false;
+}
+
+/**
+ * @brief Notifies the jobs that have finished, above the line, which is
+ * redrawn after.
+ *
+ * @param l     The line.
+ */
+static void notify(LINE *l)
+{
+    append("\r\x1b[0K", 5);
+    flush_output();
+    background_notify();
+    l->dirty = true;
+}
+
+/**
+ * @brief Reads the next key, first redrawing the line once all the keys
+ * already read have been handled. The jobs that finish meanwhile are
+ * notified.
+ *
+ * @param l     The line.
+ * @param msec  The most milliseconds to wait for a key, or 0 to wait on.
+ * @return The key, KEY_TIMEOUT, or -1 at the end of input.
+ */
+static int read_key_within(LINE *l, int msec)
+{
+    bool timed = (next_key == nkeys) && (msec > 0);
+    int key = 0;
+
+    if (timed)
+    {
+        eventloop_timer(msec);
+    }
+
+    while ((next_key == nkeys) && (key == 0))
+    {
+        if (l->dirty)
+        {
+            redraw(l);
+        }
+
+        unsigned events = eventloop_wait(STDIN_FILENO, EVENT_INPUT
+            | EVENT_CHILD | EVENT_INTERRUPT | (timed ? EVENT_TIMER : 0));
+
+        if (events & EVENT_CHILD)
+        {
+            notify(l);
+        }
+
+        // A SIGINT, e.g. from kill, is taken as control-C.
+        if (events & EVENT_INTERRUPT)
+        {
+            key = KEY_CTRL('C');
+        }
+        else if (events & EVENT_TIMER)
+        {
+            key = KEY_TIMEOUT;
+            timed = false;
+        }
+        else if (events & EVENT_INPUT)
+        {
+            ssize_t n = read(STDIN_FILENO, keys, sizeof(keys));
+
+            if ((n == 0) || ((n == -1) && (errno != EINTR) && (errno != EAGAIN)))
+            {
+                key = -1;
+            }
+
+            nkeys = (n > 0) ? (size_t) n : 0;
+            next_key = 0;
+        }
+    }
+
+    if (timed)
+    {
+        eventloop_timer(0);
+    }
+
+    return (key != 0) ? key : keys[next_key++];
+}
+
+/**
+ * @brief Reads the next key, waiting for it as long as it takes.
+ *
+ * @param l     The line.
+ * @return The key, or -1 at the end of input.
+ */
+static int read_key(LINE *l)
+{
+    return read_key_within(l, 0);
+}
+
+/**
+ * @brief Makes room in the line's buffer.
+ *
+ * @param l     The line.
+ * @param size  The size needed.
+ */
+static void reserve(LINE *l, size_t size)
+{
+    if (size > *l->capacity)
+    {
+        *l->capacity = 2 * size;
+        *l->buffer = realloc(*l->buffer, *l->capacity);
+        check_allocation(*l->buffer);
+    }
+}
+
+/**
+ * @brief Inserts chars at the cursor.
+ *
+ * @param l         The line.
+ * @param s         The chars.
+ * @param length    The number of chars.
+ */
+static void insert(LINE *l, const char *s, size_t length)
+{
+    reserve(l, l->length + length + 2);
+    char *line = *l->buffer;
+    memmove(line + l->cursor + length, line + l->cursor, l->length - l->cursor);
+    memcpy(line + l->cursor, s, length);
+    l->length += length;
+    l->cursor += length;
+}
+
+/**
+ * @brief Deletes chars from the line.
+ *
+ * @param l     The line.
+ * @param from  The first char to delete.
+ * @param to    The char after the last to delete.
+ */
+static void delete(LINE *l, size_t from, size_t to)
+{
+    char *line = *l->buffer;
+    memmove(line + from, line + to, l->length - to);
+    l->length -= to - from;
+    l->cursor = (l->cursor > to) ? l->cursor - (to - from)
+        : (l->cursor > from) ? from : l->cursor;
+}
+
+/**
+ * @brief Replaces the line, putting the cursor at its end.
+ *
+ * @param l         The line.
+ * @param text      The new line.
+ * @param length    The length of the new line.
+ */
+static void set_line(LINE *l, const char *text, size_t length)
+{
+    l->length = l->cursor = 0;
+    insert(l, text, length);
+}
+
+/**
+ * @brief Shows the entry of the history before the one shown, keeping
+ * the line typed to come back to.
+ *
+ * @param l     The line.
+ */
+static void history_up(LINE *l)
+{
+    HISTORY_ENTRY entry;
+    size_t from = (l->history == AT_BOTTOM) ? history_end() : l->history;
+
+    if (!history_entry_before(from, &entry))
+    {
+        return;
+    }
+
+    if (l->history == AT_BOTTOM)
+    {
+        free(l->saved);
+        l->saved = malloc(l->length + 1);
+        check_allocation(l->saved);
+        memcpy(l->saved, *l->buffer, l->length);
+        l->saved_length = l->length;
+    }
+
+    set_line(l, entry.text, entry.length);
+    l->history = entry.offset;
+}
+
+/**
+ * @brief Shows the entry of the history after the one shown, or the line
+ * typed after the last.
+ *
+ * @param l     The line.
+ */
+static void history_down(LINE *l)
+{
+    HISTORY_ENTRY entry;
+
+    if (l->history == AT_BOTTOM)
+    {
+        return;
+    }
+
+    if (history_entry_after(l->history, &entry))
+    {
+        set_line(l, entry.text, entry.length);
+        l->history = entry.offset;
+        return;
+    }
+
+    set_line(l, l->saved, l->saved_length);
+    l->history = AT_BOTTOM;
+}
+
+/**
+ * @brief Searches the history backwards as the query is typed, showing
+ * the entry found. Control-R finds the entry before, control-G gives up
+ * the search, and any other key takes the entry to edit.
+ *
+ * @param l     The line.
+ * @return True if the entry is taken with Enter, to be run.
+ */
+static bool search(LINE *l)
+{
+    const char *prompt = l->prompt;
+    size_t prompt_length = l->prompt_length;
+    char *original = malloc(l->length + 1);
+    check_allocation(original);
+    memcpy(original, *l->buffer, l->length);
+    size_t original_length = l->length;
+
+    char query[QUERY_MAX], display[QUERY_MAX + 32];
+    size_t length = 0, before = history_end();
+    bool found = true, taken = false;
+    HISTORY_ENTRY entry;
+    query[0] = '\0';
+
+    for (;;)
+    {
+        snprintf(display, sizeof(display), "(%sreverse-i-search)`%s': ",
+            found ? "" : "failed ", query);
+        l->prompt = display;
+        l->prompt_length = strlen(display);
+        l->dirty = true;
+
+        int key = read_key(l);
+        size_t from = history_end();
+
+        if ((key == KEY_CTRL('R')) && (length > 0))
+        {
+            from = before;
+        }
+        else if (((key == KEY_BACKSPACE) || (key == KEY_CTRL('H'))) && (length > 0))
+        {
+            query[--length] = '\0';
+        }
+        else if ((key >= ' ') && (key != KEY_BACKSPACE) && (length + 1 < QUERY_MAX))
+        {
+            query[length++] = key;
+            query[length] = '\0';
+        }
+        else if ((key == KEY_CTRL('G')) || (key == -1))
+        {
+            set_line(l, original, original_length);
+            break;
+        }
+        else
+        {
+            // The key is handled again, once the entry is taken.
+            taken = (key == '\r') || (key == '\n');
+            next_key -= !taken;
+            break;
+        }
+
+        found = history_search(query, from, &entry);
+
+        if (found)
+        {
+            set_line(l, entry.text, entry.length);
+            before = entry.offset;
+
+            // The cursor is put on the query, in the entry.
+            for (l->cursor = 0; (length > 0) && (l->cursor + length <= l->length)
+                && (memcmp(*l->buffer + l->cursor, query, length) != 0); l->cursor++)
+            {
+            }
+        }
+    }
+
+    free(original);
+    l->prompt = prompt;
+    l->prompt_length = prompt_length;
+    l->history = AT_BOTTOM;
+    l->dirty = true;
+    return taken;
+}
+
+/**
+ * @brief Inserts a completion, escaping the chars special to the parser.
+ *
+ * @param l         The line.
+ * @param s         The completion.
+ * @param length    The length of the completion.
+ */
+static void insert_escaped(LINE *l, const char *s, size_t length)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        if (strchr(SPECIAL_CHARS, s[i]) != NULL)
+        {
+            insert(l, "\\", 1);
+        }
+        insert(l, s + i, 1);
+    }
+}
+
+/**
+ * @brief Lists the candidates of a completion in columns, below the line,
+ * asking first if there are many.
+ *
+ * @param l     The line.
+ * @param c     The completion.
+ * @param skip  The length of the directories shared by the candidates.
+ */
+static void list_candidates(LINE *l, const COMPLETIONS *c, size_t skip)
+{
+    char text[64];
+    append("\n", 1);
+
+    if (c->count > LIST_MAX)
+    {
+        int n = snprintf(text, sizeof(text),
+            "Display all %zu possibilities? (y or n)", c->count);
+        append(text, n);
+        flush_output();
+
+        int key = read_key(l);
+        append("\n", 1);
+
+        if ((key != 'y') && (key != 'Y'))
+        {
+            flush_output();
+            l->dirty = true;
+            return;
+        }
+    }
+
+    size_t width = 0;
+
+    for (size_t i = 0; i < c->count; i++)
+    {
+        size_t length = strlen(completion_name(c, i) + skip) + 2;
+        width = (length > width) ? length : width;
+    }
+
+    size_t ncolumns = (l->columns > width) ? l->columns / width : 1;
+    size_t nrows = (c->count + ncolumns - 1) / ncolumns;
+
+    for (size_t row = 0; row < nrows; row++)
+    {
+        for (size_t i = row; i < c->count; i += nrows)
+        {
+            const char *name = completion_name(c, i) + skip;
+            size_t length = strlen(name);
+            append(name, length);
+
+            if (i + nrows < c->count)
+            {
+                for (; length < width; length++)
+                {
+                    append(" ", 1);
+                }
+            }
+        }
+        append("\n", 1);
+    }
+
+    flush_output();
+    l->dirty = true;
+}
+
+/**
+ * @brief Checks if the word before a position of the line is a keyword
+ * followed by a command, e.g. do or then.
+ *
+ * @param line      The line.
+ * @param before    The position, after the word and any blanks.
+ * @return True if the word is such a keyword.
+ */
+static bool after_keyword(const char *line, size_t before)
+{
+    static const char *keywords[] =
+    {
+        "if", "then", "elif", "else", "while", "do", NULL
+    };
+    size_t start = before;
+
+    while ((start > 0) && (strchr(WORD_BREAKS, line[start - 1]) == NULL))
+    {
+        start--;
+    }
+
+    for (const char **k = keywords; *k != NULL; k++)
+    {
+        if ((strlen(*k) == before - start)
+            && (strncmp(line + start, *k, before - start) == 0))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief Completes the word before the cursor: a command name, in the
+ * first word of a command, else a filename.
+ *
+ * @param l     The line.
+ * @param again True if Tab was the last key, to list the candidates.
+ */
+static void complete(LINE *l, bool again)
+{
+    const char *line = *l->buffer;
+    size_t start = l->cursor;
+
+    while ((start > 0) && ((strchr(WORD_BREAKS, line[start - 1]) == NULL)
+        || ((start > 1) && (line[start - 2] == '\\'))))
+    {
+        start--;
+    }
+
+    // The word is matched as the parser would see it, unescaped.
+    char *prefix = malloc(l->cursor - start + 1);
+    check_allocation(prefix);
+    size_t length = 0;
+
+    for (size_t i = start; i < l->cursor; i++)
+    {
+        i += (line[i] == '\\') && (i + 1 < l->cursor);
+        prefix[length++] = line[i];
+    }
+    prefix[length] = '\0';
+
+    size_t before = start;
+
+    while ((before > 0) && ((line[before - 1] == ' ') || (line[before - 1] == '\t')))
+    {
+        before--;
+    }
+
+    bool command = ((before == 0) || (strchr(COMMAND_BREAKS, line[before - 1]) != NULL)
+        || ((before < start) && after_keyword(line, before)))
+        && (strchr(prefix, '/') == NULL);
+    const char *slash = strrchr(prefix, '/');
+    size_t skip = (slash != NULL) ? (size_t) (slash - prefix) + 1 : 0;
+    COMPLETIONS c = {0};
+
+    if (command)
+    {
+        completion_commands(prefix, false, &c);
+    }
+    else
+    {
+        completion_files(prefix, &c);
+    }
+
+    size_t common = completion_common(&c);
+    const char *first = (c.count > 0) ? completion_name(&c, 0) : NULL;
+
+    if ((c.count > 0) && (common > length))
+    {
+        insert_escaped(l, first + length, common - length);
+    }
+
+    if (c.unique && (common > 0) && (first[common - 1] != '/'))
+    {
+        insert(l, " ", 1);
+    }
+    else if ((c.count > 0) && !c.unique && (common == length) && again)
+    {
+        // Only the prefix the command names share was found, not them all.
+        if (command)
+        {
+            completion_free(&c);
+            completion_commands(prefix, true, &c);
+        }
+        list_candidates(l, &c, skip);
+    }
+    else if ((c.count == 0) || (common == length))
+    {
+        append("\a", 1);
+        flush_output();
+    }
+
+    completion_free(&c);
+    free(prefix);
+}
+
+/**
+ * @brief Handles an escape sequence, of the arrow, home, end and delete
+ * keys.
+ *
+ * @param l     The line.
+ */
+static void escape_sequence(LINE *l)
+{
+    int key = read_key_within(l, ESCAPE_MSEC);
+    int final = (key != KEY_TIMEOUT) ? read_key_within(l, ESCAPE_MSEC) : key;
+    int parameter = 0;
+
+    if (key == '[')
+    {
+        // e.g. ESC [ 3 ~, or ESC [ 1 ; 5 C, ending with a byte of @ to ~.
+        while ((final >= '0') && (final <= ';'))
+        {
+            parameter = (parameter == 0) ? final : parameter;
+            final = read_key_within(l, ESCAPE_MSEC);
+        }
+    }
+    else if (key != 'O')
+    {
+        return;
+    }
+
+    if (final == '~')
+    {
+        final = (parameter == '1') || (parameter == '7') ? 'H'
+            : (parameter == '4') || (parameter == '8') ? 'F'
+            : (parameter == '3') ? '~' : 0;
+    }
+
+    switch (final)
+    {
+    case 'A':
+        history_up(l);
+        break;
+    case 'B':
+        history_down(l);
+        break;
+    case 'C':
+        l->cursor += (l->cursor < l->length);
+        break;
+    case 'D':
+        l->cursor -= (l->cursor > 0);
+        break;
+    case 'H':
+        l->cursor = 0;
+        break;
+    case 'F':
+        l->cursor = l->length;
+        break;
+    case '~':
+        if (l->cursor < l->length)
+        {
+            delete(l, l->cursor, l->cursor + 1);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief Edits the line until it is entered.
+ *
+ * @param l     The line.
+ * @return 1 if the line is entered, 0 at the end of input, or -1 if it
+ * is interrupted with control-C.
+ */
+static int edit(LINE *l)
+{
+    bool tabbed = false;
+
+    for (;;)
+    {
+        int key = read_key(l);
+        bool tab = false;
+        size_t word = l->cursor;
+
+        switch (key)
+        {
+        case -1:
+            return (l->length > 0);
+        case '\r':
+        case '\n':
+            return 1;
+        case KEY_CTRL('C'):
+            append("^C", 2);
+            flush_output();
+            return -1;
+        case KEY_CTRL('D'):
+            if (l->length == 0)
+            {
+                return 0;
+            }
+            if (l->cursor < l->length)
+            {
+                delete(l, l->cursor, l->cursor + 1);
+            }
+            break;
+        case KEY_BACKSPACE:
+        case KEY_CTRL('H'):
+            if (l->cursor > 0)
+            {
+                delete(l, l->cursor - 1, l->cursor);
+            }
+            break;
+        case KEY_CTRL('A'):
+            l->cursor = 0;
+            break;
+        case KEY_CTRL('E'):
+            l->cursor = l->length;
+            break;
+        case KEY_CTRL('B'):
+            l->cursor -= (l->cursor > 0);
+            break;
+        case KEY_CTRL('F'):
+            l->cursor += (l->cursor < l->length);
+            break;
+        case KEY_CTRL('K'):
+            l->length = l->cursor;
+            break;
+        case KEY_CTRL('U'):
+            delete(l, 0, l->cursor);
+            break;
+        case KEY_CTRL('W'):
+            while ((word > 0) && ((*l->buffer)[word - 1] == ' '))
+            {
+                word--;
+            }
+            while ((word > 0) && ((*l->buffer)[word - 1] != ' '))
+            {
+                word--;
+            }
+            delete(l, word, l->cursor);
+            break;
+        case KEY_CTRL('L'):
+            append("\x1b[H\x1b[2J", 7);
+            break;
+        case KEY_CTRL('P'):
+            history_up(l);
+            break;
+        case KEY_CTRL('N'):
+            history_down(l);
+            break;
+        case KEY_CTRL('R'):
+            if (search(l))
+            {
+                return 1;
+            }
+            break;
+        case '\t':
+            complete(l, tabbed);
+            tab = true;
+            break;
+        case KEY_ESCAPE:
+            escape_sequence(l);
+            break;
+        default:
+            if ((key >= ' ') && (key != KEY_BACKSPACE))
+            {
+                char ch = key;
+                insert(l, &ch, 1);
+            }
+            break;
+        }
+
+        tabbed = tab;
+        l->dirty = true;
+    }
+}
+
+/**
+ * @brief Reads a line typed at the terminal, as getline() would, editing
+ * it in raw mode. Control-D on an empty line ends the input.
+ *
+ * @param prompt    The prompt, of which only the last line is redrawn.
+ * @param buffer    The buffer to read into, grown as for getline().
+ * @param capacity  The capacity of the buffer.
+ * @return The length of the line, with its newline, or -1 at the end.
+ */
+ssize_t lineedit_read(const char *prompt, char **buffer, size_t *capacity)
+{
+    struct termios cooked, raw;
+    fflush(stdout);
+
+    if (closed)
+    {
+        return -1;
+    }
+
+    if (tcgetattr(STDIN_FILENO, &cooked) == -1)
+    {
+        return lineedit_getline(buffer, capacity);
+    }
+
+    // A control-C typed while the last command ran has been handled.
+    eventloop_take(EVENT_INTERRUPT);
+
+    raw = cooked;
+    raw.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+    raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    check_error(tcsetattr(STDIN_FILENO, TCSADRAIN, &raw));
+
+    // The prompt's earlier lines are written once, its last with the line.
+    const char *last = strrchr(prompt, '\n');
+    last = (last != NULL) ? last + 1 : prompt;
+    append(prompt, last - prompt);
+
+    struct winsize size;
+    LINE l =
+    {
+        .buffer         = buffer,
+        .capacity       = capacity,
+        .prompt         = last,
+        .prompt_length  = strlen(last),
+        .columns        = ((ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0)
+            && (size.ws_col > 0)) ? size.ws_col : 80,
+        .dirty          = true,
+        .history        = AT_BOTTOM
+    };
+
+    int result = edit(&l);
+
+    // The line is shown whole, and the cursor left on the next line.
+    if (result >= 0)
+    {
+        l.cursor = l.length;
+        redraw(&l);
+        append("\n", 1);
+        flush_output();
+    }
+
+    reserve(&l, l.length + 2);
+    (*buffer)[l.length] = '\n';
+    (*buffer)[l.length + 1] = '\0';
+    tcsetattr(STDIN_FILENO, TCSADRAIN, &cooked);
+    free(l.saved);
+
+    if (result < 0)
+    {
+        // As if control-C had been typed to the parser in cooked mode. The
+        // parser's handler jumps out of itself, leaving SIGINT blocked.
+        sigset_t interrupt;
+        sigemptyset(&interrupt);
+        sigaddset(&interrupt, SIGINT);
+        sigprocmask(SIG_UNBLOCK, &interrupt, NULL);
+        raise(SIGINT);
+        return -1;
+    }
+
+    closed = (result == 0);
+    return closed ? -1 : (ssize_t) l.length + 1;
+}
+
+/**
+ * @brief Reads a line of input that is not typed at a terminal, as
+ * getline() would, from the blocks read as they arrive. The jobs that
+ * finish while the shell waits are reaped.
+ *
+ * @param buffer    The buffer to read into, grown as for getline().
+ * @param capacity  The capacity of the buffer.
+ * @return The length of the line, with its newline, or -1 at the end.
+ */
+ssize_t lineedit_getline(char **buffer, size_t *capacity)
+{
+    size_t length = 0;
+
+    if (ahead == NULL)
+    {
+        ahead = malloc(INPUT_BLOCK);
+        check_allocation(ahead);
+    }
+
+    while (!closed)
+    {
+        // The line is taken from the block read, up to its newline.
+        char *start = ahead + next_ahead;
+        char *newline = memchr(start, '\n', nahead - next_ahead);
+        size_t take = (newline != NULL) ? (size_t) (newline + 1 - start)
+            : nahead - next_ahead;
+
+        if (length + take + 1 > *capacity)
+        {
+            *capacity = 2 * (length + take + 1);
+            *buffer = realloc(*buffer, *capacity);
+            check_allocation(*buffer);
+        }
+
+        memcpy(*buffer + length, start, take);
+        length += take;
+        next_ahead += take;
+
+        if (newline != NULL)
+        {
+            break;
+        }
+
+        unsigned events = eventloop_wait(STDIN_FILENO, EVENT_INPUT | EVENT_CHILD);
+
+        if (events & EVENT_CHILD)
+        {
+            background_notify();
+        }
+
+        if (events & EVENT_INPUT)
+        {
+            ssize_t n = read(STDIN_FILENO, ahead, INPUT_BLOCK);
+            closed = (n == 0) || ((n == -1) && (errno != EINTR) && (errno != EAGAIN));
+            nahead = (n > 0) ? (size_t) n : 0;
+            next_ahead = 0;
+        }
+    }
+
+    if (length == 0)
+    {
+        return -1;
+    }
+
+    (*buffer)[length] = '\0';
+    return length;
+}
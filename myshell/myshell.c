@@ -15,107 +15,387 @@
 #include "parser.h"
 #include "external.h"
 #include "internal.h"
+#include "builtins.h"
 #include "subshell.h"
 #include "redirection.h"
 #include "pipeline.h"
 #include "background.h"
+#include "parallel.h"
+#include "jobserver.h"
+#include "expand.h"
+#include "pathcache.h"
+#include "shellscript.h"
+#include "variables.h"
+#include "wildcard.h"
+#include "history.h"
+#include "lineedit.h"
+#include "program.h"
+#include "eventloop.h"
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
+extern char **environ;
+
 /**
  * @brief The exit status to return on exit.
  */
 static int exitstatus = EXIT_SUCCESS;
 
 /**
- * @brief This function should traverse the command-tree and execute the
- * commands that it holds, returning the appropriate exit-status.
+ * @brief True once control-C has interrupted the command-tree being
+ * executed, until the next is read.
+ */
+static bool interrupted = false;
+
+/**
+ * @brief Executes a command, its words expanded, as a builtin or else an
+ * external command.
  * 
- * @param t     The shellcmd to handle.
- * @return The exitstatus of the operation.
+ * @param t     The command.
+ * @param final True if the command is the last of this process.
+ * @return The exitstatus of the command.
  */
-int execute_shellcmd(SHELLCMD *t)
+static int execute_command(SHELLCMD *t, bool final)
 {
-    switch (t->type)
+    // A command may expand to no words at all.
+    if (t->argc == 0)
     {
-    case CMD_COMMAND:
+        return (exitstatus = EXIT_SUCCESS);
+    }
+
+    COMMAND command = parse_cmd(t->argv[0]);
+
+    // External commands are redirected in the child, when spawned.
+    if (command == COMMAND_EXECUTE)
     {
-        struct REDIRECTION* redirection = redirection_shellcmd(t);
+        finalcommand = final;
+        return (exitstatus = external_shellcmd(t));
+    }
 
-        if (redirection == NULL)
-        {
-            return EXIT_FAILURE;
-        }
+    if (command == COMMAND_EXEC)
+    {
+        return (exitstatus = exec_shellcmd(t));
+    }
 
-        COMMAND command = parse_cmd(t->argv[0]);
+    struct REDIRECTION* redirection = redirection_shellcmd(t);
 
-        switch (command)
-        {
-        case COMMAND_CD:
-            exitstatus = cd_shellcmd(t);
-            break;
-        case COMMAND_EXIT:
-            background_exit();
-            exitstatus = exit_shellcmd(t, exitstatus);
-            break;
-        case COMMAND_TIME:
-            exitstatus = time_shellcmd(t);
-            break;
-        case COMMAND_EXECUTE:
-        default:
-            exitstatus = external_shellcmd(t);
-            break;
-        }
+    if (redirection == NULL)
+    {
+        return (exitstatus = EXIT_FAILURE);
+    }
 
-        free_redirection_shellcmd(t, redirection);
+    switch (command)
+    {
+    case COMMAND_CD:
+        exitstatus = cd_shellcmd(t);
         break;
-    }
-    case CMD_SEMICOLON:    // cmd1 ;  cmd2
-        exitstatus = execute_shellcmd(t->left);
-        exitstatus = execute_shellcmd(t->right);
+    case COMMAND_EXIT:
+        background_exit();
+        exitstatus = exit_shellcmd(t, exitstatus);
         break;
-    case CMD_AND:          // cmd1 && cmd2
-        exitstatus = execute_shellcmd(t->left);
-        if (exitstatus == EXIT_SUCCESS)
-        {
-            execute_shellcmd(t->right);
-        }
+    case COMMAND_TIME:
+        exitstatus = time_shellcmd(t);
         break;
-    case CMD_OR:           // cmd1 || cmd2
-        exitstatus = execute_shellcmd(t->left);
-        if (exitstatus != EXIT_SUCCESS)
-        {
-            execute_shellcmd(t->right);
-        }
+    case COMMAND_SET:
+        exitstatus = set_shellcmd(t);
+        break;
+    case COMMAND_HASH:
+        exitstatus = hash_shellcmd(t);
+        break;
+    case COMMAND_ECHO:
+        exitstatus = echo_shellcmd(t);
+        break;
+    case COMMAND_TRUE:
+        exitstatus = true_shellcmd(t);
         break;
-    case CMD_SUBSHELL:     // ( cmds )
+    case COMMAND_FALSE:
+        exitstatus = false_shellcmd(t);
+        break;
+    case COMMAND_TEST:
+        exitstatus = test_shellcmd(t);
+        break;
+    case COMMAND_PWD:
+        exitstatus = pwd_shellcmd(t);
+        break;
+    case COMMAND_PRINTF:
+        exitstatus = printf_shellcmd(t);
+        break;
+    case COMMAND_JOBS:
+        exitstatus = jobs_shellcmd(t);
+        break;
+    case COMMAND_WAIT:
+        exitstatus = wait_shellcmd(t);
+        break;
+    case COMMAND_FG:
+        exitstatus = fg_shellcmd(t);
+        break;
+    case COMMAND_PARALLEL:
+        exitstatus = parallel_shellcmd(t);
+        break;
+    case COMMAND_EXPORT:
+        exitstatus = export_shellcmd(t);
+        break;
+    case COMMAND_HISTORY:
+        exitstatus = history_shellcmd(t);
+        break;
+    default:
+        break;
+    }
+
+    // Builtins write through stdio, which must reach the redirection.
+    fflush(stdout);
+    free_redirection_shellcmd(t, redirection);
+    return exitstatus;
+}
+
+/**
+ * @brief Executes a command, a subshell or a pipeline, the nodes of a
+ * command-tree that are not lowered to instructions.
+ * 
+ * @param t     The node.
+ * @param final True if the node is the last of this process.
+ * @return The exitstatus of the node.
+ */
+static int execute_node(SHELLCMD *t, bool final)
+{
+    switch (t->type)
     {
-        struct REDIRECTION* redirection = redirection_shellcmd(t);
+    case CMD_COMMAND:
+    {
+        EXPANSION expansion;
 
-        if (redirection == NULL)
+        // VAR=val cmd assigns VAR for cmd alone, VAR=val for the shell.
+        if (expand_shellcmd(t, &expansion))
+        {
+            size_t mark = variables_assign(expansion.assignments,
+                expansion.nassignments, t->argc > 0);
+            exitstatus = execute_command(t, final);
+            variables_restore(mark);
+        }
+        else
         {
-            return EXIT_FAILURE;
+            exitstatus = EXIT_FAILURE;
         }
 
-        exitstatus = subshell_shellcmd(t);
-        free_redirection_shellcmd(t, redirection);
+        expand_free(t, &expansion);
         break;
     }
+    case CMD_SUBSHELL:     // ( cmds ), redirected in the child
+        finalcommand = final;
+        exitstatus = subshell_shellcmd(t);
+        break;
     case CMD_PIPE:         // cmd1 |  cmd2    
-        exitstatus = pipeline_shellcmd(t);
+        exitstatus = timed_pipeline(t)
+            ? time_pipeline_shellcmd(t)
+            : pipeline_shellcmd(t);
         break;
-    case CMD_BACKGROUND:   // cmd1 &
-    {
-        exitstatus = background_shellcmd(t->left);
-        exitstatus = execute_shellcmd(t->right);
+    default:
         break;
     }
-    default:
+    return exitstatus;
+}
+
+/**
+ * @brief The instructions of the command-trees being executed. A
+ * command-tree executed by another, e.g. by time, is appended after it.
+ */
+static PROGRAM program;
+
+/**
+ * @brief A while or for loop being executed.
+ */
+typedef struct
+{
+    SHELLCMD    *t;
+    int         status;     // The exit status of its body, last run.
+    int         next;       // The index of a for's next word.
+    EXPANSION   expansion;  // The expansion of a for's words.
+} LOOP;
+
+/**
+ * @brief The loops being executed, innermost last.
+ */
+static LOOP     *loops;
+static size_t   nloops, loops_capacity;
+
+/**
+ * @brief Starts a loop. A for's words are expanded once, before the
+ * first time its body is run, into the loop's own expansion: they are
+ * copies, not the values of variables that its body may set, e.g. for X
+ * in $X, and live until the loop ends.
+ * 
+ * @param t     The while or for.
+ */
+static void loop_begin(SHELLCMD *t)
+{
+    if (nloops == loops_capacity)
     {
-        break;
+        loops_capacity = (loops_capacity == 0) ? 8 : loops_capacity * 2;
+        loops = realloc(loops, loops_capacity * sizeof(*loops));
+        check_allocation(loops);
     }
+
+    LOOP *loop = &loops[nloops++];
+    *loop = (LOOP) {.t = t, .status = EXIT_SUCCESS, .next = 1};
+
+    if ((t->type == CMD_FOR) && !expand_shellcmd(t, &loop->expansion))
+    {
+        loop->next = t->argc;
+        loop->status = EXIT_FAILURE;
     }
+}
+
+/**
+ * @brief Sets the variable of the innermost loop, a for, to its next word.
+ * 
+ * @return False if there are no more words.
+ */
+static bool loop_next(void)
+{
+    static char *assignment;
+    static size_t capacity;
+    LOOP *loop = &loops[nloops - 1];
+    SHELLCMD *t = loop->t;
+
+    if (loop->next >= t->argc)
+    {
+        return false;
+    }
+
+    // The variable is set as NAME=word.
+    size_t length = strlen(t->argv[0]);
+    const char *word = t->argv[loop->next++];
+    size_t size = length + 1 + strlen(word) + 1;
+
+    if (size > capacity)
+    {
+        capacity = 2 * size;
+        assignment = realloc(assignment, capacity);
+        check_allocation(assignment);
+    }
+
+    memcpy(assignment, t->argv[0], length);
+    assignment[length] = '=';
+    strcpy(assignment + length + 1, word);
+    variable_set(assignment, false);
+    return true;
+}
+
+/**
+ * @brief Ends the innermost loop.
+ * 
+ * @return The exit status of the loop, of its body last run, or success
+ * if it never ran.
+ */
+static int loop_end(void)
+{
+    LOOP *loop = &loops[--nloops];
+
+    if (loop->t->type == CMD_FOR)
+    {
+        expand_free(loop->t, &loop->expansion);
+    }
+
+    return loop->status;
+}
+
+/**
+ * @brief This function should traverse the command-tree and execute the
+ * commands that it holds, returning the appropriate exit-status. The
+ * tree is lowered to instructions and run by a loop, not recursively, so
+ * a line of any number of commands runs in constant stack, and a while
+ * or for runs its body again without parsing or lowering it again.
+ * 
+ * @param t     The shellcmd to handle.
+ * @return The exitstatus of the operation.
+ */
+int execute_shellcmd(SHELLCMD *t)
+{
+    // Only the last command of a process may exec in place of it.
+    bool final = finalcommand;
+    finalcommand = false;
+
+    // A lone command, subshell or pipeline needs no instructions.
+    if ((t != NULL) && ((t->type == CMD_COMMAND)
+        || (t->type == CMD_SUBSHELL) || (t->type == CMD_PIPE)))
+    {
+        return execute_node(t, final);
+    }
+
+    size_t start = program_lower(&program, t, final);
+    size_t pc = start, base = nloops;
+
+    // The instructions are copied, the program may grow as they run.
+    while (pc < program.count)
+    {
+        INSTRUCTION instruction = program.code[pc++];
+
+        switch (instruction.op)
+        {
+        case OP_EXECUTE:
+            execute_node(instruction.cmd, instruction.final);
+            break;
+        case OP_BACKGROUND:     // cmd1 &
+            exitstatus = background_shellcmd(instruction.cmd);
+            break;
+        case OP_JUMP_FAILURE:   // cmd1 && cmd2
+            pc = (exitstatus != EXIT_SUCCESS) ? instruction.target : pc;
+            break;
+        case OP_JUMP_SUCCESS:   // cmd1 || cmd2
+            pc = (exitstatus == EXIT_SUCCESS) ? instruction.target : pc;
+            break;
+        case OP_JUMP:
+            pc = instruction.target;
+            break;
+        case OP_SUCCEED:        // if cmds ; then cmds ; fi
+            exitstatus = EXIT_SUCCESS;
+            break;
+        case OP_LOOP:
+            loop_begin(instruction.cmd);
+            break;
+        case OP_WHILE:          // while cmds ; do cmds ; done
+            if (exitstatus != EXIT_SUCCESS)
+            {
+                exitstatus = loop_end();
+                pc = instruction.target;
+            }
+            break;
+        case OP_FOR:            // for name in words ; do cmds ; done
+            if (!loop_next())
+            {
+                exitstatus = loop_end();
+                pc = instruction.target;
+            }
+            break;
+        case OP_LOOP_END:
+            loops[nloops - 1].status = exitstatus;
+            pc = instruction.target;
+            break;
+        }
+
+        // Control-C at an interactive shell ends the command-tree, and the
+        // loops it is in, but not the shell. Each look is a read(), so it
+        // is looked for once a loop iteration, and after a command fails,
+        // as one it killed does, not after every instruction.
+        bool look = (instruction.op == OP_LOOP_END)
+            || ((instruction.op == OP_EXECUTE) && (exitstatus != EXIT_SUCCESS));
+
+        if (interactive
+            && (interrupted || (look && eventloop_take(EVENT_INTERRUPT))))
+        {
+            interrupted = true;
+            exitstatus = EXIT_FAILURE;
+
+            while (nloops > base)
+            {
+                loop_end();
+            }
+            break;
+        }
+    }
+
+    program.count = start;
     return exitstatus;
 }
 
@@ -136,32 +416,88 @@ int main(int argc, char *argv[])
     argc--;             // skip 1st command-line argument
     argv++;
 
-    // INITIALIZE THE THREE INTERNAL VARIABLES
-    HOME = getenv("HOME");
-    if (HOME == NULL)
+    // OPTIONS PRECEDE ANY SCRIPT NAMED ON THE COMMAND-LINE
+    long njobs = 0;
+
+    for (; (argc > 0) && (argv[0][0] == '-'); argc--, argv++)
     {
-        HOME = DEFAULT_HOME;
+        if (strcmp(argv[0], "--no-cache") == 0)
+        {
+            scriptcache = false;    // parse scripts every time they run
+            continue;
+        }
+
+        if (strcmp(argv[0], "-n") == 0)
+        {
+            noexec = true;          // parse commands, but do not run them
+            continue;
+        }
+
+        // -j N CREATES A JOBSERVER, SHARED WITH make AND THE SHELLS IT RUNS
+        bool jobs = (strncmp(argv[0], "-j", 2) == 0);
+        char *value = argv[0] + 2;
+
+        if (jobs && (*value == '\0') && (argc > 1))
+        {
+            argc--;
+            argv++;
+            value = argv[0];
+        }
+
+        char *end = value;
+        njobs = jobs ? strtol(value, &end, 10) : 0;
+
+        if ((njobs <= 0) || (*end != '\0'))
+        {
+            fprintf(stderr, "Usage: %s [--no-cache] [-n] [-j N] [script]\n", name0);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // IMPORT THE ENVIRONMENT, INCLUDING THE THREE INTERNAL VARIABLES
+    variables_init(environ);
+
+    // DETERMINE IF THIS SHELL IS INTERACTIVE
+    interactive = (isatty(fileno(stdin)) && isatty(fileno(stdout)));
+    shellpid = getpid();
+
+    // WAIT FOR INPUT, CHILDREN AND CONTROL-C TOGETHER, IN THE EVENT LOOP
+    eventloop_init();
+
+    // TAKE PART IN make's JOBSERVER, OR BE ONE
+    if (njobs > 0)
+    {
+        jobserver_create(njobs);
+    }
+    else
+    {
+        jobserver_init();
     }
 
-    PATH = getenv("PATH");
-    if (PATH == NULL) 
+    // A SCRIPT NAMED ON THE COMMAND-LINE, e.g. BY A #! LINE, IS RUN INSTEAD
+    if (argc > 0)
     {
-        PATH = DEFAULT_PATH;
+        interactive = false;
+        shell_exit(shellscript_run(argv[0]));
     }
 
-    CDPATH = getenv("CDPATH");
-    if (CDPATH == NULL) 
+    // AN INTERACTIVE SHELL KEEPS A HISTORY OF THE COMMANDS TYPED
+    if (interactive)
     {
-        CDPATH = DEFAULT_CDPATH;
+        history_open();
     }
 
-    // DETERMINE IF THIS SHELL IS INTERACTIVE
-    interactive = (isatty(fileno(stdin)) && isatty(fileno(stdout)));
+    // EACH COMMAND-TREE IS ALLOCATED FROM, AND RELEASED WITH, THE ARENA
+    ARENA arena = {0};
+#if defined(MYSHELL_STATS)
+    size_t nlines = 0;
+#endif
 
     // READ AND EXECUTE COMMANDS FROM stdin UNTIL IT IS CLOSED (with control-D)
-    while (!feof(stdin))
+    while (!feof(stdin) && !lineedit_closed())
     {
-        SHELLCMD *t = parse_shellcmd(stdin);
+        background_reap();
+        SHELLCMD *t = parse_shellcmd(stdin, &arena);
 
         if (t == NULL)
         {
@@ -171,10 +507,26 @@ int main(int argc, char *argv[])
         // WE COULD DISPLAY THE PARSED COMMAND-TREE, HERE, BY CALLING:
         // print_shellcmd(t);
 
-        exitstatus = execute_shellcmd(t);
-        free_shellcmd(t);
+        pathcache_revalidate();
+        wildcard_revalidate();
+        interrupted = false;
+        exitstatus = noexec ? exitstatus : execute_shellcmd(t);
+        arena_reset(&arena);
+#if defined(MYSHELL_STATS)
+        nlines++;
+#endif
     }
 
+#if defined(MYSHELL_STATS)
+    // allocations IS WHAT THE PARSER USED TO malloc, mallocs WHAT IT DOES NOW
+    fprintf(stderr, "%s: %zu lines, %zu allocations (%.2f per line), "
+        "%zu mallocs (%.2f per line)\n", name0, nlines, arena.allocations,
+        (double) arena.allocations / (nlines ? nlines : 1), arena.mallocs,
+        (double) arena.mallocs / (nlines ? nlines : 1));
+#endif
+    arena_free(&arena);
+    background_release();
+
     if (interactive) 
     {
 	    fputc('\n', stdout);
@@ -0,0 +1,394 @@
+/**
+ * @file    parallel.c
+ * @author  Joshua Ng
+ * @brief   Runs a command over a list of arguments, N at a time.
+ * @date    2026-10-18
+ */
+
+#include "parallel.h"
+#include "globals.h"
+#include "background.h"
+#include "timing.h"
+#include "jobserver.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+
+/**
+ * parallel [-j N] cmd [args...] ::: arg1 arg2 ...
+ * parallel [-j N] cmd [args...] < list
+ *
+ * Runs cmd once for each argument, the argument appended, or in place of
+ * each {}, keeping N children running, by default one per core. A
+ * new child starts as soon as one terminates, reaped through the job
+ * table's self-pipe. A child's output goes to a temporary file of its
+ * slot, and is copied out whole when it terminates, so the output of two
+ * children is never interleaved. Under a jobserver each child also takes
+ * a token: the first waits for one, the others start only if one is free.
+ */
+
+#define SEPARATOR       ":::"
+#define PLACEHOLDER     "{}"
+
+/**
+ * @brief A slot for a running child.
+ */
+typedef struct
+{
+    pid_t   pid;        // The child's pid, or 0 if the slot is free.
+    char    *arg;       // The child's argument.
+    int     token;      // The child's jobserver token.
+    FILE    *out;       // The child's buffered stdout
+    FILE    *err;       // and stderr.
+} SLOT;
+
+/**
+ * @brief The arguments of a parallel command.
+ */
+typedef struct
+{
+    char    **argv;     // The command.
+    int     argc;
+    char    **args;     // The arguments, from the command-line,
+    int     nargs;
+    int     next;
+    FILE    *input;     // else from stdin.
+    char    *line;
+    size_t  size;
+} ARGS;
+
+/**
+ * @brief Gets the next argument.
+ *
+ * @param args  The arguments.
+ * @return A memory allocated argument, or NULL if there are no more.
+ */
+static char *next_arg(ARGS *args)
+{
+    if (args->args != NULL)
+    {
+        return (args->next < args->nargs) ? strdup(args->args[args->next++]) : NULL;
+    }
+
+    // stdin's own buffer may hold the shell's input, read fd 0 anew.
+    if (args->input == NULL)
+    {
+        args->input = fdopen(dup(STDIN_FILENO), "r");
+        check_allocation(args->input);
+    }
+
+    ssize_t length = getline(&args->line, &args->size, args->input);
+
+    if (length == -1)
+    {
+        return NULL;
+    }
+
+    if ((length > 0) && (args->line[length - 1] == '\n'))
+    {
+        args->line[length - 1] = '\0';
+    }
+
+    return strdup(args->line);
+}
+
+/**
+ * @brief Replaces each {} in a word with the argument.
+ *
+ * @param word  The word.
+ * @param arg   The argument.
+ * @return The word, or a memory allocated copy with the replacements.
+ */
+static char *replace_placeholders(char *word, const char *arg)
+{
+    char *found = strstr(word, PLACEHOLDER);
+
+    if (found == NULL)
+    {
+        return word;
+    }
+
+    size_t n = 0;
+    for (char *p = found; p != NULL; p = strstr(p + 2, PLACEHOLDER))
+    {
+        n++;
+    }
+
+    char *result = malloc(strlen(word) + n * strlen(arg) + 1);
+    check_allocation(result);
+    char *out = result;
+
+    for (; found != NULL; found = strstr(word, PLACEHOLDER))
+    {
+        memcpy(out, word, found - word);
+        out = stpcpy(out + (found - word), arg);
+        word = found + 2;
+    }
+
+    strcpy(out, word);
+    return result;
+}
+
+/**
+ * @brief Runs the command with an argument, in the child.
+ *
+ * @param args  The arguments.
+ * @param slot  The child's slot.
+ */
+static void run_child(ARGS *args, SLOT *slot)
+{
+    check_error(dup2(fileno(slot->out), STDOUT_FILENO));
+    check_error(dup2(fileno(slot->err), STDERR_FILENO));
+
+    char **argv = malloc((args->argc + 2) * sizeof(*argv));
+    check_allocation(argv);
+    bool placed = false;
+
+    for (int a = 0; a < args->argc; a++)
+    {
+        argv[a] = replace_placeholders(args->argv[a], slot->arg);
+        placed = placed || (argv[a] != args->argv[a]);
+    }
+
+    int argc = args->argc;
+    if (!placed)
+    {
+        argv[argc++] = slot->arg;
+    }
+    argv[argc] = NULL;
+
+    SHELLCMD t = {.type = CMD_COMMAND, .argc = argc, .argv = argv};
+    finalcommand = true;
+    shell_exit(execute_shellcmd(&t));
+}
+
+/**
+ * @brief Copies a child's buffered output out, and empties the buffer.
+ *
+ * @param from  The buffer.
+ * @param to    The fd to copy to.
+ */
+static void copy_output(FILE *from, int to)
+{
+    char buffer[BUFSIZ];
+    ssize_t n;
+    int fd = fileno(from);
+
+    check_error(lseek(fd, 0, SEEK_SET));
+
+    while ((n = read(fd, buffer, sizeof(buffer))) > 0)
+    {
+        for (ssize_t written = 0; written < n; )
+        {
+            ssize_t w = write(to, buffer + written, n - written);
+
+            if ((w == -1) && (errno != EINTR))
+            {
+                break;
+            }
+
+            written += (w > 0) ? w : 0;
+        }
+    }
+
+    check_error(ftruncate(fd, 0));
+    check_error(lseek(fd, 0, SEEK_SET));
+}
+
+/**
+ * @brief Parses the -j option.
+ *
+ * @param t         The parallel shellcmd.
+ * @param first     Set to the index of the command.
+ * @return The number of slots, or -1 on error.
+ */
+static long parse_slots(SHELLCMD *t, int *first)
+{
+    long nslots = sysconf(_SC_NPROCESSORS_ONLN);
+    const char *value = NULL;
+    *first = 1;
+
+    if ((t->argc > 1) && (strncmp(t->argv[1], "-j", 2) == 0))
+    {
+        value = (t->argv[1][2] != '\0') ? t->argv[1] + 2 : t->argv[2];
+        *first = (t->argv[1][2] != '\0') ? 2 : 3;
+    }
+
+    if (value != NULL)
+    {
+        char *end;
+        nslots = strtol(value, &end, 10);
+
+        if ((*end != '\0') || (nslots < 0))
+        {
+            fprintf(stderr, "%s: invalid number of jobs: %s\n", t->argv[0], value);
+            return -1;
+        }
+    }
+
+    // -j 0, or an unknown number of cores, runs one per core or one.
+    if (nslots <= 0)
+    {
+        nslots = (value != NULL) ? sysconf(_SC_NPROCESSORS_ONLN) : 1;
+    }
+
+    return (nslots > 0) ? nslots : 1;
+}
+
+/**
+ * @brief Handles the parallel command.
+ *
+ * @param t     The parallel shellcmd to handle.
+ * @return EXIT_SUCCESS if every child succeeded.
+ */
+int parallel_shellcmd(SHELLCMD *t)
+{
+    int first;
+    long nslots = parse_slots(t, &first);
+
+    if (nslots < 0)
+    {
+        return EXIT_FAILURE;
+    }
+
+    ARGS args = {.argv = t->argv + first, .argc = t->argc - first};
+
+    for (int a = first; a < t->argc; a++)
+    {
+        if (strcmp(t->argv[a], SEPARATOR) == 0)
+        {
+            args.argc = a - first;
+            args.args = t->argv + a + 1;
+            args.nargs = t->argc - a - 1;
+            break;
+        }
+    }
+
+    if (args.argc <= 0)
+    {
+        fprintf(stderr, "Usage: %s [-j N] command [args...] [::: args...]\n",
+            t->argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    SLOT *slots = calloc(nslots, sizeof(*slots));
+    check_allocation(slots);
+    long running = 0;
+    size_t nfailed = 0, njobs = 0;
+    char *arg = next_arg(&args);
+
+    while ((arg != NULL) || (running > 0))
+    {
+        // Fill every free slot, then wait for any child to terminate.
+        for (long s = 0; (s < nslots) && (arg != NULL); s++)
+        {
+            SLOT *slot = &slots[s];
+
+            if (slot->pid != 0)
+            {
+                continue;
+            }
+
+            int token = (running == 0) ? background_token()
+                : (jobserver_active() ? jobserver_acquire() : JOBSERVER_NONE);
+
+            if (jobserver_active() && (token == JOBSERVER_NONE))
+            {
+                break;      // Wait for a child to give its token back.
+            }
+
+            if (slot->out == NULL)
+            {
+                slot->out = tmpfile();
+                slot->err = tmpfile();
+                check_allocation(slot->out);
+                check_allocation(slot->err);
+                check_error(fcntl(fileno(slot->out), F_SETFD, FD_CLOEXEC));
+                check_error(fcntl(fileno(slot->err), F_SETFD, FD_CLOEXEC));
+            }
+
+            slot->arg = arg;
+            slot->token = token;
+            fflush(stdout);
+            fflush(stderr);
+            slot->pid = shell_fork();
+
+            if (slot->pid == 0)
+            {
+                run_child(&args, slot);
+            }
+
+            running++;
+            njobs++;
+            arg = next_arg(&args);
+        }
+
+        int status;
+        struct rusage usage;
+        pid_t pid = background_wait(&status, &usage);
+
+        if (pid == -1)
+        {
+            break;
+        }
+
+        long s = 0;
+
+        while ((s < nslots) && (slots[s].pid != pid))
+        {
+            s++;
+        }
+
+        // Not a slot's, e.g. a process substitution of the parallel command.
+        if (s == nslots)
+        {
+            background_unowned(pid, status, &usage);
+            continue;
+        }
+
+        SLOT *slot = &slots[s];
+        int exitstatus = WIFEXITED(status) ? WEXITSTATUS(status) : EXIT_FAILURE;
+        timing_record(pid, args.argv[0], exitstatus, &usage);
+        copy_output(slot->out, STDOUT_FILENO);
+        copy_output(slot->err, STDERR_FILENO);
+
+        if (exitstatus != EXIT_SUCCESS)
+        {
+            fprintf(stderr, "%s: %s %s: exit %d\n", t->argv[0],
+                args.argv[0], slot->arg, exitstatus);
+            nfailed++;
+        }
+
+        jobserver_release(slot->token);
+        free(slot->arg);
+        slot->pid = 0;
+        running--;
+    }
+
+    for (long s = 0; s < nslots; s++)
+    {
+        if (slots[s].out != NULL)
+        {
+            fclose(slots[s].out);
+            fclose(slots[s].err);
+        }
+    }
+
+    free(slots);
+    free(args.line);
+    if (args.input != NULL)
+    {
+        fclose(args.input);
+    }
+
+    if (nfailed > 0)
+    {
+        fprintf(stderr, "%s: %zu of %zu jobs failed\n", t->argv[0], nfailed, njobs);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -9,6 +9,13 @@
 #include "parser.h"
 #include "globals.h"
 #include "myshell.h"
+#include "arena.h"
+#include "expand.h"
+#include "history.h"
+#include "lineedit.h"
+#include "variables.h"
+#include <ctype.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -16,12 +23,14 @@
  * Written by Chris.McDonald@uwa.edu.au, October 2017.
  * 
  * This file provides the most complicated part of the shell -
- * its command parser.  This file provides two functions (at bottom of file):
+ * its command parser.  This file provides one function (at bottom of file):
  *      
- *      SHELLCMD    *parse_shellcmd(FILE *fp);
- *      void        free_shellcmd(SHELLCMD *t);
- * 
- * These two functions need only be called from within the main() function.
+ *      SHELLCMD    *parse_shellcmd(FILE *fp, ARENA *arena);
+ *
+ * and its variant parse_shellcmd_buffer(), which parses from memory.
+ * The command-tree is allocated from the arena, and released in O(1) by
+ * resetting the arena once the command has executed.
+ * This function need only be called from within the main() function.
  * All other functions are variables are declared as 'static' so that they
  * are not visible outside of this file.
  */
@@ -56,65 +65,252 @@ typedef enum
 
 // -------------------------- lexical stuff -----------------------------
 
+/*
+ * Lines are read whole, however long, by the line editor, and tokenized in
+ * place: unescaping only ever shrinks a word, so each word is written back
+ * over the line and the command's argv points into the line buffer.
+ * A command continued over several lines retires each full buffer, to be
+ * freed when the next command is parsed.
+ * Lines of a memory buffer, such as a mapped script, are tokenized where
+ * they lie, without being copied at all.
+ */
+
 static  FILE    *fp;
+static  char    *buffer;    // The memory input, or NULL to read from fp.
+static  size_t  buffer_length, buffer_offset;
+static  bool    eof;        // True once the input is exhausted.
+static  ARENA   *arena;     // Allocates the command-tree being parsed.
 
 static  TOKEN   token;
-static  char    chararray[BUFSIZ];
-static  char    *ch_ptr;
+static  char    *word;      // The text of the current word token.
+static  char    *ch_ptr;    // Where the next char of the word is written.
+static  bool    in_word;    // True while a word is being written.
+
+static  char    *line;      // The line being tokenized.
+static  char    *input;     // The line buffer owned by the parser.
+static  size_t  input_capacity;
+static  char    **retired;  // Lines still referenced by the command.
+static  size_t  nretired, retired_capacity;
 
-static  char    line[BUFSIZ];
 static  char    prompt1[32], prompt2[32];
 static  char    ch;
+static  bool    pushback;   // True if ch is to be returned again by get().
 static  size_t  ch_count;
 static  size_t  line_length;
 static  bool    init_prompt;
 
 static  uint32_t prompt_no   = 1;
 static  uint32_t nerrors = 0;
+static  size_t  nrejected = 0;  // Commands rejected for their errors.
+
+/**
+ * @brief Keeps the current line until the next command is parsed, as
+ * the command's words point into it.
+ */
+static void retire_line(void)
+{
+    if (nretired == retired_capacity)
+    {
+        retired_capacity = (retired_capacity == 0) ? 4 : retired_capacity * 2;
+        retired = realloc(retired, retired_capacity * sizeof(*retired));
+        check_allocation(retired);
+    }
+
+    retired[nretired++] = input;
+    input = NULL;
+    input_capacity = 0;
+}
+
+/**
+ * @brief Frees the lines retired by the previous command.
+ */
+static void free_retired_lines(void)
+{
+    while (nretired > 0)
+    {
+        free(retired[--nretired]);
+    }
+}
+
+/**
+ * @brief Grows the line buffer to hold at least size chars.
+ *
+ * @param size  The size required.
+ */
+static void reserve_input(size_t size)
+{
+    if (input_capacity < size)
+    {
+        input_capacity = size;
+        input = realloc(input, input_capacity);
+        check_allocation(input);
+    }
+}
+
+/**
+ * @brief Reads the next line of the memory buffer.
+ *
+ * @param keep      The length of the word being written.
+ * @param partial   The word being written.
+ * @return The length of the line read, excluding the word, or -1 at the end.
+ */
+static ssize_t read_buffer_line(size_t keep, char *partial)
+{
+    char *next = buffer + buffer_offset;
+    size_t remaining = buffer_length - buffer_offset;
+
+    if (remaining == 0)
+    {
+        return -1;
+    }
+
+    char *newline = memchr(next, '\n', remaining);
+
+    if (newline != NULL)
+    {
+        // The partial word is moved up against the line, which it preceded.
+        size_t length = newline + 1 - next;
+        buffer_offset += length;
+        line = (keep > 0) ? memmove(next - keep, partial, keep) : next;
+        return length;
+    }
+
+    // A last line without a newline has no room to terminate a word in.
+    buffer_offset = buffer_length;
+    reserve_input(keep + remaining + 1);
+
+    if (keep > 0)
+    {
+        memmove(input, partial, keep);
+    }
+
+    memcpy(input + keep, next, remaining);
+    input[keep + remaining] = '\0';
+    line = input;
+    return remaining;
+}
+
+/**
+ * @brief Reads the next line of the file into the line buffer.
+ *
+ * @param keep      The length of the word being written.
+ * @param partial   The word being written.
+ * @return The length of the line read, excluding the word, or -1 at the end.
+ */
+static ssize_t read_file_line(size_t keep, char *partial)
+{
+    // The first line of a command reuses the buffer, later lines do not.
+    if (!init_prompt && (input != NULL))
+    {
+        retire_line();
+    }
+
+    // A line typed at the terminal is edited, the editor showing the prompt,
+    // and stdin is read as it arrives, the jobs reaped while waiting.
+    ssize_t length = interactive
+        ? lineedit_read(init_prompt ? prompt1 : prompt2, &input, &input_capacity)
+        : (fp == stdin)
+        ? lineedit_getline(&input, &input_capacity)
+        : getline(&input, &input_capacity, fp);
+
+    if (length < 0)
+    {
+        return -1;
+    }
+
+    // Each line typed is added to the history before it is tokenized.
+    if (interactive)
+    {
+        history_add(input, length);
+    }
+
+    if (keep > 0)
+    {
+        reserve_input(keep + length + 1);
+        memmove(input + keep, input, length + 1);
+        memcpy(input, partial, keep);
+    }
+
+    line = input;
+    return length;
+}
+
+/**
+ * @brief Reads the next line. A word still being written is carried over
+ * to the start of the new line.
+ *
+ * @return False at the end of the input.
+ */
+static bool read_line(void)
+{
+    size_t keep = in_word ? (size_t) (ch_ptr - word) : 0;
+    ssize_t length = (buffer != NULL)
+        ? read_buffer_line(keep, word)
+        : read_file_line(keep, word);
+
+    if (length < 0)
+    {
+        eof = true;
+        return false;
+    }
+
+    if (in_word)
+    {
+        word = line;
+        ch_ptr = line + keep;
+    }
+
+    ch_count = keep;
+    line_length = keep + length;
+    return true;
+}
 
 /**
  * @brief Get the next buffered char from line
  */
 static void get(void)
 {
+    if (pushback)
+    {
+        pushback = false;
+        return;
+    }
+
     if (ch_count >= line_length)
     {
         ch = '\0';
-        line[0] = '\0';
         line_length = 0;
         ch_count = 0;
         
-        if (interactive && init_prompt)
+        // Only the lines read from the terminal are prompted for.
+        if (interactive && init_prompt && (buffer == NULL))
         {
             // format prompt
             sprintf(prompt1, "\n%s.%i ", name0, prompt_no);
             strcpy(prompt2, " ++          ");
             prompt2[strlen(prompt1) - 1] = '\0';
-            fputs(prompt1, stdout);
         }
         
-        if (fgets(line, sizeof(line), fp) == NULL)
+        if (!read_line())
         {
             init_prompt = false;
             return;
         }
-        
-        if (interactive && !init_prompt)
+        init_prompt = false;
+
+        if (ch_count >= line_length)
         {
-            fputs(prompt2 , stdout);
+            return;
         }
-        init_prompt = false;
-        
-        line_length = (size_t) strlen(line);
     }
     
     ch = line[ch_count++];
 }
 
 /**
- * @brief Rewinds get's next buffered char to the previous one
+ * @brief Returns the current char again on the next get()
  */
-#define unget() (ch = line[--ch_count])
+#define unget() (pushback = true)
 
 /**
  * @brief Skip spaces, tabs and comments
@@ -123,13 +319,18 @@ static void skip_blanks(void)
 {
     while (ch == ' ' || ch == '\t' || ch == COMMENT_CHAR)
     {
-        // ignore to end-of-line
+        // ignore to end-of-line, the newline still ends the command
         if (ch == COMMENT_CHAR)
         {
-            while (ch_count < line_length)
+            while ((ch != '\n') && (ch_count < line_length))
             {
                 get();
             }
+
+            if (ch == '\n')
+            {
+                return;
+            }
         }
 
         get();
@@ -156,16 +357,203 @@ static void escape_char(void)
     get();
 }
 
+/**
+ * @brief Starts writing a word over the line, from the current char.
+ */
+static void begin_word(void)
+{
+    word = ch_ptr = line + ch_count - 1;
+    in_word = true;
+}
+
+/**
+ * @brief Copies the text of a command, up to its closing ')', into the
+ * word unchanged, to be parsed again when it is expanded. The ')' is
+ * written as EXPAND_END.
+ */
+static void command_text(void)
+{
+    int depth = 0;
+    char quote = '\0';
+
+    for (;;)
+    {
+        get();
+
+        if (eof)
+        {
+            fprintf(stderr, "')' expected\n");
+            nerrors++;
+            return;
+        }
+
+        if (ch == '\\')
+        {
+            *ch_ptr++ = ch;     // The escaped char is copied as it is.
+            get();
+        }
+        else if (quote != '\0')
+        {
+            quote = (ch == quote) ? '\0' : quote;
+        }
+        else if ((ch == '\'') || (ch == '"'))
+        {
+            quote = ch;
+        }
+        else if (ch == '(')
+        {
+            depth++;
+        }
+        else if ((ch == ')') && (depth-- == 0))
+        {
+            *ch_ptr++ = EXPAND_END;
+            return;
+        }
+
+        *ch_ptr++ = ch;
+    }
+}
+
+/**
+ * @brief Reads a process substitution, <( cmd ) or >( cmd ), as a word:
+ * EXPAND_PROCSUB, < or >, the command's text and EXPAND_END. The command
+ * is started when the word is expanded.
+ *
+ * @param kind  Either < or >.
+ */
+static void process_substitution(char kind)
+{
+    // The word is written over the <( just read.
+    word = ch_ptr = line + ch_count - 2;
+    in_word = true;
+    *ch_ptr++ = EXPAND_PROCSUB;
+    *ch_ptr++ = kind;
+    command_text();
+
+    // The delimiter may be overwritten, it is kept in ch.
+    get();
+    unget();
+    *ch_ptr = '\0';
+    in_word = false;
+    token = T_WORD;
+}
+
+/**
+ * @brief Reads a $ of a word. $( cmd ) is a command substitution, written
+ * as EXPAND_COMMAND, the command's text and EXPAND_END, to be run when
+ * the word is expanded. $NAME is written as EXPAND_VARIABLE and NAME, and
+ * ${NAME} also as EXPAND_END, to be expanded with the variable's value.
+ * Any other $ is as it is.
+ *
+ * @return True if the $ starts an expansion.
+ */
+static bool dollar(void)
+{
+    get();
+
+    if (ch == '(')
+    {
+        *ch_ptr++ = EXPAND_COMMAND;
+        command_text();
+        get();
+        return true;
+    }
+
+    bool braced = (ch == '{');
+    *ch_ptr++ = '$';
+
+    if (braced)
+    {
+        *ch_ptr++ = ch;
+        get();
+    }
+
+    if (!isalpha((unsigned char) ch) && (ch != '_'))
+    {
+        return false;
+    }
+
+    // The $, and {, are overwritten.
+    ch_ptr -= 1 + braced;
+    *ch_ptr++ = EXPAND_VARIABLE;
+
+    while (isalnum((unsigned char) ch) || (ch == '_'))
+    {
+        *ch_ptr++ = ch;
+        get();
+    }
+
+    if (braced)
+    {
+        *ch_ptr++ = EXPAND_END;
+
+        if (ch != '}')
+        {
+            fprintf(stderr, "'}' expected\n");
+            nerrors++;
+            return true;
+        }
+
+        get();
+    }
+
+    return true;
+}
+
+/**
+ * @brief Reads quoted text into the word, from its opening quote, the
+ * current char, up to its closing quote. Text in "double quotes" with
+ * expansions is marked by EXPAND_QUOTED, before it, and after it if the
+ * word goes on, as its expansions are not split.
+ *
+ * @param close     True if the word goes on after the closing quote.
+ */
+static void quoted_text(bool close)
+{
+    char quote = ch;
+    char *start = ch_ptr;
+    bool expands = false;
+    *ch_ptr++ = EXPAND_QUOTED;  // Over the opening quote.
+    get();
+
+    while ((ch != quote) && !eof)
+    {
+        if (ch == '\\')
+        {
+            escape_char();
+        }
+        else if ((quote == '"') && (ch == '$'))
+        {
+            expands |= dollar();
+        }
+        else
+        {
+            *ch_ptr++ = ch;
+            get();
+        }
+    }
+
+    // Only text with expansions need be known to be quoted.
+    if (!expands)
+    {
+        memmove(start, start + 1, --ch_ptr - start);
+    }
+    else if (close)
+    {
+        *ch_ptr++ = EXPAND_QUOTED;
+    }
+}
+
 /**
  * @brief parse the line for the token type.
  */
 static void gettoken(void)
 {
-    *chararray = '\0';
+    word = NULL;
     get();
     skip_blanks();
 
-    if (feof(fp)) 
+    if (eof) 
     {
         token = T_EOF;
         return;
@@ -173,12 +561,24 @@ static void gettoken(void)
     
     switch (ch)
     {
-    case '<':   // input redirection 
+    case '<':   // input redirection, or <( cmd )
         token = T_FROMFILE;
+        get();
+        if (ch == '(')
+        {
+            process_substitution('<');
+            break;
+        }
+        unget();
         break;
-    case '>':   // output redirection 
+    case '>':   // output redirection, or >( cmd )
         token = T_APPEND;
         get();
+        if (ch == '(')
+        {
+            process_substitution('>');
+            break;
+        }
         if (ch != '>') 
         {
             unget();
@@ -218,38 +618,52 @@ static void gettoken(void)
         break;
     case '"':
     case '\'':
-        *chararray = ch;
-        ch_ptr = chararray + 1;
-
-        do 
-        {
-            get();
-            while (ch == '\\')
-            {
-                escape_char();
-            }
-            *ch_ptr++ = ch;
-        } 
-        while((ch != *chararray) && !feof(fp));
+    {
+        char quote = ch;
+        begin_word();
+        quoted_text(false);
 
-        *--ch_ptr = '\0';
-        token = (*chararray == '"') ? T_DQUOTE : T_SQUOTE;
+        // The closing quote is overwritten.
+        *ch_ptr = '\0';
+        in_word = false;
+        token = (quote == '"') ? T_DQUOTE : T_SQUOTE;
         break;
+    }
     default:
-        ch_ptr = chararray;
+        begin_word();
 
-        while (!feof(fp)  && !strchr(" \t\n<>|();&", ch)) 
+        while (!eof && !strchr(" \t\n<>|();&", ch)) 
         {
-            while (ch == '\\')
+            if (ch == '\\')
             {
                 escape_char();
             }
-            *ch_ptr++ = ch;
-            get();
+            else if (ch == '$')
+            {
+                dollar();
+            }
+            else if ((ch == '"') || (ch == '\''))
+            {
+                quoted_text(true);
+                get();
+            }
+            else if ((ch == '*') || (ch == '?') || (ch == '['))
+            {
+                *ch_ptr++ = (ch == '*') ? EXPAND_STAR
+                    : (ch == '?') ? EXPAND_QUESTION : EXPAND_BRACKET;
+                get();
+            }
+            else
+            {
+                *ch_ptr++ = ch;
+                get();
+            }
         }
 
+        // The delimiter may be overwritten, it is kept in ch.
         unget();
         *ch_ptr = '\0';
+        in_word = false;
         token = T_WORD;
     }
 }
@@ -277,12 +691,11 @@ static void interrupt_parsing(int why)
  * @brief Create a new shellcmd struct.
  * 
  * @param t The command type.
- * @return A memory allocated pointer to a shellcmd stuct.
+ * @return An arena allocated pointer to a shellcmd stuct.
  */
 static SHELLCMD *new_shellcmd(CMDTYPE t)
 {
-    SHELLCMD *t1 = calloc(1, sizeof(*t1));
-    check_allocation(t1);
+    SHELLCMD *t1 = arena_calloc(arena, sizeof(*t1));
     t1->type = t;
     return t1;
 }
@@ -299,15 +712,9 @@ static bool get_redirection(SHELLCMD *t1)
     TOKEN cptoken = token;
 
     gettoken();
-    if (token == T_WORD) 
+    if (is_word(token)) 
     {
-        filename = strdup(chararray);
-        check_allocation(filename);
-    }
-    else if (token == T_SQUOTE || token == T_DQUOTE) 
-    {
-        filename = strdup(chararray + 1);
-        check_allocation(filename);
+        filename = word;
     }
     else 
     {        
@@ -345,57 +752,52 @@ static bool get_redirection(SHELLCMD *t1)
 }
 
 /**
- * @brief Creates a word list for each shellcmd.
+ * @brief Creates a word list for each shellcmd. There is no limit on the
+ * number of words, other than the kernel's ARG_MAX when executed.
  * 
- * @return A memory allocated pointer to a shellcmd struct.
+ * @return An arena allocated pointer to a shellcmd struct.
  */
 static SHELLCMD *cmd_wordlist(void)
 {
-#define MAXARGS 254     // hope that this will be enough!
-
-    static char *argv[MAXARGS + 2];
+    static char **argv;             // grows to the longest command seen
+    static size_t argv_capacity;
     int argc = 0;
     SHELLCMD *t1 = new_shellcmd(CMD_COMMAND);
 
-    while (!feof(fp) && (is_redirection(token) || is_word(token))) 
+    while (is_redirection(token) || is_word(token)) 
     {
+        if (is_word(token) && ((size_t) argc == argv_capacity))
+        {
+            argv_capacity = (argv_capacity == 0) ? 64 : argv_capacity * 2;
+            argv = realloc(argv, argv_capacity * sizeof(argv[0]));
+            check_allocation(argv);
+        }
+
         switch ((int) token) 
         {
         case T_WORD :
-            if (argc < MAXARGS) 
+            if (word[0] == HOME_CHAR) 
             {
-                if (chararray[0] == HOME_CHAR) 
-                {
-                    argv[argc] = malloc(strlen(HOME) + strlen(chararray) + 1);
-                    check_allocation(argv[argc]);
-                    sprintf(argv[argc], "%s%s", HOME, chararray + 1);
-                }
-                else 
-                {
-                    argv[argc] = strdup(chararray);
-                    check_allocation(argv[argc]);
-                }
-
-                ++argc;
-                argv[argc] = NULL;
+                argv[argc] = arena_alloc(arena,
+                    strlen(HOME) + strlen(word) + 1);
+                sprintf(argv[argc], "%s%s", HOME, word + 1);
             }
+            else 
+            {
+                argv[argc] = word;
+            }
+
+            ++argc;
             break;
         case T_SQUOTE :
         case T_DQUOTE :
-            if (argc < MAXARGS) 
-            {
-                argv[argc] = strdup(chararray + 1);
-                check_allocation(argv[argc]);
-                ++argc;
-                argv[argc] = NULL;
-            }
+            argv[argc++] = word;
             break;
         case T_FROMFILE :
         case T_TOFILE :
         case T_APPEND :
             if (!get_redirection(t1))
             {
-                free_shellcmd(t1);
                 interrupt_parsing(0);
             }
             break;
@@ -408,22 +810,14 @@ static SHELLCMD *cmd_wordlist(void)
 
     if(argc == 0) 
     {
-        free_shellcmd(t1);
         return NULL;
     }
 
-    argv[argc] = NULL;
     t1->argc = argc;
-    t1->argv = malloc((argc + 1) * sizeof(t1->argv[0]));
-    check_allocation(t1->argv);
-
-    for (int i = 0; i < (argc + 1); i++)
-    {
-        t1->argv[i] = argv[i];
-    }
-
+    t1->argv = arena_alloc(arena, (argc + 1) * sizeof(t1->argv[0]));
+    memcpy(t1->argv, argv, argc * sizeof(t1->argv[0]));
+    t1->argv[argc] = NULL;
     return t1;
-#undef    MAXARGS
 }
 
 static SHELLCMD *cmd_pipeline(void);        // a forward declaration
@@ -431,7 +825,7 @@ static SHELLCMD *cmd_pipeline(void);        // a forward declaration
 /**
  * @brief Constructs conditional shellcmds. i.e. &&, ||
  * 
- * @return A memory allocated pointer to a shellcmd.
+ * @return An arena allocated pointer to a shellcmd.
  */
 static SHELLCMD *cmd_condition(void)
 {
@@ -452,7 +846,6 @@ static SHELLCMD *cmd_condition(void)
             fprintf(stderr, "command expected after '%s'\n",
                 (savetoken == T_AND) ? "&&" : "||");
             nerrors++;
-            free_shellcmd(t2);
             interrupt_parsing(0);
         }
 
@@ -465,7 +858,7 @@ static SHELLCMD *cmd_condition(void)
 /**
  * @brief Constructs sequence shellcmds. i.e. ;, &
  * 
- * @return A memory allocated pointer to a shellcmd struct.
+ * @return An arena allocated pointer to a shellcmd struct.
  */
 static SHELLCMD *cmd_sequence(void)
 {
@@ -484,15 +877,237 @@ static SHELLCMD *cmd_sequence(void)
     return t1;
 }
 
+/**
+ * @brief The reserved words that end the commands of an if, while or for.
+ */
+static const char *reserved_words[] =
+{
+    "then", "elif", "else", "fi", "do", "done", NULL
+};
+
+/**
+ * @brief Checks if the token is a keyword. Keywords are only recognised
+ * where a command may start, and not if quoted.
+ *
+ * @param keyword   The keyword.
+ * @return True if the token is the keyword.
+ */
+static bool is_keyword(const char *keyword)
+{
+    return (token == T_WORD) && (strcmp(word, keyword) == 0);
+}
+
+/**
+ * @brief Checks if the token is a reserved word, ending a list of commands.
+ *
+ * @return True if the token is a reserved word.
+ */
+static bool is_reserved(void)
+{
+    for (const char **r = reserved_words; *r != NULL; r++)
+    {
+        if (is_keyword(*r))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief Skips a keyword, which must be the token.
+ *
+ * @param keyword   The keyword.
+ */
+static void expect(const char *keyword)
+{
+    if (!is_keyword(keyword))
+    {
+        fprintf(stderr, "'%s' expected\n", keyword);
+        nerrors++;
+        interrupt_parsing(0);
+    }
+
+    gettoken();
+}
+
+/**
+ * @brief Constructs the commands of an if, while or for, which may be
+ * on many lines, up to a reserved word.
+ *
+ * @param after     The keyword the commands follow, for errors.
+ * @return An arena allocated pointer to a shellcmd.
+ */
+static SHELLCMD *cmd_list(const char *after)
+{
+    SHELLCMD *t1 = NULL, *t2;
+
+    for (;;)
+    {
+        while (token == T_NEWLINE)
+        {
+            gettoken();
+        }
+
+        if ((t2 = cmd_sequence()) == NULL)
+        {
+            break;
+        }
+
+        // The ; before a reserved word ends the command, as a newline does.
+        if ((t2->type == CMD_SEMICOLON) && (t2->right == NULL))
+        {
+            t2 = t2->left;
+        }
+
+        if (t1 != NULL)
+        {
+            SHELLCMD *t3 = new_shellcmd(CMD_SEMICOLON);
+            t3->left = t1;
+            t3->right = t2;
+            t2 = t3;
+        }
+
+        t1 = t2;
+
+        if (token != T_NEWLINE)
+        {
+            break;
+        }
+    }
+
+    if (t1 == NULL)
+    {
+        fprintf(stderr, "command expected after '%s'\n", after);
+        nerrors++;
+        interrupt_parsing(0);
+    }
+
+    return t1;
+}
+
+/**
+ * @brief Constructs an if shellcmd, from its if or elif.
+ *
+ * @return An arena allocated pointer to a shellcmd.
+ */
+static SHELLCMD *cmd_if(void)
+{
+    SHELLCMD *t1 = new_shellcmd(CMD_IF);
+    SHELLCMD *t2 = new_shellcmd(CMD_THEN);
+    const char *keyword = is_keyword("if") ? "if" : "elif";
+
+    gettoken();
+    t1->left = cmd_list(keyword);
+    expect("then");
+    t1->right = t2;
+    t2->left = cmd_list("then");
+
+    // An elif is an if of its own, in place of the else, ended by the fi.
+    if (is_keyword("elif"))
+    {
+        t2->right = cmd_if();
+        return t1;
+    }
+
+    if (is_keyword("else"))
+    {
+        gettoken();
+        t2->right = cmd_list("else");
+    }
+
+    expect("fi");
+    return t1;
+}
+
+/**
+ * @brief Constructs a while shellcmd.
+ *
+ * @return An arena allocated pointer to a shellcmd.
+ */
+static SHELLCMD *cmd_while(void)
+{
+    SHELLCMD *t1 = new_shellcmd(CMD_WHILE);
+
+    gettoken();
+    t1->left = cmd_list("while");
+    expect("do");
+    t1->right = cmd_list("do");
+    expect("done");
+    return t1;
+}
+
+/**
+ * @brief Constructs a for shellcmd. Its name and words are read as a
+ * command's, then the in between them is removed.
+ *
+ * @return An arena allocated pointer to a shellcmd.
+ */
+static SHELLCMD *cmd_for(void)
+{
+    gettoken();
+    SHELLCMD *t1 = cmd_wordlist();
+
+    if ((t1 == NULL) || (t1->argc < 2) || (strcmp(t1->argv[1], "in") != 0)
+        || (variable_name(t1->argv[0]) != strlen(t1->argv[0]))
+        || (t1->infile != NULL) || (t1->outfile != NULL))
+    {
+        fprintf(stderr, "for name in words expected\n");
+        nerrors++;
+        interrupt_parsing(0);
+    }
+
+    t1->type = CMD_FOR;
+    memmove(t1->argv + 1, t1->argv + 2, (t1->argc - 1) * sizeof(t1->argv[0]));
+    t1->argc--;
+
+    if (token == T_SCOLON)
+    {
+        gettoken();
+    }
+
+    while (token == T_NEWLINE)
+    {
+        gettoken();
+    }
+
+    expect("do");
+    t1->left = cmd_list("do");
+    expect("done");
+    return t1;
+}
+
 /**
  * @brief Constructs the subshell and normal shellcmds. i.e. (), cmd
  * 
- * @return A memory allocated pointer to a shellcmd.
+ * @return An arena allocated pointer to a shellcmd.
  */
 static SHELLCMD *cmd_factor(void)
 {
     SHELLCMD *t1, *t2;
 
+    if (is_keyword("if"))
+    {
+        return cmd_if();
+    }
+
+    if (is_keyword("while"))
+    {
+        return cmd_while();
+    }
+
+    if (is_keyword("for"))
+    {
+        return cmd_for();
+    }
+
+    // A reserved word ends the commands before it, it is not a command.
+    if (is_reserved())
+    {
+        return NULL;
+    }
+
     if (token != T_LEFTB)
     {
         t1 = cmd_wordlist();
@@ -511,7 +1126,6 @@ static SHELLCMD *cmd_factor(void)
     {
         fprintf(stderr, "')' expected\n");
         nerrors++;
-        free_shellcmd(t1);
         interrupt_parsing(0);
         return NULL;
     }
@@ -533,7 +1147,6 @@ static SHELLCMD *cmd_factor(void)
     {
         if (!get_redirection(t2)) 
         {
- 		    free_shellcmd(t2);
  		    interrupt_parsing(0);
  		}
 
@@ -547,7 +1160,7 @@ static SHELLCMD *cmd_factor(void)
 /**
  * @brief Constructs a pipeline shellcmd. i.e. |
  * 
- * @return A memory allocated shellcmd. 
+ * @return An arena allocated shellcmd. 
  */
 static SHELLCMD *cmd_pipeline(void)
 {
@@ -560,7 +1173,6 @@ static SHELLCMD *cmd_pipeline(void)
         {
             fprintf(stderr, "output cannot be both redirected and piped\n");
             nerrors++;
-            free_shellcmd(t1);
             interrupt_parsing(0);
             return NULL;
         }
@@ -574,7 +1186,6 @@ static SHELLCMD *cmd_pipeline(void)
         {
             fprintf(stderr, "command expected after '|'\n");
             nerrors++;
-            free_shellcmd(t2);
             interrupt_parsing(0);
             return NULL;
  	    }
@@ -583,7 +1194,6 @@ static SHELLCMD *cmd_pipeline(void)
         {
             fprintf(stderr, "input cannot be both redirected and piped\n");
             nerrors++;
-            free_shellcmd(t2);
             interrupt_parsing(0);
             return NULL;
         }
@@ -599,7 +1209,7 @@ static SHELLCMD *cmd_pipeline(void)
 typedef void (*sighandler_t)(int);
 
 #if defined(CGI_INTERFACE)
-SHELLCMD *parse_shellcmd_string(char *str)
+SHELLCMD *parse_shellcmd_string(char *str, ARENA *arena_)
 {
     extern FILE *fp;                        // in parser.c
     extern SHELLCMD	*cmd_sequence(void);	// in parser.c
@@ -613,8 +1223,16 @@ SHELLCMD *parse_shellcmd_string(char *str)
     }
 
     fp = stdin;
+    buffer = NULL;
+    arena = arena_;
+    free_retired_lines();
+    line_length     = strlen(str) + 1;
+    reserve_input(line_length + 1);
+    line = input;
     sprintf(line, "%s\n", str);
-    line_length     = (size_t) strlen(line);
+    eof             = false;
+    pushback        = false;
+    in_word         = false;
     ch_count        = 0;
     init_prompt     = true;
     nerrors	        = 0;
@@ -629,7 +1247,6 @@ SHELLCMD *parse_shellcmd_string(char *str)
 
     if (nerrors != 0)
     {
-        free_shellcmd(t1);
         t1 = NULL;
     }
     
@@ -639,16 +1256,24 @@ SHELLCMD *parse_shellcmd_string(char *str)
 #else
 
 /**
- * @brief Read input from the file pointer to construct a command tree. 
- *  Anticipated for this function to be called from main().
+ * @brief Read the input to construct a command tree.
  * 
- * @param fp_   The input file pointer.
- * @return A memory allocated pointer to a shellcmd struct.
+ * @param arena_    The arena to allocate the command-tree from.
+ * @return An arena allocated pointer to a shellcmd struct.
  */
-SHELLCMD *parse_shellcmd(FILE *fp_)
+static SHELLCMD *parse(ARENA *arena_)
 {
     SHELLCMD *t1;
     sighandler_t old_handler = signal(SIGINT, interrupt_parsing);
+    ARENA_MARK mark = arena_mark(arena_);
+    nerrors = 0;
+
+    // A memory buffer may be parsed while a command read from the file,
+    // whose words are in the retired lines, is executing.
+    if (buffer == NULL)
+    {
+        free_retired_lines();
+    }
 
     if (setjmp(env)) 
     {
@@ -660,26 +1285,39 @@ SHELLCMD *parse_shellcmd(FILE *fp_)
 
     do 
     {
+        nrejected       += (nerrors != 0);
         t1              = NULL;
-        fp              = fp_;
+        arena           = arena_;
         ch_count        = 0;
         line_length     = 0;
+        pushback        = false;
+        in_word         = false;
         init_prompt     = true;
         nerrors         = 0;
+        token           = T_EOF;
+        arena_rewind(arena, mark);
+        eof             = (buffer != NULL)
+            ? (buffer_offset == buffer_length)
+            : (feof(fp) || lineedit_closed());
 
-        if (feof(fp)) 
+        if (eof) 
         {
             break;
         }
 
         gettoken();
     } 
-    while ((t1 = cmd_sequence()) == NULL);
+    while (((t1 = cmd_sequence()) == NULL) && !is_reserved());
 
     signal(SIGINT, old_handler);    // control-C to interrupt parsing
-    ++prompt_no;
+    prompt_no += (buffer == NULL);
 
-    if ((token != T_NEWLINE) && (token != T_EOF)) 
+    if (is_reserved())
+    {
+        fprintf(stderr, "'%s' unexpected\n", word);
+        nerrors++;
+    }
+    else if ((token != T_NEWLINE) && (token != T_EOF)) 
     {
         fprintf(stderr, "garbage at end of line\n");
         nerrors++;
@@ -687,62 +1325,60 @@ SHELLCMD *parse_shellcmd(FILE *fp_)
 
     if (nerrors != 0)
     {
-        free_shellcmd(t1);
+        nrejected++;
+        arena_rewind(arena, mark);
         t1 = NULL;
     }
     
     return t1;
 }
-#endif
 
 /**
- * @brief Free allocated memory for the infile and outfile.
+ * @brief Counts the commands rejected for syntax errors, so far.
  * 
- * @param t     The shellcmd to free.
+ * @return The number of commands rejected.
  */
-static void free_redirection(SHELLCMD *t)
+size_t parse_rejected(void)
 {
-    free(t->infile);
-    free(t->outfile);
+    return nrejected;
 }
 
 /**
- * @brief Deallocate all dynamically allocated memory in a command-tree.
- * Anticipated that this function will be called from main().
+ * @brief Read input from the file pointer to construct a command tree. 
+ *  Anticipated for this function to be called from main().
  * 
- * @param t     The shellcmd to free.
+ * @param fp_       The input file pointer.
+ * @param arena_    The arena to allocate the command-tree from.
+ * @return An arena allocated pointer to a shellcmd struct.
  */
-void free_shellcmd(SHELLCMD *t)
+SHELLCMD *parse_shellcmd(FILE *fp_, ARENA *arena_)
 {
-    if (t != NULL) 
-    {
-        switch (t->type) 
-        {
-        case CMD_COMMAND :
-            free_shellcmd(t->left);
-
-            for (int a = 0; a < t->argc; a++)
-            {   
-                free(t->argv[a]);   // free command-words
-            }
+    fp = fp_;
+    buffer = NULL;
+    return parse(arena_);
+}
 
-            free(t->argv);
-            free_redirection(t);
-            break;
-        case CMD_SUBSHELL :
-            free_shellcmd(t->left);
-            free_redirection(t);
-            break;
-        case CMD_AND :
-        case CMD_BACKGROUND :
-        case CMD_OR :
-        case CMD_PIPE :
-        case CMD_SEMICOLON :
-            free_shellcmd(t->left); // free the subtrees
-            free_shellcmd(t->right);
-            break;
-        }
-        
-        free(t);    // and free the node itself
-    }
+/**
+ * @brief Read input from a memory buffer to construct a command tree.
+ *  The buffer is tokenized in place, so it must be writable, and the
+ *  command's words point into it.
+ * 
+ * @param buffer_   The input buffer.
+ * @param length    The length of the buffer.
+ * @param offset    The offset to parse from, advanced past the command.
+ * @param arena_    The arena to allocate the command-tree from.
+ * @return An arena allocated pointer to a shellcmd struct.
+ */
+SHELLCMD *parse_shellcmd_buffer(char *buffer_, size_t length, size_t *offset,
+    ARENA *arena_)
+{
+    fp = NULL;
+    buffer = buffer_;
+    buffer_length = length;
+    buffer_offset = *offset;
+    SHELLCMD *t1 = parse(arena_);
+    *offset = buffer_offset;
+    buffer = NULL;
+    return t1;
 }
+#endif
@@ -0,0 +1,397 @@
+/**
+ * @file    pathcache.c
+ * @author  Joshua Ng
+ * @brief   Caches the PATH lookup of command names, like the hash
+ *          builtin of POSIX shells.
+ * @date    2026-10-18
+ */
+
+#include "pathcache.h"
+#include "myshell.h"
+#include "globals.h"
+#include "hashset.h"
+#include "shellscript.h"
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#if defined(__APPLE__)
+    #define st_mtim st_mtimespec
+#endif
+
+#define MIN_CAPACITY 64
+
+/**
+ * @brief A directory of the PATH. Lookups are only valid while none of
+ * the directories searched before the hit has changed.
+ */
+typedef struct
+{
+    char            *name;
+    bool            relative;   // Relative directories follow the cwd.
+    bool            exists;
+    dev_t           device;
+    ino_t           inode;
+    struct timespec mtime;
+    unsigned long   checked;    // The generation of the last stat.
+} PATHDIR;
+
+/**
+ * @brief A cached lookup of a command name.
+ */
+typedef struct
+{
+    char    *name;
+    char    *path;          // NULL if the command was not found.
+    size_t  directory;      // Index of the directory found in.
+    size_t  hits;
+    bool    read;           // True once the script flag is known.
+    bool    script;         // True if the command is a myshell script.
+} PATHENTRY;
+
+static size_t hash_entry(const void *entry);
+static bool entries_equals(const void *entry1, const void *entry2);
+
+static HASHSET entries = {.interface = {.hash = hash_entry,
+    .equals = entries_equals}};
+
+static char         *pathlist   = NULL;     // The PATH the cache is for.
+static PATHDIR      *directories = NULL;
+static size_t       ndirectories = 0;
+static unsigned long generation = 1;
+
+/**
+ * @brief Compute the hash of an entry's command name (FNV-1a).
+ * @param entry The entry to be hashed.
+ * @return The hash of the entry.
+ */
+static size_t hash_entry(const void *entry)
+{
+    size_t hash = (size_t) 2166136261u;
+
+    for (const char *ch = ((const PATHENTRY *) entry)->name; *ch; ch++)
+    {
+        hash = (hash ^ (unsigned char) *ch) * 16777619u;
+    }
+
+    return hash;
+}
+
+/**
+ * @brief Check if two entries are for the same command name.
+ * @param entry1 The first entry.
+ * @param entry2 The second entry.
+ * @return True if the command names equal each other.
+ */
+static bool entries_equals(const void *entry1, const void *entry2)
+{
+    return strcmp(((const PATHENTRY *) entry1)->name,
+        ((const PATHENTRY *) entry2)->name) == 0;
+}
+
+/**
+ * @brief Removes and frees every cached entry.
+ */
+static void clear_entries(void)
+{
+    for (size_t i = 0; i < entries.capacity; i++)
+    {
+        PATHENTRY *entry = entries.elements[i];
+
+        if (entry != NULL)
+        {
+            free(entry->name);
+            free(entry->path);
+            free(entry);
+            entries.elements[i] = NULL;
+        }
+    }
+
+    entries.size = 0;
+}
+
+/**
+ * @brief Splits PATH into its directories, dropping the cache if PATH
+ * has changed since the last lookup.
+ */
+static void update_pathlist(void)
+{
+    if ((pathlist != NULL) && (strcmp(pathlist, PATH) == 0))
+    {
+        return;
+    }
+
+    clear_entries();
+
+    for (size_t i = 0; i < ndirectories; i++)
+    {
+        free(directories[i].name);
+    }
+
+    free(directories);
+    free(pathlist);
+    pathlist = strdup(PATH);
+    check_allocation(pathlist);
+
+    // Like searchpath(), empty directory names are skipped.
+    char *copy = strdup(PATH);
+    check_allocation(copy);
+    size_t capacity = 1;
+
+    for (char *ch = copy; *ch; ch++)
+    {
+        capacity += (*ch == ':');
+    }
+
+    directories = calloc(capacity, sizeof(PATHDIR));
+    check_allocation(directories);
+    ndirectories = 0;
+
+    for (char *dir = strtok(copy, COLON); dir; dir = strtok(NULL, COLON))
+    {
+        PATHDIR *directory = &directories[ndirectories++];
+        directory->name = strdup(dir);
+        check_allocation(directory->name);
+        directory->relative = (dir[0] != '/');
+    }
+
+    free(copy);
+}
+
+/**
+ * @brief Checks whether a directory has changed since the entries were
+ * cached, and if so clears the cache. Each directory is stat'ed at most
+ * once per generation, except relative directories which follow the cwd.
+ *
+ * @param directory The directory to check.
+ * @return True if the directory is unchanged.
+ */
+static bool directory_unchanged(PATHDIR *directory)
+{
+    if ((directory->checked == generation) && !directory->relative)
+    {
+        return true;
+    }
+
+    struct stat info;
+    bool exists = (stat(directory->name, &info) == 0);
+    bool unchanged = (directory->checked == 0)
+        || ((exists == directory->exists)
+            && (!exists
+                || ((info.st_dev == directory->device)
+                    && (info.st_ino == directory->inode)
+                    && (info.st_mtim.tv_sec == directory->mtime.tv_sec)
+                    && (info.st_mtim.tv_nsec == directory->mtime.tv_nsec))));
+
+    directory->checked = generation;
+    directory->exists = exists;
+
+    if (exists)
+    {
+        directory->device = info.st_dev;
+        directory->inode = info.st_ino;
+        directory->mtime = info.st_mtim;
+    }
+
+    // Entries only depend on directories that were checked before.
+    if (!unchanged)
+    {
+        clear_entries();
+    }
+
+    return unchanged;
+}
+
+/**
+ * @brief Checks every directory up to and including the given one.
+ *
+ * @param last  The index of the last directory to check.
+ * @return True if none of the directories have changed.
+ */
+static bool directories_unchanged(size_t last)
+{
+    bool unchanged = true;
+
+    for (size_t i = 0; (i <= last) && (i < ndirectories); i++)
+    {
+        unchanged &= directory_unchanged(&directories[i]);
+    }
+
+    return unchanged;
+}
+
+/**
+ * @brief Resize the entries set capacity.
+ * @param capacity The new capacity.
+ */
+static void resize_entries_capacity(size_t capacity)
+{
+    void *elements = calloc(capacity, sizeof(void *));
+    check_allocation(elements);
+
+    if (entries.capacity == 0)
+    {
+        entries.elements = elements;
+        entries.capacity = capacity;
+        return;
+    }
+
+    void *old = hashset_resize(&entries, elements, capacity);
+    if (old == NULL)
+    {
+        fprintf(stderr, "%s: unable to resize path cache capacity\n", name0);
+        exit(EXIT_FAILURE);
+    }
+    free(old);
+}
+
+/**
+ * @brief Checks if a path is a command that can be run: an executable
+ * regular file, as execvp() looks for, not e.g. a directory.
+ *
+ * @param path  The path.
+ * @return True if the path can be run.
+ */
+static bool executable(const char *path)
+{
+    struct stat info;
+    return (stat(path, &info) == 0) && S_ISREG(info.st_mode)
+        && (access(path, X_OK) == 0);
+}
+
+/**
+ * @brief Searches the PATH directories for a command and caches the
+ * result, including when it is not found.
+ *
+ * @param name  The command name.
+ * @return The new cache entry.
+ */
+static PATHENTRY *add_entry(const char *name)
+{
+    PATHENTRY *entry = calloc(1, sizeof(PATHENTRY));
+    check_allocation(entry);
+    entry->name = strdup(name);
+    check_allocation(entry->name);
+    entry->directory = ndirectories;
+
+    char path[PATH_MAX];
+
+    for (size_t i = 0; i < ndirectories; i++)
+    {
+        int length = snprintf(path, sizeof(path), "%s/%s",
+            directories[i].name, name);
+
+        if ((length < (int) sizeof(path)) && executable(path))
+        {
+            entry->path = strdup(path);
+            check_allocation(entry->path);
+            entry->directory = i;
+            break;
+        }
+    }
+
+    if (entries.capacity == 0)
+    {
+        resize_entries_capacity(MIN_CAPACITY);
+    }
+
+    hashset_insert(&entries, entry);
+
+    if (entries.size > entries.capacity / 2)
+    {
+        resize_entries_capacity(entries.capacity * 2);
+    }
+
+    return entry;
+}
+
+/**
+ * @brief Looks up a command name on PATH, using the cached result while
+ * PATH and the directories searched are unchanged.
+ *
+ * @param name  The command name, which must not contain a '/'.
+ * @return The path of the command, owned by the cache, or NULL.
+ */
+const char* pathcache_lookup(const char* name)
+{
+    update_pathlist();
+
+    PATHENTRY key = {.name = (char *) name};
+    PATHENTRY *entry = (entries.size > 0) ? hashset_find(&entries, &key) : NULL;
+
+    // A change to any directory searched clears the cache.
+    if ((entry == NULL) || !directories_unchanged(entry->directory))
+    {
+        directories_unchanged(ndirectories);
+        entry = add_entry(name);
+    }
+
+    entry->hits++;
+    return entry->path;
+}
+
+/**
+ * @brief Checks if a command found on PATH is a script for this shell. Its
+ * #! line is read once, and the answer kept with the lookup.
+ *
+ * @param name  The command name, looked up by pathcache_lookup().
+ * @return True if the command is a myshell script.
+ */
+bool pathcache_script(const char* name)
+{
+    PATHENTRY key = {.name = (char *) name};
+    PATHENTRY *entry = (entries.size > 0) ? hashset_find(&entries, &key) : NULL;
+
+    if ((entry == NULL) || (entry->path == NULL))
+    {
+        return false;
+    }
+
+    if (!entry->read)
+    {
+        entry->script = shellscript_detect(entry->path);
+        entry->read = true;
+    }
+
+    return entry->script;
+}
+
+/**
+ * @brief Starts a new generation, so the PATH directories are stat'ed
+ * again on their next use. Called once per command line.
+ */
+void pathcache_revalidate(void)
+{
+    generation++;
+}
+
+/**
+ * @brief Forgets every cached lookup.
+ */
+void pathcache_clear(void)
+{
+    clear_entries();
+}
+
+/**
+ * @brief Prints the cached commands that were found.
+ */
+void pathcache_print(void)
+{
+    ITERATOR it = hashset_iterator(&entries);
+
+    while (it.has_next(&it))
+    {
+        PATHENTRY *entry = it.next(&it);
+
+        if (entry->path != NULL)
+        {
+            printf("%4zu\t%s\n", entry->hits, entry->path);
+        }
+    }
+
+    fflush(stdout);
+}
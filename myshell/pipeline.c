@@ -13,57 +13,145 @@
 /**
  * @brief Describes the read and write file descriptors ends.
  */
-enum FILEDESCRIPTOR 
+enum FILEDESCRIPTOR
 {
     READ_END = 0,
     WRITE_END = 1
 };
 
 /**
- * @brief  Pipeline pass output of command1 as input of command2.
- * 
- * @param t     The shell command.
- * @return The exit status of the command.
+ * @brief Counts the stages of a pipeline. The parser builds pipelines
+ * right-recursive, i.e. cmd1 | (cmd2 | (cmd3)).
+ *
+ * @param t     The pipeline shell command.
+ * @return The number of stages.
  */
-int pipeline_shellcmd(SHELLCMD *t)
+static size_t count_stages(SHELLCMD *t)
 {
-    int exitstatus = EXIT_SUCCESS;
-    int fd[2];
-    pipe(fd);
-    pid_t fpid = fork();
-    check_error(fpid);
+    size_t nstages = 1;
 
-    if (fpid == 0)  // Command 1.
+    for (SHELLCMD *s = t; (s != NULL) && (s->type == CMD_PIPE); s = s->right)
     {
-        close(fd[READ_END]);
-        dup2(fd[WRITE_END], STDOUT_FILENO);
-        check_error(execute_shellcmd(t->left));
-        exit(EXIT_FAILURE);
+        nstages++;
     }
 
-    close(fd[WRITE_END]);
-    int status;
-    waitpid(fpid, &status, 0);
-    exitstatus = WIFEXITED(status) ? WEXITSTATUS(status) : EXIT_FAILURE;
+    return nstages;
+}
 
-    if (exitstatus != EXIT_SUCCESS) // Command 1 failed.
+/**
+ * @brief Names a stage of the pipeline, as reported by time.
+ *
+ * @param stage     The stage's shell command.
+ * @return The command's name.
+ */
+static const char *stage_command(SHELLCMD *stage)
+{
+    if (stage == NULL)
     {
-        close(fd[READ_END]);
-        return EXIT_FAILURE;
+        return "";
     }
 
-    fpid = fork();
-    check_error(fpid);
+    return ((stage->type == CMD_COMMAND) && (stage->argc > 0))
+        ? stage->argv[0]
+        : "( )";
+}
 
-    if (fpid == 0) // Command 2.
+/**
+ * @brief Starts one stage of the pipeline in a child process.
+ *
+ * @param stage     The stage's shell command.
+ * @param input     The read end of the previous stage's pipe, or -1.
+ * @param fd        The pipe to the next stage, or {-1, -1} if last.
+ * @return The pid of the child process.
+ */
+static pid_t start_stage(SHELLCMD *stage, int input, int fd[2])
+{
+    pid_t fpid = shell_fork();
+
+    if (fpid == 0)
     {
-        dup2(fd[READ_END], STDIN_FILENO);
-        check_error(execute_shellcmd(t->right));
-        exit(EXIT_FAILURE);
+        if (input != -1)
+        {
+            check_error(dup2(input, STDIN_FILENO));
+            close(input);
+        }
+
+        if (fd[WRITE_END] != -1)
+        {
+            close(fd[READ_END]);
+            check_error(dup2(fd[WRITE_END], STDOUT_FILENO));
+            close(fd[WRITE_END]);
+        }
+
+        finalcommand = true;
+        shell_exit((stage != NULL) ? execute_shellcmd(stage) : EXIT_SUCCESS);
+    }
+
+    return fpid;
+}
+
+/**
+ * @brief  Pipeline pass output of each command as input of the next.
+ * All stages are started before any is waited for, so the stages run
+ * concurrently and the pipeline is only as slow as its slowest stage.
+ *
+ * @param t     The shell command.
+ * @return The exit status of the last stage or, if pipefail is set, of
+ * the rightmost stage to fail.
+ */
+int pipeline_shellcmd(SHELLCMD *t)
+{
+    size_t nstages = count_stages(t);
+    pid_t *pids = malloc(nstages * sizeof(*pids));
+    check_allocation(pids);
+    const char **commands = malloc(nstages * sizeof(*commands));
+    check_allocation(commands);
+
+    int input = -1;     // The read end of the previous stage's pipe.
+    SHELLCMD *s = t;
+
+    for (size_t i = 0; i < nstages; i++)
+    {
+        SHELLCMD *stage = s;
+        int fd[2] = {-1, -1};
+
+        if ((s != NULL) && (s->type == CMD_PIPE))
+        {
+            stage = s->left;
+            s = s->right;
+            check_error(pipe(fd));
+        }
+
+        pids[i] = start_stage(stage, input, fd);
+        commands[i] = stage_command(stage);
+
+        // The parent keeps only the read end for the next stage.
+        if (input != -1)
+        {
+            close(input);
+        }
+
+        if (fd[WRITE_END] != -1)
+        {
+            close(fd[WRITE_END]);
+        }
+
+        input = fd[READ_END];
+    }
+
+    int exitstatus = EXIT_SUCCESS;
+
+    for (size_t i = 0; i < nstages; i++)
+    {
+        int stagestatus = shell_wait(pids[i], commands[i]);
+
+        if (pipefail ? (stagestatus != EXIT_SUCCESS) : (i == nstages - 1))
+        {
+            exitstatus = stagestatus;
+        }
     }
 
-    close(fd[READ_END]);
-    waitpid(fpid, &status, 0);
-    exitstatus = WIFEXITED(status) ? WEXITSTATUS(status) : EXIT_FAILURE;
+    free(pids);
+    free(commands);
     return exitstatus;
 }
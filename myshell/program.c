@@ -0,0 +1,325 @@
+/**
+ * @file    program.c
+ * @author  Joshua Ng
+ * @brief   Lowers a command-tree to a flat array of instructions, with
+ *          explicit jumps for &&, ||, if, while and for, to be run by a
+ *          loop.
+ * @date    2026-10-18
+ */
+
+#include "program.h"
+#include "globals.h"
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * @brief The minimum capacity of a program, and of the lowering stack.
+ */
+#define MIN_CAPACITY 64
+
+/**
+ * @brief No step is to be patched with the instruction emitted.
+ */
+#define NO_PATCH    SIZE_MAX
+
+/**
+ * @brief The kinds of step of lowering a command-tree.
+ */
+typedef enum
+{
+    STEP_NODE = 0,  // lowers a node
+    STEP_EMIT,      // emits an instruction, e.g. the jump of a && or ||
+    STEP_PATCH      // targets a jump at the next instruction
+} STEPKIND;
+
+/**
+ * @brief A step of lowering a command-tree. The steps are kept on a stack,
+ * in place of recursion, so a tree of any depth can be lowered.
+ */
+typedef struct
+{
+    STEPKIND    kind;
+    bool        final;      // STEP_NODE: true if nothing runs after it.
+    SHELLCMD    *t;         // STEP_NODE: the node.
+    INSTRUCTION instruction;    // STEP_EMIT: the instruction.
+    size_t      index;      // STEP_EMIT: the stack index of the STEP_PATCH
+                            // of its jump, or NO_PATCH. STEP_PATCH: the
+                            // jump to target.
+} STEP;
+
+/**
+ * @brief The stack of steps, kept for the next command-tree.
+ */
+static STEP     *steps;
+static size_t   nsteps, steps_capacity;
+
+/**
+ * @brief Pushes a step of lowering.
+ *
+ * @param step  The step.
+ */
+static void push_step(STEP step)
+{
+    if (nsteps == steps_capacity)
+    {
+        steps_capacity = (steps_capacity < MIN_CAPACITY)
+            ? MIN_CAPACITY
+            : steps_capacity * 2;
+        steps = realloc(steps, steps_capacity * sizeof(steps[0]));
+        check_allocation(steps);
+    }
+
+    steps[nsteps++] = step;
+}
+
+/**
+ * @brief Appends an instruction to a program.
+ *
+ * @param program       The program.
+ * @param instruction   The instruction.
+ * @return The index of the instruction.
+ */
+static size_t emit(PROGRAM *program, INSTRUCTION instruction)
+{
+    if (program->count == program->capacity)
+    {
+        program->capacity = (program->capacity < MIN_CAPACITY)
+            ? MIN_CAPACITY
+            : program->capacity * 2;
+        program->code = realloc(program->code,
+            program->capacity * sizeof(program->code[0]));
+        check_allocation(program->code);
+    }
+
+    program->code[program->count] = instruction;
+    return program->count++;
+}
+
+/**
+ * @brief Pushes a node to lower.
+ *
+ * @param t         The node.
+ * @param final     True if nothing runs after the node.
+ */
+static void push_node(SHELLCMD *t, bool final)
+{
+    push_step((STEP){.kind = STEP_NODE, .final = final, .t = t});
+}
+
+/**
+ * @brief Pushes an instruction to emit.
+ *
+ * @param instruction   The instruction.
+ * @param patch         The stack index of the STEP_PATCH that targets
+ *                      the instruction, a jump, or NO_PATCH.
+ */
+static void push_emit(INSTRUCTION instruction, size_t patch)
+{
+    push_step((STEP){.kind = STEP_EMIT, .instruction = instruction,
+        .index = patch});
+}
+
+/**
+ * @brief Pushes the patch of a jump, to target the instruction after
+ * those of the steps pushed since. The jump is set once emitted.
+ *
+ * @param jump  The jump, if already emitted.
+ * @return The stack index of the patch.
+ */
+static size_t push_patch(size_t jump)
+{
+    push_step((STEP){.kind = STEP_PATCH, .index = jump});
+    return nsteps - 1;
+}
+
+/**
+ * @brief Checks if an instruction is a conditional jump.
+ *
+ * @param instruction   The instruction.
+ * @return True if the instruction is a conditional jump.
+ */
+static bool is_conditional(const INSTRUCTION *instruction)
+{
+    return (instruction->op == OP_JUMP_FAILURE)
+        || (instruction->op == OP_JUMP_SUCCESS);
+}
+
+/**
+ * @brief Lowers a node of a command-tree. Its operands are pushed as
+ * steps, right before left, so the left is lowered first.
+ *
+ * @param program   The program.
+ * @param t         The node.
+ * @param final     True if nothing runs after the node.
+ */
+static void lower_node(PROGRAM *program, SHELLCMD *t, bool final)
+{
+    if (t == NULL)          // as in   cmd1 ;
+    {
+        return;
+    }
+
+    switch (t->type)
+    {
+    case CMD_SEMICOLON:     // cmd1 ;  cmd2
+        push_node(t->right, final);
+        push_node(t->left, false);
+        break;
+    case CMD_AND:           // cmd1 && cmd2, skipping cmd2 if cmd1 fails
+    case CMD_OR:            // cmd1 || cmd2, skipping cmd2 if cmd1 succeeds
+    {
+        size_t end = push_patch(0);
+
+        push_node(t->right, final);
+        push_emit((INSTRUCTION){.op = (t->type == CMD_AND)
+            ? OP_JUMP_FAILURE
+            : OP_JUMP_SUCCESS}, end);
+        push_node(t->left, false);
+        break;
+    }
+    case CMD_BACKGROUND:    // cmd1 &  cmd2
+        emit(program, (INSTRUCTION){.op = OP_BACKGROUND, .cmd = t->left});
+        push_node(t->right, final);
+        break;
+    case CMD_IF:            // cond, jump to else if it failed, then, jump to
+    {                       // the end, else, or succeed if there is none
+        SHELLCMD *branches = t->right;
+        size_t end = push_patch(0);
+
+        if ((branches != NULL) && (branches->right != NULL))
+        {
+            push_node(branches->right, final);
+        }
+        else
+        {
+            push_emit((INSTRUCTION){.op = OP_SUCCEED}, NO_PATCH);
+        }
+
+        size_t otherwise = push_patch(0);
+        push_emit((INSTRUCTION){.op = OP_JUMP}, end);
+        push_node((branches != NULL) ? branches->left : NULL, final);
+        push_emit((INSTRUCTION){.op = OP_JUMP_FAILURE}, otherwise);
+        push_node(t->left, false);
+        break;
+    }
+    case CMD_WHILE:         // loop, cond, end the loop if it failed, body,
+    {                       // jump back to cond
+        size_t head = emit(program, (INSTRUCTION){.op = OP_LOOP, .cmd = t});
+        size_t end = push_patch(0);
+
+        push_emit((INSTRUCTION){.op = OP_LOOP_END, .target = head + 1},
+            NO_PATCH);
+        push_node(t->right, false);
+        push_emit((INSTRUCTION){.op = OP_WHILE}, end);
+        push_node(t->left, false);
+        break;
+    }
+    case CMD_FOR:           // loop, set the next word or end the loop,
+    {                       // body, jump back to set the next word
+        emit(program, (INSTRUCTION){.op = OP_LOOP, .cmd = t});
+        size_t next = emit(program, (INSTRUCTION){.op = OP_FOR, .cmd = t});
+
+        push_patch(next);
+        push_emit((INSTRUCTION){.op = OP_LOOP_END, .target = next},
+            NO_PATCH);
+        push_node(t->left, false);
+        break;
+    }
+    default:                // a command, ( cmds ) or a pipeline
+        emit(program, (INSTRUCTION){
+            .op = OP_EXECUTE, .final = final, .cmd = t});
+        break;
+    }
+}
+
+/**
+ * @brief Threads the jumps of a program, so a failure in a chain of &&
+ * jumps once, past the chain. A conditional jump landing on one of the
+ * same kind would take it too, and on the other kind would not, and any
+ * jump landing on a jump would take it.
+ *
+ * @param program   The program.
+ * @param start     The first instruction of the program.
+ */
+static void thread_jumps(PROGRAM *program, size_t start)
+{
+    INSTRUCTION *code = program->code;
+
+    // These jumps are forwards, so the later jumps are threaded first.
+    for (size_t i = program->count; i-- > start; )
+    {
+        if (!is_conditional(&code[i]) && (code[i].op != OP_JUMP))
+        {
+            continue;
+        }
+
+        size_t target = code[i].target;
+
+        while (target < program->count)
+        {
+            if (code[target].op == OP_JUMP)
+            {
+                target = code[target].target;
+            }
+            else if (is_conditional(&code[i]) && is_conditional(&code[target]))
+            {
+                target = (code[target].op == code[i].op)
+                    ? code[target].target
+                    : target + 1;
+            }
+            else
+            {
+                break;
+            }
+        }
+
+        code[i].target = target;
+    }
+}
+
+/**
+ * @brief Lowers a command-tree to instructions, appended to a program.
+ * The instructions run in order, each jump to its target if its
+ * condition holds, until the end of the program. No recursion is used,
+ * the memory used is proportional to the number of nodes.
+ *
+ * @param program   The program.
+ * @param t         The command-tree.
+ * @param final     True if nothing runs after the command-tree.
+ * @return The index of the first instruction.
+ */
+size_t program_lower(PROGRAM *program, SHELLCMD *t, bool final)
+{
+    size_t start = program->count;
+
+    nsteps = 0;
+    push_node(t, final);
+
+    while (nsteps > 0)
+    {
+        STEP step = steps[--nsteps];
+
+        switch (step.kind)
+        {
+        case STEP_NODE:
+            lower_node(program, step.t, step.final);
+            break;
+        case STEP_EMIT:
+        {
+            size_t index = emit(program, step.instruction);
+
+            if (step.index != NO_PATCH)
+            {
+                steps[step.index].index = index;
+            }
+            break;
+        }
+        case STEP_PATCH:
+            program->code[step.index].target = program->count;
+            break;
+        }
+    }
+
+    thread_jumps(program, start);
+    return start;
+}
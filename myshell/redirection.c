@@ -7,14 +7,13 @@
 
 #include "redirection.h"
 #include "globals.h"
-#include "filepaths.h"
-#include "searchpath.h"
+#include <errno.h>
 #include <fcntl.h>
 #include <stdlib.h>
 #include <unistd.h>
 
 /**
- * @brief A redirection data structure.
+ * @brief The fds saved by a builtin's redirections, to be restored.
  */
 typedef struct REDIRECTION
 {
@@ -22,6 +21,12 @@ typedef struct REDIRECTION
     int old_output;
 } REDIRECTION;
 
+/**
+ * @brief The first fd used to save a redirected fd, above those a command
+ * would redirect itself.
+ */
+#define SAVED_FD_MIN    10
+
 /**
  * @brief Creates the redirection data structure.
  * 
@@ -36,69 +41,105 @@ static REDIRECTION* redirection_create(void)
 }
 
 /**
- * @brief A helper function to open a file and redirect.
- * 
- * @param file      The file to open.
- * @param flags     The file open flags.
- * @param fd_old    The file descriptor to replace.
- * @return A clone of the replaced file descriptor.
+ * @brief Gets the shellcmd's redirections, i.e. its plan: the file opened
+ * onto each fd, output first, and its open flags.
+ *
+ * @param t     The shellcmd.
+ * @param plan  Set to the redirections.
+ * @return The number of redirections.
  */
-int redirection(char* file, int flags, int fd_old)
+static int redirection_plan(SHELLCMD *t, REDIRECT plan[2])
 {
-    char *original = file;
-    char *temp = NULL;
+    int n = 0;
 
-    if (!is_absolute_path(file))
+    if (t->outfile != NULL)
     {
-        temp = searchpath(CDPATH, file);
-        if (temp != NULL)
-        {
-            file = temp;
-        }
+        int append = t->append ? O_APPEND : O_TRUNC;
+        plan[n++] = (REDIRECT){STDOUT_FILENO, t->outfile, O_CREAT|O_WRONLY|append};
     }
 
-    int fd = open(file, flags);
+    if (t->infile != NULL)
+    {
+        plan[n++] = (REDIRECT){STDIN_FILENO, t->infile, O_RDONLY};
+    }
+
+    return n;
+}
+
+/**
+ * @brief A helper function to open a file onto a file descriptor.
+ * 
+ * @param redirect  The redirection.
+ * @return True if the file was opened.
+ */
+static bool redirection_open(const REDIRECT *redirect)
+{
+    int fd = open(redirect->file, redirect->flags | O_CLOEXEC, 0666);
     if (fd == -1)
     {
-        print_command_error(name0, original);
-        return -1;
+        print_command_error(name0, (char *) redirect->file);
+        return false;
+    }
+
+    // dup2 clears the close-on-exec flag of the redirected fd.
+    check_error(dup2(fd, redirect->fd));
+    close(fd);
+    return true;
+}
+
+/**
+ * @brief Applies the shellcmd's redirections to this process, for good,
+ * i.e. in the child that runs the command.
+ *
+ * @param t     The shellcmd to handle.
+ * @return True if every file was opened.
+ */
+bool redirection_apply(SHELLCMD *t)
+{
+    REDIRECT plan[2];
+    int n = redirection_plan(t, plan);
+
+    for (int i = 0; i < n; i++)
+    {
+        if (!redirection_open(&plan[i]))
+        {
+            return false;
+        }
     }
 
-    int fd_clone = dup(fd_old);
-    check_error(fd_clone);
-    check_error(dup2(fd, fd_old));
-    free(temp);
-    return fd_clone;
+    return true;
 }
 
 /**
  * @brief Change the input/output node to the requested file descriptor of 
- * provided file.
+ * provided file, saving the replaced ones to be restored. Only commands
+ * that run in the shell itself, i.e. builtins, need to save them; the
+ * saved fds are close-on-exec so they do not leak into children.
  * 
  * @param t     The shellcmd to handle.
  * @return Returns the replaced file descriptor struct.
  */
 REDIRECTION* redirection_shellcmd(SHELLCMD *t)
 {
+    REDIRECT plan[2];
+    int n = redirection_plan(t, plan);
     REDIRECTION* result = redirection_create();
 
-    if (t->outfile != NULL)
+    for (int i = 0; i < n; i++)
     {
-        int append = t->append ? O_APPEND : O_TRUNC;
-        int flags = O_CREAT|O_WRONLY|append;
+        int saved = fcntl(plan[i].fd, F_DUPFD_CLOEXEC, SAVED_FD_MIN);
+        check_error(saved);
 
-        result->old_output = redirection(t->outfile, flags, STDOUT_FILENO);
-
-        if (result->old_output == -1)
+        if (plan[i].fd == STDOUT_FILENO)
         {
-            return NULL;
+            result->old_output = saved;
         }
-    }
- 
-    if (t->infile != NULL)
-    {
-        result->old_input = redirection(t->infile, O_RDONLY, STDIN_FILENO);
-        if (result->old_input == -1)
+        else
+        {
+            result->old_input = saved;
+        }
+
+        if (!redirection_open(&plan[i]))
         {
             free_redirection_shellcmd(t, result);
             return NULL;
@@ -119,13 +160,55 @@ void free_redirection_shellcmd(SHELLCMD *t, REDIRECTION* r)
     if (r->old_input != -1)
     {
         check_error(dup2(r->old_input, STDIN_FILENO));
+        close(r->old_input);
     }
 
     if (r->old_output != -1)
     {
         check_error(dup2(r->old_output, STDOUT_FILENO));
+        close(r->old_output);
     }
 
     free(r);
 }
 
+/**
+ * @brief Frees the redirected file descriptors, keeping the redirections,
+ * i.e. exec without a command.
+ * 
+ * @param r     The redirected file descriptors.
+ */
+void keep_redirection_shellcmd(REDIRECTION* r)
+{
+    if (r->old_input != -1)
+    {
+        close(r->old_input);
+    }
+
+    if (r->old_output != -1)
+    {
+        close(r->old_output);
+    }
+
+    free(r);
+}
+
+/**
+ * @brief Adds the shellcmd's input and output redirections to the spawn
+ * file actions, so they are applied in the child only.
+ *
+ * @param t         The shellcmd to handle.
+ * @param actions   The spawn file actions to add to.
+ */
+void redirection_spawn_actions(SHELLCMD *t, posix_spawn_file_actions_t *actions)
+{
+    REDIRECT plan[2];
+    int n = redirection_plan(t, plan);
+
+    for (int i = 0; i < n; i++)
+    {
+        errno = posix_spawn_file_actions_addopen(actions, plan[i].fd,
+            plan[i].file, plan[i].flags, 0666);
+        check_error(-errno);
+    }
+}
@@ -0,0 +1,673 @@
+/**
+ * @file    scriptcache.c
+ * @author  Joshua Ng
+ * @brief   Caches the parsed command-trees of shell scripts, so that a
+ *          script run again is executed without being lexed or parsed.
+ * @date    2026-10-18
+ */
+
+#include "scriptcache.h"
+#include "globals.h"
+#include "filepaths.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#if defined(__APPLE__)
+    #define st_mtim st_mtimespec
+#endif
+
+/**
+ * A cache file is a header followed by the script's command-trees, one
+ * per statement, each stored in pre-order. A node is a CACHENODE then its
+ * NUL terminated argv strings, infile and outfile, padded to CACHE_ALIGN,
+ * then its left and right subtrees. Nothing in the file is a pointer, so
+ * it is mapped anywhere and a statement's SHELLCMDs are built from it in
+ * the arena, their strings pointing into the mapping.
+ *
+ * The file is named by a hash of the script's real path, and is valid
+ * while the script's size, modification time and content hash match.
+ */
+
+#define CACHE_MAGIC     "myshellc"
+#define CACHE_VERSION   6       // Bumped when the trees stored change.
+#define CACHE_ALIGN     4
+#define MIN_CAPACITY    16      // The stack of nodes' first capacity.
+
+typedef struct
+{
+    char        magic[8];
+    uint32_t    version;
+    uint32_t    nstatements;
+    uint64_t    size;
+    int64_t     mtime_sec;
+    int64_t     mtime_nsec;
+    uint64_t    hash;
+    uint64_t    length;         // The length of the records that follow.
+} CACHEHEADER;
+
+typedef struct
+{
+    uint8_t     type;
+    uint8_t     flags;
+    uint16_t    unused;
+    uint32_t    argc;
+} CACHENODE;
+
+enum
+{
+    NODE_ARGV       = 1,
+    NODE_INFILE     = 2,
+    NODE_OUTFILE    = 4,
+    NODE_APPEND     = 8,
+    NODE_LEFT       = 16,
+    NODE_RIGHT      = 32
+};
+
+static bool verify(SCRIPTCACHE *cache);
+
+/**
+ * @brief Hashes bytes with the 64-bit FNV-1a hash, taken a word rather
+ * than a byte at a time, as a whole script is hashed before it runs.
+ *
+ * @param hash      The hash to continue.
+ * @param data      The bytes to hash.
+ * @param length    The number of bytes.
+ * @return The hash.
+ */
+static uint64_t fnv1a(uint64_t hash, const char *data, size_t length)
+{
+    size_t i = 0;
+
+    for (; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t))
+    {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * 1099511628211u;
+        hash ^= hash >> 32;
+    }
+
+    for (; i < length; i++)
+    {
+        hash = (hash ^ (unsigned char) data[i]) * 1099511628211u;
+    }
+
+    return hash;
+}
+
+#define FNV1A_BASIS 14695981039346656037u
+
+/**
+ * @brief Gets the directory of the cache files, creating it if needed.
+ *
+ * @return A memory allocated path, or NULL if there is none.
+ */
+static char *cache_directory(void)
+{
+    char *xdg = getenv("XDG_CACHE_HOME");
+    char *base;
+
+    if ((xdg != NULL) && (xdg[0] == '/'))
+    {
+        base = strdup(xdg);
+        check_allocation(base);
+    }
+    else if (getenv("HOME") != NULL)
+    {
+        base = join_paths(getenv("HOME"), ".cache");
+    }
+    else
+    {
+        return NULL;
+    }
+
+    mkdir(base, 0700);
+    char *directory = join_paths(base, "myshell");
+    free(base);
+
+    if ((mkdir(directory, 0700) == -1) && (errno != EEXIST))
+    {
+        free(directory);
+        return NULL;
+    }
+
+    return directory;
+}
+
+/**
+ * @brief Gets the path of a script's cache file.
+ *
+ * @param path      The script's path.
+ * @return A memory allocated path, or NULL if there is none.
+ */
+static char *cache_file(const char *path)
+{
+    char *real = realpath(path, NULL);
+
+    if (real == NULL)
+    {
+        return NULL;
+    }
+
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.cache",
+        (unsigned long long) fnv1a(FNV1A_BASIS, real, strlen(real)));
+    free(real);
+
+    char *directory = cache_directory();
+
+    if (directory == NULL)
+    {
+        return NULL;
+    }
+
+    char *file = join_paths(directory, name);
+    free(directory);
+    return file;
+}
+
+/**
+ * @brief Maps the cache file, if it is of the script as it is now.
+ *
+ * @param cache     The cache.
+ * @return True if the cache was mapped.
+ */
+static bool cache_map(SCRIPTCACHE *cache)
+{
+    int fd = open(cache->file, O_RDONLY | O_CLOEXEC);
+
+    if (fd == -1)
+    {
+        return false;
+    }
+
+    struct stat sb;
+    check_error(fstat(fd, &sb));
+
+    if ((size_t) sb.st_size < sizeof(CACHEHEADER))
+    {
+        close(fd);
+        return false;
+    }
+
+    // The words are writable, as they are when the parser makes them.
+    char *mapping = mmap(NULL, sb.st_size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (mapping == MAP_FAILED)
+    {
+        return false;
+    }
+
+    CACHEHEADER *header = (CACHEHEADER *) mapping;
+
+    if ((memcmp(header->magic, CACHE_MAGIC, sizeof(header->magic)) != 0)
+        || (header->version != CACHE_VERSION)
+        || (header->size != cache->size)
+        || (header->mtime_sec != cache->mtime_sec)
+        || (header->mtime_nsec != cache->mtime_nsec)
+        || (header->hash != cache->hash)
+        || (header->length != sb.st_size - sizeof(CACHEHEADER)))
+    {
+        munmap(mapping, sb.st_size);
+        return false;
+    }
+
+    cache->mapping = mapping;
+    cache->mapping_size = sb.st_size;
+    cache->data = mapping + sizeof(CACHEHEADER);
+    cache->length = header->length;
+    cache->nstatements = header->nstatements;
+
+    if (!verify(cache))
+    {
+        fprintf(stderr, "%s: corrupt script cache: %s\n", name0, cache->file);
+        unlink(cache->file);
+        munmap(mapping, sb.st_size);
+        cache->mapping = cache->data = NULL;
+        cache->mapping_size = cache->length = 0;
+        cache->nstatements = 0;
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Opens a script's cache. On a hit its statements are read with
+ * scriptcache_next(), else they are recorded with scriptcache_add() as the
+ * script is parsed, and saved by scriptcache_store().
+ *
+ * @param cache     The cache to open.
+ * @param path      The script's path.
+ * @param script    The script's contents, before it is parsed.
+ * @param sb        The script's status.
+ * @return True if the cache is a hit.
+ */
+bool scriptcache_open(SCRIPTCACHE *cache, const char *path,
+    const char *script, const struct stat *sb)
+{
+    *cache = (SCRIPTCACHE) {0};
+    cache->file = cache_file(path);
+
+    if (cache->file == NULL)
+    {
+        return false;
+    }
+
+    // The parser expands ~ with HOME, so the trees depend on it too.
+    cache->size = sb->st_size;
+    cache->mtime_sec = sb->st_mtim.tv_sec;
+    cache->mtime_nsec = sb->st_mtim.tv_nsec;
+    cache->hash = fnv1a(fnv1a(FNV1A_BASIS, script, sb->st_size),
+        HOME, strlen(HOME) + 1);
+
+    return cache_map(cache);
+}
+
+/**
+ * @brief Takes the next bytes of the records.
+ *
+ * @param cache     The cache.
+ * @param size      The number of bytes.
+ * @return The bytes, or NULL if the records are too short.
+ */
+static void *take(SCRIPTCACHE *cache, size_t size)
+{
+    if (cache->length - cache->offset < size)
+    {
+        return NULL;
+    }
+
+    void *data = cache->data + cache->offset;
+    cache->offset += size;
+    return data;
+}
+
+/**
+ * @brief Takes the next string of the records.
+ *
+ * @param cache     The cache.
+ * @return The string, or NULL if the records are too short.
+ */
+static char *take_string(SCRIPTCACHE *cache)
+{
+    char *string = cache->data + cache->offset;
+    char *end = memchr(string, '\0', cache->length - cache->offset);
+
+    if (end == NULL)
+    {
+        return NULL;
+    }
+
+    cache->offset += end + 1 - string;
+    return string;
+}
+
+/**
+ * @brief Checks a node's fields are ones the parser makes, so a corrupt
+ * cache cannot index past the command types or build a negative argc.
+ *
+ * @param node      The node.
+ * @return True if the node is valid.
+ */
+static bool valid_node(const CACHENODE *node)
+{
+    return (node->type <= CMD_FOR) && (node->argc <= INT_MAX)
+        && ((node->flags & ~(NODE_ARGV | NODE_INFILE | NODE_OUTFILE
+            | NODE_APPEND | NODE_LEFT | NODE_RIGHT)) == 0);
+}
+
+/**
+ * @brief Checks every statement's records, before any is executed, so a
+ * corrupt cache is rebuilt rather than stopping the script part way.
+ *
+ * @param cache     The mapped cache.
+ * @return True if the records are valid.
+ */
+static bool verify(SCRIPTCACHE *cache)
+{
+    size_t pending = 0;     // The nodes still to come of the statements.
+
+    for (uint32_t i = 0; i < cache->nstatements; i++)
+    {
+        pending++;
+
+        while (pending > 0)
+        {
+            CACHENODE *node = take(cache, sizeof(CACHENODE));
+
+            if ((node == NULL) || !valid_node(node))
+            {
+                return false;
+            }
+
+            for (uint32_t a = 0; (node->flags & NODE_ARGV) && (a < node->argc); a++)
+            {
+                if (take_string(cache) == NULL)
+                {
+                    return false;
+                }
+            }
+
+            if (((node->flags & NODE_INFILE) && (take_string(cache) == NULL))
+                || ((node->flags & NODE_OUTFILE) && (take_string(cache) == NULL)))
+            {
+                return false;
+            }
+
+            size_t padding = -cache->offset % CACHE_ALIGN;
+
+            if ((padding != 0) && (take(cache, padding) == NULL))
+            {
+                return false;
+            }
+
+            pending += ((node->flags & NODE_LEFT) != 0)
+                + ((node->flags & NODE_RIGHT) != 0) - 1;
+        }
+    }
+
+    bool valid = (cache->offset == cache->length);
+    cache->offset = 0;
+    return valid;
+}
+
+/**
+ * @brief Makes room on a stack of nodes for two more.
+ *
+ * @param stack     The stack.
+ * @param n         The number of nodes on the stack.
+ * @param capacity  The stack's capacity, updated if it grows.
+ * @param size      The size of a node.
+ * @return The stack, moved if it grew.
+ */
+static void *reserve(void *stack, size_t n, size_t *capacity, size_t size)
+{
+    if (n + 2 > *capacity)
+    {
+        *capacity = (*capacity == 0) ? MIN_CAPACITY : *capacity * 2;
+        stack = realloc(stack, *capacity * size);
+        check_allocation(stack);
+    }
+
+    return stack;
+}
+
+/**
+ * @brief Builds a command-tree from its records. The nodes are built in
+ * pre-order from a stack of the places their subtrees go, for trees of
+ * any depth.
+ *
+ * @param cache     The cache.
+ * @param arena     The arena to allocate the command-tree from.
+ * @param t         The command-tree to build.
+ * @return False if the records are corrupt.
+ */
+static bool build(SCRIPTCACHE *cache, ARENA *arena, SHELLCMD **t)
+{
+    size_t n = 0, capacity = 0;
+    SHELLCMD ***stack = reserve(NULL, n, &capacity, sizeof(*stack));
+    bool valid = true;
+    stack[n++] = t;
+
+    while (valid && (n > 0))
+    {
+        SHELLCMD **place = stack[--n];
+        CACHENODE *node = take(cache, sizeof(CACHENODE));
+
+        if ((node == NULL) || !valid_node(node))
+        {
+            valid = false;
+            break;
+        }
+
+        SHELLCMD *t1 = arena_calloc(arena, sizeof(SHELLCMD));
+        t1->type = node->type;
+        t1->argc = node->argc;
+        t1->append = (node->flags & NODE_APPEND) != 0;
+
+        if (node->flags & NODE_ARGV)
+        {
+            t1->argv = arena_alloc(arena, (t1->argc + 1) * sizeof(char *));
+
+            for (int i = 0; i < t1->argc; i++)
+            {
+                valid &= (t1->argv[i] = take_string(cache)) != NULL;
+            }
+
+            t1->argv[t1->argc] = NULL;
+        }
+
+        if (node->flags & NODE_INFILE)
+        {
+            valid &= (t1->infile = take_string(cache)) != NULL;
+        }
+
+        if (node->flags & NODE_OUTFILE)
+        {
+            valid &= (t1->outfile = take_string(cache)) != NULL;
+        }
+
+        size_t padding = -cache->offset % CACHE_ALIGN;
+        valid &= (take(cache, padding) != NULL) || (padding == 0);
+        *place = t1;
+
+        // The left subtree is recorded first, so it is built first.
+        stack = reserve(stack, n, &capacity, sizeof(*stack));
+
+        if (node->flags & NODE_RIGHT)
+        {
+            stack[n++] = &t1->right;
+        }
+
+        if (node->flags & NODE_LEFT)
+        {
+            stack[n++] = &t1->left;
+        }
+    }
+
+    free(stack);
+    return valid;
+}
+
+/**
+ * @brief Builds the cached script's next statement.
+ *
+ * @param cache     The cache.
+ * @param arena     The arena to allocate the command-tree from.
+ * @return The statement's command-tree, or NULL after the last.
+ */
+SHELLCMD *scriptcache_next(SCRIPTCACHE *cache, ARENA *arena)
+{
+    if (cache->nstatements == 0)
+    {
+        return NULL;
+    }
+
+    SHELLCMD *t;
+    cache->nstatements--;
+
+    if (!build(cache, arena, &t))
+    {
+        fprintf(stderr, "%s: corrupt script cache: %s\n", name0, cache->file);
+        unlink(cache->file);
+        cache->nstatements = 0;
+        return NULL;
+    }
+
+    return t;
+}
+
+/**
+ * @brief Appends bytes to the records.
+ *
+ * @param cache     The cache being recorded.
+ * @param data      The bytes.
+ * @param size      The number of bytes.
+ */
+static void put(SCRIPTCACHE *cache, const void *data, size_t size)
+{
+    if (cache->length + size > cache->capacity)
+    {
+        cache->capacity = (cache->capacity == 0) ? 4096 : cache->capacity;
+
+        while (cache->length + size > cache->capacity)
+        {
+            cache->capacity *= 2;
+        }
+
+        cache->data = realloc(cache->data, cache->capacity);
+        check_allocation(cache->data);
+    }
+
+    memcpy(cache->data + cache->length, data, size);
+    cache->length += size;
+}
+
+/**
+ * @brief Appends a command-tree to the records, in pre-order from a stack
+ * of the nodes still to record, for trees of any depth.
+ *
+ * @param cache     The cache being recorded.
+ * @param t         The command-tree.
+ */
+static void record(SCRIPTCACHE *cache, SHELLCMD *t)
+{
+    size_t n = 0, capacity = 0;
+    SHELLCMD **stack = reserve(NULL, n, &capacity, sizeof(*stack));
+    stack[n++] = t;
+
+    while (n > 0)
+    {
+        t = stack[--n];
+
+        CACHENODE node =
+        {
+            .type   = t->type,
+            .argc   = t->argc,
+            .flags  = ((t->argv != NULL) ? NODE_ARGV : 0)
+                    | ((t->infile != NULL) ? NODE_INFILE : 0)
+                    | ((t->outfile != NULL) ? NODE_OUTFILE : 0)
+                    | (t->append ? NODE_APPEND : 0)
+                    | ((t->left != NULL) ? NODE_LEFT : 0)
+                    | ((t->right != NULL) ? NODE_RIGHT : 0)
+        };
+
+        put(cache, &node, sizeof(node));
+
+        for (int i = 0; (t->argv != NULL) && (i < t->argc); i++)
+        {
+            put(cache, t->argv[i], strlen(t->argv[i]) + 1);
+        }
+
+        if (t->infile != NULL)
+        {
+            put(cache, t->infile, strlen(t->infile) + 1);
+        }
+
+        if (t->outfile != NULL)
+        {
+            put(cache, t->outfile, strlen(t->outfile) + 1);
+        }
+
+        static const char padding[CACHE_ALIGN];
+        put(cache, padding, -cache->length % CACHE_ALIGN);
+        stack = reserve(stack, n, &capacity, sizeof(*stack));
+
+        if (t->right != NULL)
+        {
+            stack[n++] = t->right;
+        }
+
+        if (t->left != NULL)
+        {
+            stack[n++] = t->left;
+        }
+    }
+
+    free(stack);
+}
+
+/**
+ * @brief Records a statement of the script being parsed.
+ *
+ * @param cache     The cache being recorded.
+ * @param t         The statement's command-tree.
+ */
+void scriptcache_add(SCRIPTCACHE *cache, SHELLCMD *t)
+{
+    if ((cache->file != NULL) && (cache->mapping == NULL))
+    {
+        record(cache, t);
+        cache->nstatements++;
+    }
+}
+
+/**
+ * @brief Saves the recorded statements as the script's cache. The file
+ * is written aside and renamed into place, so it is never seen partial.
+ *
+ * @param cache     The cache being recorded.
+ */
+void scriptcache_store(SCRIPTCACHE *cache)
+{
+    if ((cache->file == NULL) || (cache->mapping != NULL))
+    {
+        return;
+    }
+
+    char temp[PATH_MAX];
+    snprintf(temp, sizeof(temp), "%s.%ld", cache->file, (long) getpid());
+    int fd = open(temp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+
+    if (fd == -1)
+    {
+        return;
+    }
+
+    CACHEHEADER header =
+    {
+        .version        = CACHE_VERSION,
+        .nstatements    = cache->nstatements,
+        .size           = cache->size,
+        .mtime_sec      = cache->mtime_sec,
+        .mtime_nsec     = cache->mtime_nsec,
+        .hash           = cache->hash,
+        .length         = cache->length
+    };
+
+    memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+    bool written = (write(fd, &header, sizeof(header)) == sizeof(header))
+        && (write(fd, cache->data, cache->length) == (ssize_t) cache->length);
+
+    if ((close(fd) == -1) || !written || (rename(temp, cache->file) == -1))
+    {
+        unlink(temp);
+    }
+}
+
+/**
+ * @brief Closes a script's cache.
+ *
+ * @param cache     The cache.
+ */
+void scriptcache_close(SCRIPTCACHE *cache)
+{
+    if (cache->mapping != NULL)
+    {
+        munmap(cache->mapping, cache->mapping_size);
+    }
+    else
+    {
+        free(cache->data);
+    }
+
+    free(cache->file);
+    *cache = (SCRIPTCACHE) {0};
+}
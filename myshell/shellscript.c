@@ -7,48 +7,257 @@
 
 #include "shellscript.h"
 #include "globals.h"
-#include "filepaths.h"
+#include "background.h"
+#include "parser.h"
+#include "pathcache.h"
+#include "redirection.h"
+#include "scriptcache.h"
+#include "variables.h"
+#include "wildcard.h"
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 /**
  * @brief Check if the path has a given extension.
- * 
+ *
  * @param path      Path to check
  * @param ext       Extension to check
  * @return True if path ends in the extension.
  */
-static bool has_extension(char *path, char *ext)
+static bool has_extension(const char *path, char *ext)
 {
-    char *dot = strrchr(path, '.');
+    const char *dot = strrchr(path, '.');
     return ((dot != NULL) && strcmp(dot, ext) == 0);
 }
 
 /**
- * @brief Checks and runs shell script shellcmds.
- * 
- * @param t     The shellcmd to handle.
- * @return The exitstatus of the command.
+ * @brief Checks if a file is named as a shell script, with a .sh
+ * extension, without reading it.
+ *
+ * @param path      The file's path.
+ * @return True if the file's name ends in .sh.
+ */
+bool shellscript_named(const char *path)
+{
+    return has_extension(path, ".sh");
+}
+
+/**
+ * @brief Checks if a file is a script for this shell: one with a #! line
+ * naming this shell as its interpreter, or a .sh file without a #! line.
+ *
+ * @param path      The file's path.
+ * @return True if the file is a myshell script.
+ */
+bool shellscript_detect(const char *path)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    if (fd == -1)
+    {
+        return false;
+    }
+
+    char header[256];
+    ssize_t length = read(fd, header, sizeof(header) - 1);
+    close(fd);
+
+    if ((length < 2) || (strncmp(header, "#!", 2) != 0))
+    {
+        return (length >= 0) && has_extension(path, ".sh");
+    }
+
+    header[length] = '\0';
+    header[strcspn(header, "\r\n")] = '\0';
+    char *interpreter = strtok(header + 2, " \t");
+    char *name = (interpreter != NULL) ? strrchr(interpreter, '/') : NULL;
+    name = (name != NULL) ? name + 1 : interpreter;
+
+    // #!/usr/bin/env myshell names the interpreter as its argument.
+    if ((name != NULL) && (strcmp(name, "env") == 0))
+    {
+        name = strtok(NULL, " \t");
+    }
+
+    return ((name != NULL) &&
+        ((strcmp(name, name0) == 0) || (strcmp(name, "myshell") == 0)));
+}
+
+/**
+ * @brief Runs a shell script's statements from its cache.
+ *
+ * @param cache     The script's cache.
+ * @return The exitstatus of the script's last command.
+ */
+static int run_cached(SCRIPTCACHE *cache)
+{
+    ARENA arena = {0};
+    int exitstatus = EXIT_SUCCESS;
+    SHELLCMD *t;
+
+    while ((t = scriptcache_next(cache, &arena)) != NULL)
+    {
+        background_reap();
+        pathcache_revalidate();
+        wildcard_revalidate();
+        finalcommand = (cache->nstatements == 0);
+        exitstatus = noexec ? exitstatus : execute_shellcmd(t);
+        arena_reset(&arena);
+    }
+
+    arena_free(&arena);
+    return exitstatus;
+}
+
+/**
+ * @brief Runs a shell script's statements as they are parsed, recording
+ * them in its cache, which is saved once the whole script has parsed
+ * without errors.
+ *
+ * @param script    The script.
+ * @param length    The script's length.
+ * @param cache     The script's cache.
+ * @return The exitstatus of the script's last command.
+ */
+static int run_parsed(char *script, size_t length, SCRIPTCACHE *cache)
+{
+    ARENA arena = {0};
+    size_t offset = 0;
+    size_t rejected = parse_rejected();
+    int exitstatus = EXIT_SUCCESS;
+
+    while (offset < length)
+    {
+        background_reap();
+        SHELLCMD *t = parse_shellcmd_buffer(script, length, &offset, &arena);
+
+        if (t != NULL)
+        {
+            scriptcache_add(cache, t);
+        }
+
+        if ((offset == length) && (parse_rejected() == rejected))
+        {
+            scriptcache_store(cache);
+        }
+
+        if (t == NULL)
+        {
+            continue;
+        }
+
+        pathcache_revalidate();
+        wildcard_revalidate();
+        finalcommand = (offset == length);
+        exitstatus = noexec ? exitstatus : execute_shellcmd(t);
+        arena_reset(&arena);
+    }
+
+    arena_free(&arena);
+    return exitstatus;
+}
+
+/**
+ * @brief Runs a shell script in this process. The script is mapped
+ * privately, so that it is tokenized in place, and parsed and executed a
+ * command at a time, unless its cached command-trees are executed. The
+ * process exits after the script, so its last command may exec in place.
+ *
+ * @param path      The script's path.
+ * @return The exitstatus of the script's last command.
  */
-int shellscript_shellcmd(SHELLCMD *t)
+int shellscript_run(const char *path)
 {
-    if (!file_exists(t->argv[0]))
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    if (fd == -1)
     {
+        print_command_error(name0, (char *) path);
         return EXIT_FAILURE;
     }
 
-    if (!has_extension(t->argv[0], ".sh"))
+    struct stat sb;
+    check_error(fstat(fd, &sb));
+    size_t length = sb.st_size;
+
+    if (length == 0)
     {
+        close(fd);
+        return EXIT_SUCCESS;
+    }
+
+    char *script = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (script == MAP_FAILED)
+    {
+        print_command_error(name0, (char *) path);
         return EXIT_FAILURE;
     }
 
-    SHELLCMD old_t = *t;
-    char* name = strdup(argv0);
-    char* argv[] = {name, NULL};
-    *t = (SHELLCMD){.argc = 1, .argv = argv, .infile = t->argv[0]};
-    int exitstatus = execute_shellcmd(t);
-    *t = old_t;
-    free(name);
+    SCRIPTCACHE cache = {0};
+    int exitstatus = (scriptcache && scriptcache_open(&cache, path, script, &sb))
+        ? run_cached(&cache)
+        : run_parsed(script, length, &cache);
+
+    scriptcache_close(&cache);
+    munmap(script, length);
     return exitstatus;
 }
+
+/**
+ * @brief Runs commands from a memory buffer in this process, e.g. those
+ * of a process substitution, which is tokenized in place. The process
+ * exits after them, so the last command may exec in place.
+ *
+ * @param buffer    The commands.
+ * @param length    The length of the commands.
+ * @return The exitstatus of the last command.
+ */
+int shellscript_buffer(char *buffer, size_t length)
+{
+    SCRIPTCACHE cache = {0};    // Never stored.
+    return run_parsed(buffer, length, &cache);
+}
+
+/**
+ * @brief Runs a shell script in a forked copy of this shell, rather than
+ * executing the shell binary anew, or in this shell itself if it is the
+ * last command of this process.
+ *
+ * @param t         The shellcmd naming the script.
+ * @param path      The script's path.
+ * @return The exitstatus of the command.
+ */
+int shellscript_shellcmd(SHELLCMD *t, const char *path)
+{
+    fflush(stdout);
+    pid_t fpid = finalcommand ? 0 : shell_fork();
+
+    if (fpid == 0)
+    {
+        if (!redirection_apply(t))
+        {
+            shell_exit(EXIT_FAILURE);
+        }
+
+        // The script starts as if executed anew, from the environment. Run
+        // in place, the shell's jobs stay its children, to be waited for.
+        interactive = false;
+        pipefail = false;
+        variables_reset();
+
+        if (!finalcommand)
+        {
+            background_reset();
+        }
+
+        shell_exit(shellscript_run(path));
+    }
+
+    return shell_wait(fpid, t->argv[0]);
+}
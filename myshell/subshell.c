@@ -1,18 +1,192 @@
 /**
  * @file    subshell.c
  * @author  Joshua Ng
- * @brief   Handles subshell command.
+ * @brief   Handles subshell command. A subshell whose commands can only
+ *          change the directory, the redirected file descriptors and the
+ *          variables runs in the shell itself, which saves and restores
+ *          them, instead of in a child.
  * @date    2023-08-26
  */
 
 #include "subshell.h"
 #include "myshell.h"
 #include "globals.h"
+#include "redirection.h"
+#include "internal.h"
+#include "expand.h"
+#include "variables.h"
+#include <fcntl.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
 
 /**
- * @brief Handles to subshell command.
+ * @brief The minimum capacity of the stack of nodes to check.
+ */
+#define MIN_CAPACITY 16
+
+/**
+ * @brief Checks if a command, once run, changes the shell in no other way
+ * than its directory and variables. Commands run in a child do not, nor do
+ * builtins that only read the shell, cd and export.
+ *
+ * @param t     The command.
+ * @return True if the command is isolated by saving the shell.
+ */
+static bool isolated_command(SHELLCMD *t)
+{
+    int i = 0;
+
+    while ((i < t->argc) && variable_assignment(t->argv[i]))
+    {
+        i++;
+    }
+
+    while (i < t->argc)
+    {
+        // The command is unknown until expanded.
+        if (strpbrk(t->argv[i], EXPAND_MARKERS) != NULL)
+        {
+            return false;
+        }
+
+        switch (parse_cmd(t->argv[i]))
+        {
+        case COMMAND_EXECUTE:
+        case COMMAND_CD:
+        case COMMAND_ECHO:
+        case COMMAND_TRUE:
+        case COMMAND_FALSE:
+        case COMMAND_TEST:
+        case COMMAND_PWD:
+        case COMMAND_PRINTF:
+        case COMMAND_EXPORT:
+            return true;
+        case COMMAND_TIME:              // time [--format=name] cmd
+            i++;
+
+            if ((i < t->argc) && (strncmp(t->argv[i], "--format=", 9) == 0))
+            {
+                i++;
+            }
+            break;
+        default:                        // e.g. exit, exec, set, wait
+            return false;
+        }
+    }
+
+    return true;                        // VAR=val, or time ( cmds )
+}
+
+/**
+ * @brief Checks if the commands of a subshell, once run, change the shell
+ * in no other way than its directory, variables and redirected file
+ * descriptors. The nodes are checked from a stack, for trees of any depth.
+ *
+ * @param t     The commands of the subshell.
+ * @return True if the commands can run in the shell itself.
+ */
+static bool isolated(SHELLCMD *t)
+{
+    SHELLCMD **stack = NULL;
+    size_t n = 0, capacity = 0;
+    bool result = true;
+
+    if (t != NULL)
+    {
+        stack = malloc(MIN_CAPACITY * sizeof(*stack));
+        check_allocation(stack);
+        capacity = MIN_CAPACITY;
+        stack[n++] = t;
+    }
+
+    while (result && (n > 0))
+    {
+        t = stack[--n];
+
+        switch (t->type)
+        {
+        case CMD_COMMAND:
+            result = isolated_command(t);
+            break;
+        case CMD_SUBSHELL:              // each decides for itself
+        case CMD_PIPE:                  // the stages run in children
+            continue;
+        case CMD_BACKGROUND:            // a job of the shell
+            result = false;
+            break;
+        default:                        // ;  &&  ||  if  while  for
+            break;
+        }
+
+        if (n + 2 > capacity)
+        {
+            capacity *= 2;
+            stack = realloc(stack, capacity * sizeof(*stack));
+            check_allocation(stack);
+        }
+
+        if (t->right != NULL)
+        {
+            stack[n++] = t->right;
+        }
+
+        if (t->left != NULL)
+        {
+            stack[n++] = t->left;
+        }
+    }
+
+    free(stack);
+    return result;
+}
+
+/**
+ * @brief Runs the commands of a subshell in the shell itself. The
+ * directory is saved as a file descriptor, the redirected file
+ * descriptors as duplicates and the variables as they are set, and all
+ * are restored after.
+ *
+ * @param t             The subshell.
+ * @param exitstatus    Set to the exitstatus of the commands.
+ * @return False if the directory could not be saved, to run in a child.
+ */
+static bool subshell_inline(SHELLCMD *t, int *exitstatus)
+{
+    int cwd = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    if (cwd == -1)
+    {
+        return false;
+    }
+
+    fflush(stdout);
+    struct REDIRECTION *redirection = redirection_shellcmd(t);
+
+    if (redirection == NULL)
+    {
+        close(cwd);
+        *exitstatus = EXIT_FAILURE;
+        return true;
+    }
+
+    size_t mark = variables_save();
+    finalcommand = false;
+    *exitstatus = execute_shellcmd(t->left);
+    fflush(stdout);
+    variables_rollback(mark);
+
+    check_error(fchdir(cwd));
+    close(cwd);
+    free_redirection_shellcmd(t, redirection);
+    return true;
+}
+
+/**
+ * @brief Handles to subshell command. The commands run in a child, unless
+ * the subshell is the last command of this process, which exits anyway,
+ * or they are isolated by saving the shell.
  * 
  * @param t     The shellcmd to handle.
  * @return The exitstatus of the operation.
@@ -20,28 +194,30 @@
 int subshell_shellcmd(SHELLCMD *t)
 {
     int exitstatus = EXIT_SUCCESS;
+
+    if (!finalcommand && isolated(t->left) && subshell_inline(t, &exitstatus))
+    {
+        return exitstatus;
+    }
+
     pid_t pid;
-    pid = fork();
+    pid = finalcommand ? 0 : shell_fork();
 
     switch (pid)
     {
-    case -1:
-        check_error(pid);
-        break;
     case 0:                             // child process
-        exit(execute_shellcmd(t->left));
+        if (!redirection_apply(t))
+        {
+            shell_exit(EXIT_FAILURE);
+        }
+
+        finalcommand = true;
+        shell_exit(execute_shellcmd(t->left));
         break;
     default:                            // parent process
-    {
-        int status;     // Declare a variable to store the exit status
-        waitpid(pid, &status, 0);       // Wait for the child.
-
-        exitstatus = WIFEXITED(status)  // True if child exited normally.
-            ? WEXITSTATUS(status)       // Update with child exitstatus.
-            : EXIT_FAILURE;             // Child exited failure.
+        exitstatus = shell_wait(pid, "( )");    // Wait for the child.
         break;
     }
-    }
 
     return exitstatus;
 }
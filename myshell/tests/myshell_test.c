@@ -0,0 +1,826 @@
+/**
+ * @file    myshell_test.c
+ * @author  Joshua Ng
+ * @brief   Regression tests for myshell. Each test runs the shell on a
+ *          script and checks what it prints.
+ * @date    2026-10-18
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <ftw.h>
+#include <termios.h>
+#include <sys/wait.h>
+
+#if defined(__linux__)
+#include <sched.h>
+#include <sys/mount.h>
+#endif
+
+/**
+ * @brief The most output of the shell a test checks.
+ */
+#define OUTPUT_MAX          65536
+
+/**
+ * @brief The exit status of a test that cannot run here, as CTest's
+ * SKIP_RETURN_CODE.
+ */
+#define TEST_SKIPPED        77
+
+/**
+ * @brief Gets the real path of the shell to test.
+ *
+ * @return A memory allocated path.
+ */
+static char *shell_path(void)
+{
+    char *shell = getenv("MYSHELL");
+    shell = realpath((shell != NULL) ? shell : MYSHELL_PATH, NULL);
+
+    if (shell == NULL)
+    {
+        perror(MYSHELL_PATH);
+        exit(EXIT_FAILURE);
+    }
+
+    return shell;
+}
+
+#if defined(__linux__)
+/**
+ * @brief Writes a file, whole.
+ *
+ * @param path  The file's path.
+ * @param text  The text to write.
+ * @return False if it cannot be written.
+ */
+static bool write_text(const char *path, const char *text)
+{
+    int fd = open(path, O_WRONLY | O_TRUNC | O_CLOEXEC);
+
+    if (fd == -1)
+    {
+        return false;
+    }
+
+    bool written = (write(fd, text, strlen(text)) == (ssize_t) strlen(text));
+    return (close(fd) == 0) && written;
+}
+#endif
+
+/**
+ * @brief Enters new user, pid and mount namespaces, in which the shell is
+ * pid 1 and may choose the pid of its next child through ns_last_pid.
+ * The calling process only waits, and exits as its child does. Elsewhere
+ * than Linux the test is skipped.
+ */
+static void enter_namespaces(void)
+{
+#if !defined(__linux__)
+    _exit(TEST_SKIPPED);
+#else
+    uid_t uid = getuid();
+    gid_t gid = getgid();
+    char map[64];
+
+    if (unshare(CLONE_NEWUSER | CLONE_NEWPID | CLONE_NEWNS) == -1)
+    {
+        _exit(TEST_SKIPPED);
+    }
+
+    snprintf(map, sizeof(map), "0 %d 1", (int) uid);
+    bool mapped = write_text("/proc/self/setgroups", "deny")
+        && write_text("/proc/self/uid_map", map);
+    snprintf(map, sizeof(map), "0 %d 1", (int) gid);
+    mapped = mapped && write_text("/proc/self/gid_map", map);
+
+    if (!mapped)
+    {
+        _exit(TEST_SKIPPED);
+    }
+
+    pid_t pid = fork();
+
+    if (pid > 0)
+    {
+        int status;
+        waitpid(pid, &status, 0);
+        _exit(WIFEXITED(status) ? WEXITSTATUS(status) : EXIT_FAILURE);
+    }
+
+    if ((pid == -1)
+        || (mount(NULL, "/", NULL, MS_REC | MS_PRIVATE, NULL) == -1)
+        || (mount("proc", "/proc", "proc", 0, NULL) == -1))
+    {
+        _exit(TEST_SKIPPED);
+    }
+#endif
+}
+
+/**
+ * @brief Removes a file or an empty directory, for nftw().
+ *
+ * @return 0, so the walk goes on.
+ */
+static int remove_file(const char *path, const struct stat *sb, int flag,
+    struct FTW *ftw)
+{
+    remove(path);
+    return 0;
+}
+
+/**
+ * @brief Runs the shell on a script, from its stdin, and collects what it
+ * writes to stdout. The shell runs in a temporary directory of its own,
+ * which also holds its script cache, and which is removed after.
+ *
+ * @param script        The script.
+ * @param output        Set to the shell's output, NUL terminated.
+ * @param size          The size of the output's buffer.
+ * @param namespaces    True to run the shell in new namespaces.
+ * @return The shell's exit status.
+ */
+static int run_shell(const char *script, char *output, size_t size,
+    bool namespaces)
+{
+    char *shell = shell_path();
+    char input[] = "/tmp/myshell_test.XXXXXX";
+    int fd = mkstemp(input);
+    int fds[2];
+
+    if ((fd == -1) || (write(fd, script, strlen(script)) == -1)
+        || (lseek(fd, 0, SEEK_SET) == -1) || (pipe(fds) == -1))
+    {
+        perror(input);
+        exit(EXIT_FAILURE);
+    }
+
+    unlink(input);
+    char directory[] = "/tmp/myshell_test.XXXXXX";
+    char cache[sizeof(directory) + 16];
+
+    if (mkdtemp(directory) == NULL)
+    {
+        perror(directory);
+        exit(EXIT_FAILURE);
+    }
+
+    snprintf(cache, sizeof(cache), "%s/.cache", directory);
+    fflush(stdout);
+    pid_t pid = fork();
+
+    if (pid == 0)
+    {
+        if (namespaces)
+        {
+            enter_namespaces();
+        }
+
+        if ((chdir(directory) == -1) || (setenv("XDG_CACHE_HOME", cache, 1) == -1))
+        {
+            perror(directory);
+            _exit(127);
+        }
+
+        dup2(fd, STDIN_FILENO);
+        dup2(fds[1], STDOUT_FILENO);
+        close(fd);
+        close(fds[0]);
+        close(fds[1]);
+        execl(shell, shell, (char *) NULL);
+        perror(shell);
+        _exit(127);
+    }
+
+    close(fd);
+    close(fds[1]);
+    size_t length = 0;
+    ssize_t n;
+
+    while ((n = read(fds[0], output + length, size - 1 - length)) > 0)
+    {
+        length += n;
+    }
+
+    output[length] = '\0';
+    close(fds[0]);
+
+    int status;
+    waitpid(pid, &status, 0);
+    nftw(directory, remove_file, 16, FTW_DEPTH | FTW_PHYS);
+    free(shell);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : EXIT_FAILURE;
+}
+
+/**
+ * @brief Checks the shell prints what it should for a script.
+ *
+ * @param script    The script.
+ * @param expected  What the shell should print.
+ * @return True if it does.
+ */
+static bool expect(const char *script, const char *expected)
+{
+    static char output[OUTPUT_MAX];
+    run_shell(script, output, sizeof(output), false);
+
+    if (strcmp(output, expected) != 0)
+    {
+        printf("script:\n%s\nexpected:\n%s\nprinted:\n%s\n", script,
+            expected, output);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief A command that sets a variable it also expands, e.g. export X=zz
+ * $X, does not read the value it replaced.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+static int test_variables_reassigned(void)
+{
+    bool passed = expect(
+        "X=abc\n"
+        "export X=zz $X\n"
+        "echo $X\n"
+        "export X=yy \"$X\"\n"
+        "echo $X\n"
+        "Y=\"a b\"\n"
+        "export Y=c $Y\n"
+        "echo $Y\n", "zz\nyy\nc\n");
+
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * @brief A job started with the pid of a finished job, kept for wait, is
+ * reaped and reported in its place. The shell runs as pid 1 of a new pid
+ * namespace, so its first job is pid 2, and setting ns_last_pid to 1 once
+ * that job is reaped gives pid 2 to the next.
+ *
+ * @return EXIT_SUCCESS, EXIT_FAILURE or TEST_SKIPPED.
+ */
+static int test_jobs_pid_reuse(void)
+{
+    static char output[OUTPUT_MAX];
+    int exitstatus = run_shell(
+        "sleep 0.1 &\n"
+        "sleep 0.5\n"
+        "echo 1 > /proc/sys/kernel/ns_last_pid\n"
+        "sleep 0.1 &\n"
+        "sleep 0.5\n"
+        "jobs\n", output, sizeof(output), true);
+
+    if (exitstatus == TEST_SKIPPED)
+    {
+        printf("jobs_pid_reuse: cannot enter new namespaces\n");
+        return TEST_SKIPPED;
+    }
+
+    if ((strstr(output, " 2 ") == NULL) || (strstr(output, "Done") == NULL)
+        || (strstr(output, "Running") != NULL))
+    {
+        printf("jobs_pid_reuse: expected one finished job of pid 2:\n%s",
+            output);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief while and for loops, and a for whose variable is the one its
+ * words expand, e.g. for X in $X, which sets it while the words are used.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+static int test_loops(void)
+{
+    bool passed = expect(
+        "for Y in 1 2 ; do for Z in x y ; do echo $Y$Z ; done ; done\n"
+        "N=go\n"
+        "while test $N = go ; do echo once ; N=stop ; done\n"
+        "X=\"a b c\"\n"
+        "for X in $X ; do echo $X ; done\n"
+        "echo $X\n",
+        "1x\n1y\n2x\n2y\nonce\na\nb\nc\nc\n");
+
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * @brief A command is looked for on PATH as execvp() does: a directory,
+ * or a file that cannot be run, of its name is passed over.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+static int test_path_search(void)
+{
+    bool passed = expect(
+        "mkdir p1 p1/cmd p2 p3\n"
+        "echo 'echo p2' > p2/cmd\n"
+        "echo 'echo p3' > p3/cmd\n"
+        "chmod +x p3/cmd\n"
+        "export PATH=p1:p2:p3\n"
+        "cmd\n", "p3\n");
+
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * @brief A command on PATH whose #! line names this shell runs in a copy
+ * of it, whatever its name, and so even if that interpreter does not
+ * exist.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+static int test_script_shebang(void)
+{
+    bool passed = expect(
+        "mkdir bin\n"
+        "echo '#!/nonexistent/myshell' > bin/script\n"
+        "echo 'echo inline' >> bin/script\n"
+        "chmod +x bin/script\n"
+        "export PATH=bin\n"
+        "script\n"
+        "script\n", "inline\ninline\n");
+
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * @brief A script run in a copy of the shell sees only the exported
+ * variables and the shell's default options, as if it were executed anew.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+static int test_script_environment(void)
+{
+    bool passed = expect(
+        "SECRET=leaked\n"
+        "export SHARED=kept\n"
+        "set -o pipefail\n"
+        "echo 'echo secret=$SECRET shared=$SHARED' > s.sh\n"
+        "echo 'set -o' >> s.sh\n"
+        "chmod +x s.sh\n"
+        "./s.sh\n"
+        "echo $SECRET\n",
+        "secret= shared=kept\npipefail\toff\nleaked\n");
+
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * @brief A script's cache is not used once the script has changed, even
+ * to a script of the same size.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+static int test_cache_invalidated(void)
+{
+    bool passed = expect(
+        "echo 'echo one' > s.sh\n"
+        "chmod +x s.sh\n"
+        "./s.sh\n"
+        "./s.sh\n"
+        "echo 'echo two' > s.sh\n"
+        "./s.sh\n",
+        "one\none\ntwo\n");
+
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * @brief A cache whose first command has a type out of range, after the
+ * 56 byte header, is rebuilt and the script parsed again.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+static int test_cache_corrupt(void)
+{
+    bool passed = expect(
+        "echo 'echo one' > s.sh\n"
+        "chmod +x s.sh\n"
+        "./s.sh\n"
+        "for F in .cache/myshell/*.cache ; do\n"
+        "printf x | dd of=$F bs=1 seek=56 conv=notrunc status=none ; done\n"
+        "./s.sh\n"
+        "./s.sh\n",
+        "one\none\none\n");
+
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * @brief parallel runs its jobs while its own process substitutions end,
+ * which are reaped for the command that started them, not taken as jobs.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+static int test_parallel_procsub(void)
+{
+    bool passed = expect(
+        "parallel -j 1 cat {} ::: <(echo x) <(sleep 0.2 ; echo y)\n"
+        "parallel cat {} ::: <(echo z) && echo done\n",
+        "x\ny\nz\ndone\n");
+
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * @brief Every jobserver token the shell's jobs take goes back to the pipe
+ * by the time the shell exits, at the end of its input or with exit. The
+ * first job runs on the shell's implicit token, the others take the two
+ * tokens in the pipe.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+static int test_jobserver_tokens(void)
+{
+    static char output[OUTPUT_MAX];
+    const char *scripts[] =
+    {
+        "sleep 0.2 &\nsleep 0.2 &\nsleep 0.2 &\n",
+        "sleep 5 &\nsleep 5 &\nsleep 5 &\nexit\n",
+    };
+
+    for (size_t i = 0; i < sizeof(scripts) / sizeof(scripts[0]); i++)
+    {
+        int fds[2];
+        char makeflags[64], tokens[8];
+
+        if ((pipe(fds) == -1) || (write(fds[1], "++", 2) != 2))
+        {
+            perror("pipe");
+            return EXIT_FAILURE;
+        }
+
+        snprintf(makeflags, sizeof(makeflags), " -j3 --jobserver-auth=%d,%d",
+            fds[0], fds[1]);
+        setenv("MAKEFLAGS", makeflags, 1);
+        run_shell(scripts[i], output, sizeof(output), false);
+        unsetenv("MAKEFLAGS");
+
+        fcntl(fds[0], F_SETFL, O_NONBLOCK);
+        ssize_t n = read(fds[0], tokens, sizeof(tokens));
+        close(fds[0]);
+        close(fds[1]);
+
+        if (n != 2)
+        {
+            printf("jobserver_tokens: %zd of 2 tokens back after:\n%s",
+                (n < 0) ? 0 : n, scripts[i]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief A process substitution is passed as a /dev/fd path to a pipe,
+ * read from with <( ) and written to with >( ).
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+static int test_process_substitution(void)
+{
+    bool passed = expect(
+        "cat <(echo x)\n"
+        "diff <(echo a) <(echo a) && echo same\n"
+        "cat <(echo y) <(echo z)\n"
+        "echo w > >(cat)\n"
+        "sleep 0.1\n"
+        "echo <(true) | cut -c 1-8\n",
+        "x\nsame\ny\nz\nw\n/dev/fd/\n");
+
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * @brief A command substitution is split into words unless it is quoted,
+ * loses its trailing newlines, and nests.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+static int test_command_substitution(void)
+{
+    bool passed = expect(
+        "for W in $(echo a  b) ; do echo [$W] ; done\n"
+        "for W in \"$(echo 'a  b')\" ; do echo \"[$W]\" ; done\n"
+        "echo x$(printf 'a\\n\\n')y\n"
+        "X=$(echo in)\n"
+        "echo $X\n"
+        "echo $(echo $(echo nested))\n",
+        "[a]\n[b]\n[a  b]\nxay\nin\nnested\n");
+
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * @brief Wildcards match sorted names, a pattern that matches nothing or
+ * is quoted stays literal, ** descends into directories, and a file made
+ * after a directory was listed is found by the next command.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+static int test_wildcards(void)
+{
+    bool passed = expect(
+        "mkdir -p s/t\n"
+        "touch b.c a.c d.h .e.c s/e.c s/t/f.c\n"
+        "echo *.c\n"
+        "echo *.none\n"
+        "echo \"*.c\"\n"
+        "echo [ab].c ?.h\n"
+        "echo **/*.c\n"
+        "touch c.c\n"
+        "echo *.c\n",
+        "a.c b.c\n*.none\n*.c\na.c b.c d.h\n"
+        "a.c b.c s/e.c s/t/f.c\na.c b.c c.c\n");
+
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * @brief Starts the shell on a new terminal, so that it is interactive,
+ * in a directory, with a history file, and types its input.
+ *
+ * @param directory     The directory.
+ * @param histfile      The history file.
+ * @param input         What to type.
+ * @param pid           Set to the shell's pid.
+ * @return The terminal's master, or -1 if there is no terminal.
+ */
+static int run_terminal(const char *directory, const char *histfile,
+    const char *input, pid_t *pid)
+{
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    char *terminal = ((master != -1) && (grantpt(master) == 0)
+        && (unlockpt(master) == 0)) ? ptsname(master) : NULL;
+
+    if (terminal == NULL)
+    {
+        return -1;
+    }
+
+    // Typed ahead, control-R would be taken by the terminal itself.
+    int slave = open(terminal, O_RDWR | O_NOCTTY | O_CLOEXEC);
+    struct termios mode;
+
+    if ((slave != -1) && (tcgetattr(slave, &mode) == 0))
+    {
+#if defined(VREPRINT)
+        mode.c_cc[VREPRINT] = _POSIX_VDISABLE;
+#endif
+        tcsetattr(slave, TCSANOW, &mode);
+    }
+
+    char *shell = shell_path();
+    fflush(stdout);
+    *pid = fork();
+
+    if (*pid == 0)
+    {
+        int slave;
+
+        if ((setsid() == -1) || ((slave = open(terminal, O_RDWR)) == -1)
+            || (chdir(directory) == -1)
+            || (setenv("HISTFILE", histfile, 1) == -1)
+            || (setenv("XDG_CACHE_HOME", directory, 1) == -1))
+        {
+            _exit(127);
+        }
+
+        dup2(slave, STDIN_FILENO);
+        dup2(slave, STDOUT_FILENO);
+        dup2(slave, STDERR_FILENO);
+        close(slave);
+        close(master);
+        execl(shell, shell, (char *) NULL);
+        _exit(127);
+    }
+
+    free(shell);
+    close(slave);
+    (void) !write(master, input, strlen(input));
+    return master;
+}
+
+/**
+ * @brief Reads what the shell writes to its terminal until it exits, and
+ * waits for it.
+ *
+ * @param master    The terminal's master.
+ * @param pid       The shell's pid.
+ */
+static void finish_terminal(int master, pid_t pid)
+{
+    char output[4096];
+
+    while (read(master, output, sizeof(output)) > 0)
+    {
+        continue;
+    }
+
+    close(master);
+    waitpid(pid, NULL, 0);
+}
+
+/**
+ * @brief Reads a file of a directory, whole.
+ *
+ * @param directory     The directory.
+ * @param name          The file's name.
+ * @param text          Set to the file's text, NUL terminated.
+ * @param size          The size of the text's buffer.
+ * @return The text.
+ */
+static char *read_text(const char *directory, const char *name, char *text,
+    size_t size)
+{
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", directory, name);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    ssize_t n = (fd != -1) ? read(fd, text, size - 1) : 0;
+    text[(n > 0) ? n : 0] = '\0';
+
+    if (fd != -1)
+    {
+        close(fd);
+    }
+
+    return text;
+}
+
+/**
+ * @brief The history of interactive shells: a log past the size worth
+ * indexing is indexed as the first shell exits, its older entries are
+ * found through the index, by history -s and control-R, and two shells
+ * running at once each append whole lines that the other finds.
+ *
+ * @return EXIT_SUCCESS, EXIT_FAILURE or TEST_SKIPPED.
+ */
+static int test_history(void)
+{
+    char directory[] = "/tmp/myshell_test.XXXXXX";
+    char histfile[sizeof(directory) + 16];
+    static char text[OUTPUT_MAX];
+
+    if (mkdtemp(directory) == NULL)
+    {
+        perror(directory);
+        return EXIT_FAILURE;
+    }
+
+    // An old entry, then more than the 64 KiB worth indexing after it.
+    snprintf(histfile, sizeof(histfile), "%s/history", directory);
+    FILE *log = fopen(histfile, "w");
+
+    if (log == NULL)
+    {
+        perror(histfile);
+        return EXIT_FAILURE;
+    }
+
+    fprintf(log, "touch needle-found\n");
+
+    for (int i = 0; i < 8000; i++)
+    {
+        fprintf(log, "echo filler %d\n", i);
+    }
+
+    fclose(log);
+
+    pid_t first, second;
+    int master = run_terminal(directory, histfile, "echo first\nexit\n", &first);
+
+    if (master == -1)
+    {
+        printf("history: no terminal\n");
+        nftw(directory, remove_file, 16, FTW_DEPTH | FTW_PHYS);
+        return TEST_SKIPPED;
+    }
+
+    finish_terminal(master, first);
+    bool indexed = (access(strcat(strcpy(text, histfile), ".idx"), F_OK) == 0);
+
+    // The second shell waits for the first to have added its entry.
+    int master1 = run_terminal(directory, histfile,
+        "echo from-b\n"
+        "while test ! -f c-done ; do sleep 0.05 ; done\n"
+        "history -s from- > found\n"
+        "history -s needle > needle\n"
+        "\x12needle-f\n"
+        "tail -n 16 history > tail\n"
+        "exit\n", &first);
+    int master2 = run_terminal(directory, histfile,
+        "echo from-c\n"
+        "touch c-done\n"
+        "exit\n", &second);
+
+    finish_terminal(master2, second);
+    finish_terminal(master1, first);
+
+    bool passed = indexed;
+    read_text(directory, "found", text, sizeof(text));
+    passed &= (strstr(text, "echo from-b\n") != NULL)
+        && (strstr(text, "echo from-c\n") != NULL);
+    read_text(directory, "needle", text, sizeof(text));
+    passed &= (strstr(text, "\ntouch needle-found\n") != NULL);
+    passed &= (access(strcat(strcpy(text, directory), "/needle-found"), F_OK) == 0);
+    read_text(directory, "tail", text, sizeof(text));
+    passed &= (strstr(text, "\necho first\n") != NULL)
+        && (strstr(text, "\necho from-b\n") != NULL)
+        && (strstr(text, "\necho from-c\n") != NULL);
+
+    if (!passed)
+    {
+        printf("history: %s\n", indexed ? "an entry was not found"
+            : "the log was not indexed");
+    }
+
+    nftw(directory, remove_file, 16, FTW_DEPTH | FTW_PHYS);
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * @brief A named test.
+ */
+typedef struct
+{
+    const char *name;
+    int (*run)(void);
+} TEST;
+
+static const TEST tests[] =
+{
+    {"jobs_pid_reuse", test_jobs_pid_reuse},
+    {"variables_reassigned", test_variables_reassigned},
+    {"loops", test_loops},
+    {"path_search", test_path_search},
+    {"script_shebang", test_script_shebang},
+    {"script_environment", test_script_environment},
+    {"cache_invalidated", test_cache_invalidated},
+    {"cache_corrupt", test_cache_corrupt},
+    {"parallel_procsub", test_parallel_procsub},
+    {"jobserver_tokens", test_jobserver_tokens},
+    {"process_substitution", test_process_substitution},
+    {"command_substitution", test_command_substitution},
+    {"wildcards", test_wildcards},
+    {"history", test_history},
+};
+
+#define NTESTS (sizeof(tests) / sizeof(tests[0]))
+
+/**
+ * @brief Runs the named tests, or all of them if none are named.
+ *
+ * @return EXIT_SUCCESS if every test passed or was skipped, TEST_SKIPPED
+ * if the one test named was skipped, else EXIT_FAILURE.
+ */
+int main(int argc, char *argv[])
+{
+    int exitstatus = EXIT_SUCCESS;
+
+    for (size_t i = 0; i < NTESTS; i++)
+    {
+        bool selected = (argc < 2);
+
+        for (int a = 1; a < argc; a++)
+        {
+            selected |= (strcmp(argv[a], tests[i].name) == 0);
+        }
+
+        if (!selected)
+        {
+            continue;
+        }
+
+        int result = tests[i].run();
+        printf("%-24s %s\n", tests[i].name, (result == EXIT_SUCCESS) ? "passed"
+            : (result == TEST_SKIPPED) ? "skipped" : "FAILED");
+        fflush(stdout);
+
+        if (result == EXIT_FAILURE)
+        {
+            exitstatus = EXIT_FAILURE;
+        }
+        else if ((result == TEST_SKIPPED) && (argc == 2))
+        {
+            exitstatus = TEST_SKIPPED;
+        }
+    }
+
+    return exitstatus;
+}
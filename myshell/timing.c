@@ -0,0 +1,338 @@
+/**
+ * @file    timing.c
+ * @author  Joshua Ng
+ * @brief   Resource accounting of timed commands, for the time builtin.
+ *          Every child the shell waits for is reaped with wait4, and its
+ *          usage recorded as a stage of the commands being timed.
+ * @date    2026-10-18
+ */
+
+#include "timing.h"
+#include "globals.h"
+#include <stdlib.h>
+#include <string.h>
+
+// The innermost command being timed, if any.
+static TIMING *active = NULL;
+
+/**
+ * @brief Converts a timeval to milliseconds.
+ *
+ * @param tv    The timeval.
+ * @return The milliseconds.
+ */
+static double timeval_ms(struct timeval tv)
+{
+    return (tv.tv_sec * 1000.0) + (tv.tv_usec / 1000.0);
+}
+
+/**
+ * @brief Subtracts two timevals.
+ *
+ * @param a     The later time.
+ * @param b     The earlier time.
+ * @return a - b.
+ */
+static struct timeval timeval_sub(struct timeval a, struct timeval b)
+{
+    struct timeval d = { a.tv_sec - b.tv_sec, a.tv_usec - b.tv_usec };
+
+    if (d.tv_usec < 0)
+    {
+        d.tv_sec--;
+        d.tv_usec += 1000000;
+    }
+
+    return d;
+}
+
+/**
+ * @brief Adds two timevals.
+ *
+ * @param a     The first time.
+ * @param b     The second time.
+ * @return a + b.
+ */
+static struct timeval timeval_add(struct timeval a, struct timeval b)
+{
+    struct timeval s = { a.tv_sec + b.tv_sec, a.tv_usec + b.tv_usec };
+
+    if (s.tv_usec >= 1000000)
+    {
+        s.tv_sec++;
+        s.tv_usec -= 1000000;
+    }
+
+    return s;
+}
+
+/**
+ * @brief Adds a stage's usage to a total. The maximum resident set size
+ * is the largest of any stage, the rest are sums.
+ *
+ * @param total     The total to add to.
+ * @param usage     The usage to add.
+ */
+static void usage_add(struct rusage *total, const struct rusage *usage)
+{
+    total->ru_utime = timeval_add(total->ru_utime, usage->ru_utime);
+    total->ru_stime = timeval_add(total->ru_stime, usage->ru_stime);
+    total->ru_majflt += usage->ru_majflt;
+    total->ru_minflt += usage->ru_minflt;
+    total->ru_nvcsw += usage->ru_nvcsw;
+    total->ru_nivcsw += usage->ru_nivcsw;
+
+    if (usage->ru_maxrss > total->ru_maxrss)
+    {
+        total->ru_maxrss = usage->ru_maxrss;
+    }
+}
+
+/**
+ * @brief Prints the fields of a usage, in the format given.
+ *
+ * @param usage     The usage to print.
+ * @param format    TIMING_KV or TIMING_JSON.
+ */
+static void print_usage(const struct rusage *usage, TIMING_FORMAT format)
+{
+    const char *f = (format == TIMING_JSON)
+        ? "\"user_ms\":%.3f,\"sys_ms\":%.3f,\"maxrss_kb\":%ld,"
+          "\"majflt\":%ld,\"minflt\":%ld,\"nvcsw\":%ld,\"nivcsw\":%ld"
+        : "user_ms=%.3f sys_ms=%.3f maxrss_kb=%ld "
+          "majflt=%ld minflt=%ld nvcsw=%ld nivcsw=%ld";
+
+    fprintf(stderr, f, timeval_ms(usage->ru_utime),
+        timeval_ms(usage->ru_stime), usage->ru_maxrss, usage->ru_majflt,
+        usage->ru_minflt, usage->ru_nvcsw, usage->ru_nivcsw);
+}
+
+/**
+ * @brief Prints a string as a JSON string.
+ *
+ * @param s     The string.
+ */
+static void print_json_string(const char *s)
+{
+    fputc('"', stderr);
+
+    for (; *s != '\0'; s++)
+    {
+        unsigned char c = (unsigned char) *s;
+
+        if ((c == '"') || (c == '\\'))
+        {
+            fprintf(stderr, "\\%c", c);
+        }
+        else if (c < 0x20)
+        {
+            fprintf(stderr, "\\u%04x", c);
+        }
+        else
+        {
+            fputc(c, stderr);
+        }
+    }
+
+    fputc('"', stderr);
+}
+
+/**
+ * @brief Prints a row of the text table.
+ *
+ * @param label     The stage number, or the row's name.
+ * @param command   The command, or "".
+ * @param status    The exit status, or "".
+ * @param usage     The usage.
+ */
+static void print_row(const char *label, const char *command,
+    const char *status, const struct rusage *usage)
+{
+    fprintf(stderr, " %-6s %-16.16s %6s %9.3f %9.3f %10ld %7ld %7ld %7ld %7ld\n",
+        label, command, status, timeval_ms(usage->ru_utime),
+        timeval_ms(usage->ru_stime), usage->ru_maxrss, usage->ru_majflt,
+        usage->ru_minflt, usage->ru_nvcsw, usage->ru_nivcsw);
+}
+
+/**
+ * @brief Checks if the shell itself did any measurable work.
+ *
+ * @param usage     The shell's usage.
+ * @return True if it used any cpu time, or faulted.
+ */
+static bool usage_any(const struct rusage *usage)
+{
+    return (usage->ru_utime.tv_sec != 0) || (usage->ru_utime.tv_usec != 0)
+        || (usage->ru_stime.tv_sec != 0) || (usage->ru_stime.tv_usec != 0)
+        || (usage->ru_majflt != 0) || (usage->ru_minflt != 0);
+}
+
+/**
+ * @brief Starts timing a command.
+ *
+ * @param timing    The timing, nested in any active one.
+ */
+void timing_begin(TIMING *timing)
+{
+    memset(timing, 0, sizeof(*timing));
+    timing->outer = active;
+    active = timing;
+    check_error(getrusage(RUSAGE_SELF, &timing->self));
+    check_error(clock_gettime(CLOCK_MONOTONIC, &timing->start));
+}
+
+/**
+ * @brief Records a reaped child as a stage of the commands being timed.
+ *
+ * @param pid           The child's pid.
+ * @param command       The child's command.
+ * @param exitstatus    The child's exit status.
+ * @param usage         The child's usage, from wait4.
+ */
+void timing_record(pid_t pid, const char *command, int exitstatus,
+    const struct rusage *usage)
+{
+    for (TIMING *timing = active; timing != NULL; timing = timing->outer)
+    {
+        if (timing->nstages == timing->capacity)
+        {
+            timing->capacity = (timing->capacity == 0) ? 4 : 2 * timing->capacity;
+            timing->stages = realloc(timing->stages,
+                timing->capacity * sizeof(*timing->stages));
+            check_allocation(timing->stages);
+        }
+
+        TIMING_STAGE *stage = &timing->stages[timing->nstages++];
+        stage->pid = pid;
+        stage->command = (command != NULL) ? command : "";
+        stage->exitstatus = exitstatus;
+        stage->usage = *usage;
+    }
+}
+
+/**
+ * @brief Stops timing a command and prints its usage to stderr: the wall
+ * clock time, then a row per stage, the shell's own row if it did the
+ * work itself, e.g. a builtin, and their total.
+ *
+ * @param timing        The timing to end.
+ * @param exitstatus    The exit status of the timed command.
+ * @param format        The output format.
+ */
+void timing_end(TIMING *timing, int exitstatus, TIMING_FORMAT format)
+{
+    struct timespec end;
+    struct rusage self;
+    check_error(clock_gettime(CLOCK_MONOTONIC, &end));
+    check_error(getrusage(RUSAGE_SELF, &self));
+    active = timing->outer;
+
+    double real = ((end.tv_sec - timing->start.tv_sec) * 1000.0)
+        + ((end.tv_nsec - timing->start.tv_nsec) / 1000000.0);
+
+    // The shell's own usage over the command; its peak resident size is
+    // not a difference, so it is reported as is.
+    self.ru_utime = timeval_sub(self.ru_utime, timing->self.ru_utime);
+    self.ru_stime = timeval_sub(self.ru_stime, timing->self.ru_stime);
+    self.ru_majflt -= timing->self.ru_majflt;
+    self.ru_minflt -= timing->self.ru_minflt;
+    self.ru_nvcsw -= timing->self.ru_nvcsw;
+    self.ru_nivcsw -= timing->self.ru_nivcsw;
+    bool shell = usage_any(&self) || (timing->nstages == 0);
+
+    struct rusage total;
+    memset(&total, 0, sizeof(total));
+    for (size_t i = 0; i < timing->nstages; i++)
+    {
+        usage_add(&total, &timing->stages[i].usage);
+    }
+    if (shell)
+    {
+        usage_add(&total, &self);
+    }
+
+    switch (format)
+    {
+    case TIMING_KV:
+    {
+        fprintf(stderr, "scope=total real_ms=%.3f status=%d ", real, exitstatus);
+        print_usage(&total, format);
+
+        for (size_t i = 0; i < timing->nstages; i++)
+        {
+            TIMING_STAGE *stage = &timing->stages[i];
+            fprintf(stderr, "\nscope=stage stage=%zu pid=%d command=%s status=%d ",
+                i + 1, (int) stage->pid, stage->command, stage->exitstatus);
+            print_usage(&stage->usage, format);
+        }
+
+        if (shell)
+        {
+            fprintf(stderr, "\nscope=shell ");
+            print_usage(&self, format);
+        }
+
+        fprintf(stderr, "\n");
+        break;
+    }
+    case TIMING_JSON:
+    {
+        fprintf(stderr, "{\"real_ms\":%.3f,\"status\":%d,", real, exitstatus);
+        print_usage(&total, format);
+        fprintf(stderr, ",\"stages\":[");
+
+        for (size_t i = 0; i < timing->nstages; i++)
+        {
+            TIMING_STAGE *stage = &timing->stages[i];
+            fprintf(stderr, "%s{\"pid\":%d,\"command\":",
+                (i > 0) ? "," : "", (int) stage->pid);
+            print_json_string(stage->command);
+            fprintf(stderr, ",\"status\":%d,", stage->exitstatus);
+            print_usage(&stage->usage, format);
+            fprintf(stderr, "}");
+        }
+
+        fprintf(stderr, "]");
+        if (shell)
+        {
+            fprintf(stderr, ",\"shell\":{");
+            print_usage(&self, format);
+            fprintf(stderr, "}");
+        }
+        fprintf(stderr, "}\n");
+        break;
+    }
+    default:
+    {
+        fprintf(stderr, "\n %.0f msec\n", real);
+        fprintf(stderr, " %-6s %-16s %6s %9s %9s %10s %7s %7s %7s %7s\n",
+            "stage", "command", "status", "user ms", "sys ms", "maxrss KiB",
+            "majflt", "minflt", "nvcsw", "nivcsw");
+
+        for (size_t i = 0; i < timing->nstages; i++)
+        {
+            TIMING_STAGE *stage = &timing->stages[i];
+            char label[24], status[24];
+            snprintf(label, sizeof(label), "%zu", i + 1);
+            snprintf(status, sizeof(status), "%d", stage->exitstatus);
+            print_row(label, stage->command, status, &stage->usage);
+        }
+
+        if (shell)
+        {
+            print_row("shell", "", "", &self);
+        }
+
+        if (timing->nstages + shell > 1)
+        {
+            char status[24];
+            snprintf(status, sizeof(status), "%d", exitstatus);
+            print_row("total", "", status, &total);
+        }
+        break;
+    }
+    }
+
+    free(timing->stages);
+    timing->stages = NULL;
+}
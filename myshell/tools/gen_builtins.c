@@ -0,0 +1,101 @@
+/**
+ * @file    gen_builtins.c
+ * @author  Joshua Ng
+ * @brief   Generates builtin_table.h, a perfect hash table of the builtin
+ *          commands listed in builtins.def, at build time.
+ * @date    2026-10-18
+ */
+
+#include "builtins.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief A builtin's name and the name of its COMMAND enum.
+ */
+typedef struct
+{
+    const char *name;
+    const char *command;
+} BUILTIN;
+
+static const BUILTIN builtins[] =
+{
+#define BUILTIN(name, command) {name, #command},
+#include "builtins.def"
+#undef BUILTIN
+};
+
+#define NBUILTINS   (sizeof(builtins) / sizeof(builtins[0]))
+#define MAX_SEED    100000u
+
+/**
+ * @brief Checks if every builtin hashes to a slot of its own.
+ *
+ * @param seed      The hash seed.
+ * @param nslots    The number of slots.
+ * @param slots     Set to the builtin in each slot, or -1.
+ * @return True if there are no collisions.
+ */
+static bool collision_free(uint32_t seed, uint32_t nslots, int slots[])
+{
+    for (uint32_t s = 0; s < nslots; s++)
+    {
+        slots[s] = -1;
+    }
+
+    for (size_t i = 0; i < NBUILTINS; i++)
+    {
+        uint32_t s = builtin_hash(builtins[i].name, seed) % nslots;
+
+        if (slots[s] != -1)
+        {
+            return false;
+        }
+
+        slots[s] = (int) i;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Searches for the smallest table, and a seed, without collisions
+ * and writes the table to stdout.
+ */
+int main(void)
+{
+    for (uint32_t nslots = NBUILTINS; nslots <= 4 * NBUILTINS; nslots++)
+    {
+        int slots[4 * NBUILTINS];
+
+        for (uint32_t seed = 0; seed < MAX_SEED; seed++)
+        {
+            if (!collision_free(seed, nslots, slots))
+            {
+                continue;
+            }
+
+            printf("// Generated by gen_builtins from builtins.def, do not edit.\n\n");
+            printf("#define BUILTIN_SEED    %uu\n", seed);
+            printf("#define BUILTIN_SLOTS   %uu\n\n", nslots);
+            printf("static const BUILTIN_ENTRY builtin_table[BUILTIN_SLOTS] =\n{\n");
+
+            for (uint32_t s = 0; s < nslots; s++)
+            {
+                if (slots[s] != -1)
+                {
+                    printf("    [%u] = {\"%s\", %s},\n", s,
+                        builtins[slots[s]].name, builtins[slots[s]].command);
+                }
+            }
+
+            printf("};\n");
+            return EXIT_SUCCESS;
+        }
+    }
+
+    fprintf(stderr, "gen_builtins: no perfect hash found\n");
+    return EXIT_FAILURE;
+}
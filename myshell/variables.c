@@ -0,0 +1,547 @@
+/**
+ * @file    variables.c
+ * @author  Joshua Ng
+ * @brief   The shell's variables, and the environment of the commands it
+ *          runs, made of its exported variables.
+ * @date    2026-10-18
+ */
+
+#include "variables.h"
+#include "globals.h"
+#include "hashset.h"
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+/**
+ * Each variable is held as NAME=value, the form of an environment entry,
+ * so the environment passed to exec is only an array of pointers to the
+ * exported variables. It is cached, and rebuilt only once an exported
+ * variable has changed, not for every command run.
+ *
+ * The assignments of VAR=val cmd hide the variables they assign while
+ * cmd runs, and are undone after it, on a stack of temporaries.
+ *
+ * A subshell run in the shell itself saves the variables, and the first
+ * assignment to each variable after is recorded on a stack of its own, to
+ * be undone when the subshell ends.
+ */
+
+#define MIN_CAPACITY    64
+
+/**
+ * @brief A variable.
+ */
+typedef struct
+{
+    char    *entry;     // NAME=value, allocated with the variable.
+    size_t  length;     // The length of NAME.
+    bool    exported;
+    size_t  saves;      // The number of saves when it was set.
+} VARIABLE;
+
+/**
+ * @brief A temporary assignment, to be undone.
+ */
+typedef struct
+{
+    char        *name;
+    VARIABLE    *saved;     // The variable it hides, or NULL.
+} TEMPORARY;
+
+/**
+ * @brief A stack of temporary assignments.
+ */
+typedef struct
+{
+    TEMPORARY   *entries;
+    size_t      count, capacity;
+} TEMPORARIES;
+
+static size_t hash_variable(const void *variable);
+static bool variables_equals(const void *variable1, const void *variable2);
+
+static HASHSET variables = {.interface = {.hash = hash_variable,
+    .equals = variables_equals}};
+
+static char         **environment = NULL;   // The cached environment.
+static size_t       environment_capacity = 0;
+static bool         changed = true;         // True if it must be rebuilt.
+
+static TEMPORARIES  temporaries;        // Of VAR=val cmd.
+static TEMPORARIES  journal;            // Of the variables saved.
+static size_t       saves = 0;          // The saves not yet rolled back.
+
+/**
+ * @brief Compute the hash of a variable's name (FNV-1a).
+ * @param variable The variable to be hashed.
+ * @return The hash of the variable.
+ */
+static size_t hash_variable(const void *variable)
+{
+    const VARIABLE *v = variable;
+    size_t hash = (size_t) 2166136261u;
+
+    for (size_t i = 0; i < v->length; i++)
+    {
+        hash = (hash ^ (unsigned char) v->entry[i]) * 16777619u;
+    }
+
+    return hash;
+}
+
+/**
+ * @brief Check if two variables have the same name.
+ * @param variable1 The first variable.
+ * @param variable2 The second variable.
+ * @return True if the names equal each other.
+ */
+static bool variables_equals(const void *variable1, const void *variable2)
+{
+    const VARIABLE *v1 = variable1, *v2 = variable2;
+    return (v1->length == v2->length)
+        && (memcmp(v1->entry, v2->entry, v1->length) == 0);
+}
+
+/**
+ * @brief Resize the variables set capacity.
+ * @param capacity The new capacity.
+ */
+static void resize_variables_capacity(size_t capacity)
+{
+    void *elements = calloc(capacity, sizeof(void *));
+    check_allocation(elements);
+
+    if (variables.capacity == 0)
+    {
+        variables.elements = elements;
+        variables.capacity = capacity;
+        return;
+    }
+
+    void *old = hashset_resize(&variables, elements, capacity);
+    if (old == NULL)
+    {
+        fprintf(stderr, "%s: unable to resize variables capacity\n", name0);
+        exit(EXIT_FAILURE);
+    }
+    free(old);
+}
+
+/**
+ * @brief Creates a variable.
+ *
+ * @param assignment    NAME=value.
+ * @param exported      True if the variable is exported.
+ * @return The memory allocated variable, freed with free().
+ */
+static VARIABLE *new_variable(const char *assignment, bool exported)
+{
+    size_t size = strlen(assignment) + 1;
+    VARIABLE *v = malloc(sizeof(VARIABLE) + size);
+    check_allocation(v);
+    v->entry = memcpy((char *) (v + 1), assignment, size);
+    v->length = strcspn(assignment, "=");
+    v->exported = exported;
+    v->saves = saves;
+    return v;
+}
+
+/**
+ * @brief Pushes a temporary, hiding a variable until it is restored.
+ *
+ * @param stack     The stack of temporaries.
+ * @param v         The variable that hides it.
+ * @param saved     The variable hidden, or NULL.
+ */
+static void push_temporary(TEMPORARIES *stack, VARIABLE *v, VARIABLE *saved)
+{
+    if (stack->count == stack->capacity)
+    {
+        stack->capacity = (stack->capacity == 0) ? 4 : 2 * stack->capacity;
+        stack->entries = realloc(stack->entries,
+            stack->capacity * sizeof(*stack->entries));
+        check_allocation(stack->entries);
+    }
+
+    TEMPORARY *t = &stack->entries[stack->count++];
+    t->name = strndup(v->entry, v->length);
+    check_allocation(t->name);
+    t->saved = saved;
+}
+
+/**
+ * @brief Finds a variable.
+ *
+ * @param name      The name, not necessarily terminated.
+ * @param length    The length of the name.
+ * @return The variable, or NULL.
+ */
+static VARIABLE *find(const char *name, size_t length)
+{
+    VARIABLE key = {.entry = (char *) name, .length = length};
+    return (variables.size > 0) ? hashset_find(&variables, &key) : NULL;
+}
+
+/**
+ * @brief Puts a variable in place of any of the same name.
+ *
+ * @param v     The variable.
+ * @return The variable replaced, or NULL.
+ */
+static VARIABLE *replace(VARIABLE *v)
+{
+    if (variables.capacity == 0)
+    {
+        resize_variables_capacity(MIN_CAPACITY);
+    }
+
+    VARIABLE *old = hashset_remove(&variables, v).element;
+    hashset_insert(&variables, v);
+
+    if (variables.size > variables.capacity / 2)
+    {
+        resize_variables_capacity(variables.capacity * 2);
+    }
+
+    changed |= v->exported || ((old != NULL) && old->exported);
+    return old;
+}
+
+/**
+ * @brief Points HOME, PATH and CDPATH at their variables' values, or
+ * their defaults.
+ */
+static void shell_variables(void)
+{
+    const char *home = variable_get("HOME", 4);
+    const char *path = variable_get("PATH", 4);
+    const char *cdpath = variable_get("CDPATH", 6);
+
+    HOME = (home != NULL) ? (char *) home : DEFAULT_HOME;
+    PATH = (path != NULL) ? (char *) path : DEFAULT_PATH;
+    CDPATH = (cdpath != NULL) ? (char *) cdpath : DEFAULT_CDPATH;
+}
+
+/**
+ * @brief Checks if an assignment is to HOME, PATH or CDPATH.
+ *
+ * @param assignment    NAME=value.
+ * @return True if the assignment is to HOME, PATH or CDPATH.
+ */
+static bool shell_variable(const char *assignment)
+{
+    return (strncmp(assignment, "HOME=", 5) == 0)
+        || (strncmp(assignment, "PATH=", 5) == 0)
+        || (strncmp(assignment, "CDPATH=", 7) == 0);
+}
+
+/**
+ * @brief Imports the environment, each of its variables exported.
+ *
+ * @param envp  The environment.
+ */
+void variables_init(char **envp)
+{
+    for (char **e = envp; *e != NULL; e++)
+    {
+        if (strchr(*e, '=') != NULL)
+        {
+            free(replace(new_variable(*e, true)));
+        }
+    }
+
+    shell_variables();
+}
+
+/**
+ * @brief Measures a variable name at the start of a string: a letter or
+ * '_', then letters, digits or '_'.
+ *
+ * @param s     The string.
+ * @return The length of the name, or 0 if there is none.
+ */
+size_t variable_name(const char *s)
+{
+    if (!isalpha((unsigned char) s[0]) && (s[0] != '_'))
+    {
+        return 0;
+    }
+
+    size_t length = 1;
+
+    while (isalnum((unsigned char) s[length]) || (s[length] == '_'))
+    {
+        length++;
+    }
+
+    return length;
+}
+
+/**
+ * @brief Checks if a word is an assignment, NAME=value.
+ *
+ * @param word  The word.
+ * @return True if the word is an assignment.
+ */
+bool variable_assignment(const char *word)
+{
+    size_t length = variable_name(word);
+    return (length > 0) && (word[length] == '=');
+}
+
+/**
+ * @brief Gets the value of a variable.
+ *
+ * @param name      The name, not necessarily terminated.
+ * @param length    The length of the name.
+ * @return The value, or NULL if the variable is not set.
+ */
+const char *variable_get(const char *name, size_t length)
+{
+    VARIABLE *v = find(name, length);
+    return (v != NULL) ? v->entry + v->length + 1 : NULL;
+}
+
+/**
+ * @brief Sets a variable. A variable that was exported stays exported.
+ *
+ * @param assignment    NAME=value.
+ * @param exported      True to export the variable.
+ */
+void variable_set(const char *assignment, bool exported)
+{
+    VARIABLE *v = new_variable(assignment, exported);
+    VARIABLE *old = find(v->entry, v->length);
+    v->exported |= (old != NULL) && old->exported;
+    old = replace(v);
+
+    // A variable set before the last save is kept, to be restored.
+    if ((saves > 0) && ((old == NULL) || (old->saves < saves)))
+    {
+        push_temporary(&journal, v, old);
+    }
+    else
+    {
+        free(old);
+    }
+
+    // Only HOME, PATH and CDPATH are pointed at, e.g. not a loop's variable.
+    if (shell_variable(assignment))
+    {
+        shell_variables();
+    }
+}
+
+/**
+ * @brief Exports a variable, which is then passed to the commands run.
+ *
+ * @param name  The variable's name, or an assignment, NAME=value.
+ */
+void variable_export(const char *name)
+{
+    if (strchr(name, '=') != NULL)
+    {
+        variable_set(name, true);
+        return;
+    }
+
+    VARIABLE *v = find(name, strlen(name));
+
+    if ((v != NULL) && !v->exported && (v->saves < saves))
+    {
+        variable_set(v->entry, true);   // A copy, the variable is restored.
+    }
+    else if ((v != NULL) && !v->exported)
+    {
+        v->exported = true;
+        changed = true;
+    }
+}
+
+/**
+ * @brief Makes the assignments of a command, NAME=value words. Those
+ * made for a command alone are temporary and exported, e.g. VAR=val cmd,
+ * and undone with variables_restore().
+ *
+ * @param assignments   The assignments.
+ * @param n             The number of assignments.
+ * @param temporary     True if the assignments are for a command alone.
+ * @return The mark to restore to.
+ */
+size_t variables_assign(char **assignments, int n, bool temporary)
+{
+    size_t mark = temporaries.count;
+
+    // Most commands assign nothing.
+    if (n == 0)
+    {
+        return mark;
+    }
+
+    for (int i = 0; i < n; i++)
+    {
+        if (!temporary)
+        {
+            variable_set(assignments[i], false);
+            continue;
+        }
+
+        VARIABLE *v = new_variable(assignments[i], true);
+        push_temporary(&temporaries, v, replace(v));
+    }
+
+    shell_variables();
+    return mark;
+}
+
+/**
+ * @brief Undoes the temporaries pushed since a mark, latest first.
+ *
+ * @param stack     The stack of temporaries.
+ * @param mark      The count of the stack to undo to.
+ */
+static void undo(TEMPORARIES *stack, size_t mark)
+{
+    if (stack->count == mark)
+    {
+        return;
+    }
+
+    while (stack->count > mark)
+    {
+        TEMPORARY *t = &stack->entries[--stack->count];
+        VARIABLE key = {.entry = t->name, .length = strlen(t->name)};
+        VARIABLE *v = hashset_remove(&variables, &key).element;
+
+        changed |= ((v != NULL) && v->exported);
+        free(v);
+
+        if (t->saved != NULL)
+        {
+            free(replace(t->saved));
+        }
+
+        free(t->name);
+    }
+
+    shell_variables();
+}
+
+/**
+ * @brief Undoes the temporary assignments made since a mark.
+ *
+ * @param mark  The mark, from variables_assign().
+ */
+void variables_restore(size_t mark)
+{
+    undo(&temporaries, mark);
+}
+
+/**
+ * @brief Saves the variables, e.g. for a subshell run in the shell
+ * itself. Each variable set after, until the variables are rolled back,
+ * is restored.
+ *
+ * @return The mark to roll back to.
+ */
+size_t variables_save(void)
+{
+    saves++;
+    return journal.count;
+}
+
+/**
+ * @brief Restores the variables saved, undoing every assignment since.
+ *
+ * @param mark  The mark, from variables_save().
+ */
+void variables_rollback(size_t mark)
+{
+    undo(&journal, mark);
+    saves--;
+}
+
+/**
+ * @brief Frees a stack of temporaries, without undoing them.
+ *
+ * @param stack     The stack of temporaries.
+ */
+static void discard(TEMPORARIES *stack)
+{
+    while (stack->count > 0)
+    {
+        TEMPORARY *t = &stack->entries[--stack->count];
+        free(t->saved);
+        free(t->name);
+    }
+}
+
+/**
+ * @brief Resets the variables to the environment of the commands run,
+ * e.g. for a script run in a copy of the shell, as if it were executed
+ * anew: the unexported variables are dropped, and the assignments to be
+ * undone are kept as they are.
+ */
+void variables_reset(void)
+{
+    char **envp = variables_environ();
+    HASHSET old = variables;
+
+    variables.elements = NULL;
+    variables.size = variables.capacity = 0;
+    discard(&temporaries);
+    discard(&journal);
+    saves = 0;
+
+    // The environment points into the old variables until it is rebuilt.
+    variables_init(envp);
+    changed = true;
+
+    ITERATOR it = hashset_iterator(&old);
+
+    while (it.has_next(&it))
+    {
+        free(it.next(&it));
+    }
+
+    free(old.elements);
+}
+
+/**
+ * @brief Gets the environment of the commands run: the exported
+ * variables. It is rebuilt only if they have changed.
+ *
+ * @return The environment, owned by the shell.
+ */
+char **variables_environ(void)
+{
+    if (!changed && (environment != NULL))
+    {
+        return environment;
+    }
+
+    if (environment_capacity < variables.size + 1)
+    {
+        environment_capacity = 2 * (variables.size + 1);
+        environment = realloc(environment, environment_capacity * sizeof(*environment));
+        check_allocation(environment);
+    }
+
+    size_t n = 0;
+    ITERATOR it = hashset_iterator(&variables);
+
+    while (it.has_next(&it))
+    {
+        VARIABLE *v = it.next(&it);
+
+        if (v->exported)
+        {
+            environment[n++] = v->entry;
+        }
+    }
+
+    environment[n] = NULL;
+    changed = false;
+    return environment;
+}
@@ -0,0 +1,919 @@
+/**
+ * @file    wildcard.c
+ * @author  Joshua Ng
+ * @brief   Expands the wildcards of a word, *, ?, [...] and **, into the
+ *          paths they match.
+ * @date    2026-10-18
+ */
+
+#include "wildcard.h"
+#include "expand.h"
+#include "globals.h"
+#include "hashset.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+/**
+ * The parser marks each unquoted *, ? and [ of a word, and a word with any
+ * is matched against the paths when it is expanded. Its pattern is
+ * compiled once, a program per path component, and each directory read
+ * is matched by the component's program, without backtracking beyond the
+ * last *. A component ** matches any number of directories.
+ *
+ * The listings of the directories read are cached, for the rest of the
+ * command line, and read again only if a directory has been modified, so
+ * that a/\*.c b/\*.c a/\*.h reads a/ once. A directory is read in large
+ * batches of entries, with getdents64 on Linux, each listing's names
+ * kept in one buffer. The paths matched are sorted in place, by a
+ * multikey quicksort, which compares only the chars after the prefix
+ * shared by a partition.
+ */
+
+#define DIRENT_BUFSIZE  (256 * 1024)    // The bytes of entries read at once.
+#define MIN_CAPACITY    16
+#define SORT_CUTOFF     16              // Partitions sorted by insertion.
+
+/**
+ * @brief An instruction of a component's program, matching a char.
+ */
+typedef enum
+{
+    OP_CHAR,        // The char c.
+    OP_ANY,         // ?, any char.
+    OP_STAR,        // *, any chars.
+    OP_CLASS,       // [...], a char of the set.
+} OPCODE;
+
+typedef struct
+{
+    OPCODE          code;
+    unsigned char   c;
+    uint8_t         set[32];    // A bit per char, of a class.
+} OP;
+
+/**
+ * @brief A component of a pattern, between its /s.
+ */
+typedef struct
+{
+    OP      *ops;
+    size_t  nops;
+    char    *text;      // The text of a component without wildcards.
+    bool    literal;    // True if it has no wildcards.
+    bool    globstar;   // True if it is **.
+    bool    dot;        // True if it starts with a '.', matching hidden names.
+} COMPONENT;
+
+/**
+ * @brief The entries of a directory.
+ */
+typedef struct
+{
+    char            *path;      // The path, "" for the current directory.
+    dev_t           dev;
+    ino_t           ino;
+    struct timespec mtime;      // Modified since, the listing is read again.
+    char            *names;     // The names, each ending with a '\0'.
+    size_t          length, capacity;
+    size_t          *offsets;   // The offsets of each name
+    unsigned char   *types;     // and its d_type.
+    size_t          n, ncapacity;
+} LISTING;
+
+/**
+ * @brief A list of paths.
+ */
+typedef struct
+{
+    char    **paths;
+    size_t  n, capacity;
+} PATHS;
+
+static size_t hash_listing(const void *listing);
+static bool listings_equals(const void *listing1, const void *listing2);
+
+static HASHSET listings = {.interface = {.hash = hash_listing,
+    .equals = listings_equals}};
+
+/**
+ * @brief Compute the hash of a listing's path (FNV-1a).
+ * @param listing The listing to be hashed.
+ * @return The hash of the listing.
+ */
+static size_t hash_listing(const void *listing)
+{
+    size_t hash = (size_t) 2166136261u;
+
+    for (const char *ch = ((const LISTING *) listing)->path; *ch; ch++)
+    {
+        hash = (hash ^ (unsigned char) *ch) * 16777619u;
+    }
+
+    return hash;
+}
+
+/**
+ * @brief Check if two listings are of the same path.
+ * @param listing1 The first listing.
+ * @param listing2 The second listing.
+ * @return True if the paths equal each other.
+ */
+static bool listings_equals(const void *listing1, const void *listing2)
+{
+    return strcmp(((const LISTING *) listing1)->path,
+        ((const LISTING *) listing2)->path) == 0;
+}
+
+/**
+ * @brief Resize the listings set capacity.
+ * @param capacity The new capacity.
+ */
+static void resize_listings_capacity(size_t capacity)
+{
+    void *elements = calloc(capacity, sizeof(void *));
+    check_allocation(elements);
+
+    if (listings.capacity == 0)
+    {
+        listings.elements = elements;
+        listings.capacity = capacity;
+        return;
+    }
+
+    void *old = hashset_resize(&listings, elements, capacity);
+    if (old == NULL)
+    {
+        fprintf(stderr, "%s: unable to resize directory cache capacity\n", name0);
+        exit(EXIT_FAILURE);
+    }
+    free(old);
+}
+
+/**
+ * @brief Gets the time a directory was last modified.
+ *
+ * @param sb    The directory's status.
+ * @return The time modified.
+ */
+static struct timespec modified(const struct stat *sb)
+{
+#if defined(__APPLE__)
+    return sb->st_mtimespec;
+#else
+    return sb->st_mtim;
+#endif
+}
+
+/**
+ * @brief Adds an entry to a listing.
+ *
+ * @param l     The listing.
+ * @param name  The entry's name.
+ * @param type  The entry's d_type.
+ */
+static void add_entry(LISTING *l, const char *name, unsigned char type)
+{
+    if ((name[0] == '.') && ((name[1] == '\0') || ((name[1] == '.') && (name[2] == '\0'))))
+    {
+        return;
+    }
+
+    size_t size = strlen(name) + 1;
+
+    if (l->length + size > l->capacity)
+    {
+        l->capacity = 2 * (l->length + size);
+        l->names = realloc(l->names, l->capacity);
+        check_allocation(l->names);
+    }
+
+    if (l->n == l->ncapacity)
+    {
+        l->ncapacity = (l->ncapacity == 0) ? 64 : 2 * l->ncapacity;
+        l->offsets = realloc(l->offsets, l->ncapacity * sizeof(*l->offsets));
+        l->types = realloc(l->types, l->ncapacity * sizeof(*l->types));
+        check_allocation(l->offsets);
+        check_allocation(l->types);
+    }
+
+    memcpy(l->names + l->length, name, size);
+    l->offsets[l->n] = l->length;
+    l->types[l->n++] = type;
+    l->length += size;
+}
+
+#if defined(__linux__)
+/**
+ * @brief A directory entry, as getdents64 returns them.
+ */
+struct linux_dirent64
+{
+    uint64_t        d_ino;
+    int64_t         d_off;
+    unsigned short  d_reclen;
+    unsigned char   d_type;
+    char            d_name[];
+};
+
+/**
+ * @brief Reads a directory's entries, in large batches.
+ *
+ * @param fd    The open directory.
+ * @param l     The listing to add them to.
+ */
+static void read_entries(int fd, LISTING *l)
+{
+    static char *buffer = NULL;
+
+    if (buffer == NULL)
+    {
+        buffer = malloc(DIRENT_BUFSIZE);
+        check_allocation(buffer);
+    }
+
+    long n;
+
+    while ((n = syscall(SYS_getdents64, fd, buffer, DIRENT_BUFSIZE)) > 0)
+    {
+        for (long offset = 0; offset < n; )
+        {
+            struct linux_dirent64 *d = (struct linux_dirent64 *) (buffer + offset);
+            add_entry(l, d->d_name, d->d_type);
+            offset += d->d_reclen;
+        }
+    }
+
+    close(fd);
+}
+#else
+/**
+ * @brief Reads a directory's entries.
+ *
+ * @param fd    The open directory.
+ * @param l     The listing to add them to.
+ */
+static void read_entries(int fd, LISTING *l)
+{
+    DIR *dir = fdopendir(fd);
+
+    if (dir == NULL)
+    {
+        close(fd);
+        return;
+    }
+
+    struct dirent *d;
+
+    while ((d = readdir(dir)) != NULL)
+    {
+        add_entry(l, d->d_name, d->d_type);
+    }
+
+    closedir(dir);
+}
+#endif
+
+/**
+ * @brief Gets the listing of a directory, from the cache unless the
+ * directory has been modified since it was read.
+ *
+ * @param path  The directory's path, "" for the current directory.
+ * @return The listing, or NULL if the directory could not be read.
+ */
+static LISTING *get_listing(const char *path)
+{
+    const char *directory = (path[0] != '\0') ? path : ".";
+    struct stat sb;
+
+    if (stat(directory, &sb) == -1)
+    {
+        return NULL;
+    }
+
+    LISTING key = {.path = (char *) path};
+    LISTING *l = (listings.size > 0) ? hashset_find(&listings, &key) : NULL;
+    struct timespec mtime = modified(&sb);
+
+    if ((l != NULL) && (l->dev == sb.st_dev) && (l->ino == sb.st_ino)
+        && (l->mtime.tv_sec == mtime.tv_sec) && (l->mtime.tv_nsec == mtime.tv_nsec))
+    {
+        return l;
+    }
+
+    int fd = open(directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    if (fd == -1)
+    {
+        return NULL;
+    }
+
+    if (l == NULL)
+    {
+        l = calloc(1, sizeof(LISTING));
+        check_allocation(l);
+        l->path = strdup(path);
+        check_allocation(l->path);
+
+        if (listings.capacity == 0)
+        {
+            resize_listings_capacity(MIN_CAPACITY);
+        }
+
+        hashset_insert(&listings, l);
+
+        if (listings.size > listings.capacity / 2)
+        {
+            resize_listings_capacity(listings.capacity * 2);
+        }
+    }
+
+    l->dev = sb.st_dev;
+    l->ino = sb.st_ino;
+    l->mtime = mtime;
+    l->length = 0;
+    l->n = 0;
+    read_entries(fd, l);
+    return l;
+}
+
+/**
+ * @brief Forgets the directories read, at the start of each command line.
+ */
+void wildcard_revalidate(void)
+{
+    for (size_t i = 0; i < listings.capacity; i++)
+    {
+        LISTING *l = listings.elements[i];
+
+        if (l != NULL)
+        {
+            free(l->path);
+            free(l->names);
+            free(l->offsets);
+            free(l->types);
+            free(l);
+            listings.elements[i] = NULL;
+        }
+    }
+
+    listings.size = 0;
+}
+
+/**
+ * @brief Gets the char a wildcard marker stands for.
+ *
+ * @param c     The char, or marker.
+ * @return The char.
+ */
+static char unmark(char c)
+{
+    switch (c)
+    {
+    case EXPAND_STAR:       return '*';
+    case EXPAND_QUESTION:   return '?';
+    case EXPAND_BRACKET:    return '[';
+    default:                return c;
+    }
+}
+
+/**
+ * @brief Checks if text has any wildcards.
+ *
+ * @param word      The text.
+ * @param length    The length of the text.
+ * @return True if the text has a marked *, ? or [.
+ */
+bool wildcard_marked(const char *word, size_t length)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        if (unmark(word[i]) != word[i])
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief Gets a pattern as it was written, for a pattern matching nothing.
+ *
+ * @param pattern   The pattern.
+ * @param arena     The arena to allocate from.
+ * @return The pattern's text.
+ */
+char *wildcard_literal(const char *pattern, ARENA *arena)
+{
+    char *literal = arena_strdup(arena, pattern);
+
+    for (char *ch = literal; *ch != '\0'; ch++)
+    {
+        *ch = unmark(*ch);
+    }
+
+    return literal;
+}
+
+/**
+ * @brief Compiles a class, [...], into a set of chars.
+ *
+ * @param s     The class, after the [.
+ * @param end   The end of the component.
+ * @param op    The op to set.
+ * @return The end of the class, after the ], or NULL if it has none.
+ */
+static const char *compile_class(const char *s, const char *end, OP *op)
+{
+    bool negate = (s < end) && ((*s == '!') || (*s == '^'));
+    const char *start = s += negate;
+
+    memset(op->set, 0, sizeof(op->set));
+    op->code = OP_CLASS;
+
+    // A ] first is a member of the class.
+    for (; (s < end) && ((*s != ']') || (s == start)); s++)
+    {
+        unsigned char lo = unmark(*s), hi = lo;
+
+        if ((s + 2 < end) && (s[1] == '-') && (s[2] != ']'))
+        {
+            hi = unmark(s[2]);
+            s += 2;
+        }
+
+        for (unsigned c = lo; c <= hi; c++)
+        {
+            op->set[c / 8] |= 1u << (c % 8);
+        }
+    }
+
+    if (s >= end)
+    {
+        return NULL;
+    }
+
+    if (negate)
+    {
+        for (size_t i = 0; i < sizeof(op->set); i++)
+        {
+            op->set[i] = ~op->set[i];
+        }
+    }
+
+    op->set[0] &= ~1u;  // Never the '\0'.
+    return s + 1;
+}
+
+/**
+ * @brief Compiles a component of a pattern into its program.
+ *
+ * @param s         The component.
+ * @param end       The end of the component.
+ * @param c         The component to set.
+ * @param arena     The arena to allocate from.
+ */
+static void compile_component(const char *s, const char *end, COMPONENT *c,
+    ARENA *arena)
+{
+    c->ops = arena_alloc(arena, (end - s) * sizeof(OP));
+    c->nops = 0;
+    c->literal = true;
+    c->dot = (*s == '.');
+
+    while (s < end)
+    {
+        OP *op = &c->ops[c->nops];
+        const char *next = NULL;
+
+        switch (*s)
+        {
+        case EXPAND_STAR:
+            op->code = OP_STAR;
+            next = s + 1;
+            break;
+        case EXPAND_QUESTION:
+            op->code = OP_ANY;
+            next = s + 1;
+            break;
+        case EXPAND_BRACKET:
+            next = compile_class(s + 1, end, op);
+            break;
+        default:
+            break;
+        }
+
+        if (next == NULL)
+        {
+            op->code = OP_CHAR;
+            op->c = unmark(*s);
+            next = s + 1;
+        }
+
+        c->literal &= (op->code == OP_CHAR);
+
+        // A run of *s is one *.
+        if ((op->code != OP_STAR) || (c->nops == 0) || (op[-1].code != OP_STAR))
+        {
+            c->nops++;
+        }
+
+        s = next;
+    }
+
+    c->globstar = false;
+    c->text = NULL;
+
+    if (c->literal)
+    {
+        c->text = arena_alloc(arena, c->nops + 1);
+
+        for (size_t i = 0; i < c->nops; i++)
+        {
+            c->text[i] = c->ops[i].c;
+        }
+
+        c->text[c->nops] = '\0';
+    }
+}
+
+/**
+ * @brief Matches a name against a component's program. A mismatch after a
+ * * retries from the char after the one the * last stopped at.
+ *
+ * @param c     The component.
+ * @param name  The name.
+ * @return True if the name matches.
+ */
+static bool match(const COMPONENT *c, const char *name)
+{
+    const OP *ops = c->ops;
+    size_t p = 0, star = SIZE_MAX;
+    const char *n = name, *resume = NULL;
+
+    if ((name[0] == '.') && !c->dot)
+    {
+        return false;   // Hidden names match only a leading '.'.
+    }
+
+    while (*n != '\0')
+    {
+        unsigned char ch = *n;
+
+        if ((p < c->nops) && (ops[p].code == OP_STAR))
+        {
+            star = ++p;
+            resume = n;
+            continue;
+        }
+
+        if ((p < c->nops) &&
+            ((ops[p].code == OP_ANY)
+            || ((ops[p].code == OP_CHAR) && (ops[p].c == ch))
+            || ((ops[p].code == OP_CLASS) && (ops[p].set[ch / 8] & (1u << (ch % 8))))))
+        {
+            p++;
+            n++;
+            continue;
+        }
+
+        if (star == SIZE_MAX)
+        {
+            return false;
+        }
+
+        p = star;
+        n = ++resume;
+    }
+
+    while ((p < c->nops) && (ops[p].code == OP_STAR))
+    {
+        p++;
+    }
+
+    return p == c->nops;
+}
+
+/**
+ * @brief Adds a path to a list.
+ *
+ * @param paths     The list.
+ * @param path      The path.
+ */
+static void add_path(PATHS *paths, char *path)
+{
+    if (paths->n == paths->capacity)
+    {
+        paths->capacity = (paths->capacity == 0) ? MIN_CAPACITY : 2 * paths->capacity;
+        paths->paths = realloc(paths->paths, paths->capacity * sizeof(*paths->paths));
+        check_allocation(paths->paths);
+    }
+
+    paths->paths[paths->n++] = path;
+}
+
+/**
+ * @brief Joins a directory's path and a name.
+ *
+ * @param directory     The directory, "" for the current directory.
+ * @param name          The name.
+ * @param arena         The arena to allocate from.
+ * @return The path.
+ */
+static char *join(const char *directory, const char *name, ARENA *arena)
+{
+    size_t length = strlen(directory);
+    bool slash = (length > 0) && (directory[length - 1] != '/');
+    char *path = arena_alloc(arena, length + slash + strlen(name) + 1);
+
+    memcpy(path, directory, length);
+    path[length] = '/';
+    strcpy(path + length + slash, name);
+    return path;
+}
+
+/**
+ * @brief Checks if an entry is a directory, from its d_type if known.
+ *
+ * @param path      The entry's path.
+ * @param type      The entry's d_type.
+ * @param follow    True to follow a symbolic link.
+ * @return True if the entry is a directory.
+ */
+static bool is_directory(const char *path, unsigned char type, bool follow)
+{
+    if ((type != DT_UNKNOWN) && ((type != DT_LNK) || !follow))
+    {
+        return (type == DT_DIR);
+    }
+
+    struct stat sb;
+    return ((follow ? stat(path, &sb) : lstat(path, &sb)) == 0) && S_ISDIR(sb.st_mode);
+}
+
+/**
+ * @brief Adds the paths below a directory, for a **, without following
+ * symbolic links or entering hidden directories.
+ *
+ * @param directory     The directory.
+ * @param directories   True to add only directories.
+ * @param paths         The list to add to.
+ * @param arena         The arena to allocate from.
+ */
+static void descend(const char *directory, bool directories, PATHS *paths,
+    ARENA *arena)
+{
+    LISTING *l = get_listing(directory);
+
+    for (size_t i = 0; (l != NULL) && (i < l->n); i++)
+    {
+        const char *name = l->names + l->offsets[i];
+
+        if (name[0] == '.')
+        {
+            continue;
+        }
+
+        char *path = join(directory, name, arena);
+        bool isdir = is_directory(path, l->types[i], false);
+
+        if (isdir || !directories)
+        {
+            add_path(paths, path);
+        }
+
+        if (isdir)
+        {
+            descend(path, directories, paths, arena);
+        }
+    }
+}
+
+/**
+ * @brief Compares two paths, after the chars they are known to share.
+ *
+ * @param a         The first path.
+ * @param b         The second path.
+ * @param depth     The length of their shared prefix.
+ * @return < 0, 0 or > 0, as a sorts before, with, or after b.
+ */
+static int compare(const char *a, const char *b, size_t depth)
+{
+    return strcmp(a + depth, b + depth);
+}
+
+/**
+ * @brief Gets the char of a path at a depth.
+ *
+ * @param path      The path.
+ * @param depth     The depth, not beyond its '\0'.
+ * @return The char.
+ */
+#define char_at(path, depth) ((unsigned char) (path)[depth])
+
+/**
+ * @brief Sorts paths in place, by a multikey quicksort: partitioned by
+ * the char at a depth, the paths equal there are sorted from the next.
+ *
+ * @param v         The paths.
+ * @param n         The number of paths.
+ * @param depth     The length of the prefix the paths share.
+ */
+static void sort_paths(char **v, size_t n, size_t depth)
+{
+    while (n > SORT_CUTOFF)
+    {
+        // The median of three chars is the pivot.
+        int a = char_at(v[0], depth);
+        int b = char_at(v[n / 2], depth);
+        int c = char_at(v[n - 1], depth);
+        int pivot = (a < b) ? ((b < c) ? b : ((a < c) ? c : a))
+                            : ((a < c) ? a : ((b < c) ? c : b));
+
+        size_t lt = 0, i = 0, gt = n;
+
+        while (i < gt)
+        {
+            int ch = char_at(v[i], depth);
+            char *t = v[i];
+
+            if (ch < pivot)
+            {
+                v[i++] = v[lt];
+                v[lt++] = t;
+            }
+            else if (ch > pivot)
+            {
+                v[i] = v[--gt];
+                v[gt] = t;
+            }
+            else
+            {
+                i++;
+            }
+        }
+
+        sort_paths(v, lt, depth);
+
+        if (pivot != '\0')
+        {
+            sort_paths(v + lt, gt - lt, depth + 1);
+        }
+
+        v += gt;
+        n -= gt;
+    }
+
+    for (size_t i = 1; i < n; i++)
+    {
+        char *t = v[i];
+        size_t j = i;
+
+        for (; (j > 0) && (compare(v[j - 1], t, depth) > 0); j--)
+        {
+            v[j] = v[j - 1];
+        }
+
+        v[j] = t;
+    }
+}
+
+/**
+ * @brief Matches a component against the entries of each directory.
+ *
+ * @param c         The component.
+ * @param last      True if it is the pattern's last component.
+ * @param from      The directories.
+ * @param to        The list to add the paths matched to.
+ * @param arena     The arena to allocate from.
+ */
+static void match_component(const COMPONENT *c, bool last, PATHS *from,
+    PATHS *to, ARENA *arena)
+{
+    for (size_t d = 0; d < from->n; d++)
+    {
+        const char *directory = from->paths[d];
+
+        if (c->literal)
+        {
+            add_path(to, join(directory, c->text, arena));
+            continue;
+        }
+
+        if (c->globstar)
+        {
+            if (!last)
+            {
+                add_path(to, (char *) directory);
+            }
+
+            descend(directory, !last, to, arena);
+            continue;
+        }
+
+        LISTING *l = get_listing(directory);
+
+        for (size_t i = 0; (l != NULL) && (i < l->n); i++)
+        {
+            const char *name = l->names + l->offsets[i];
+
+            if (!match(c, name))
+            {
+                continue;
+            }
+
+            char *path = join(directory, name, arena);
+
+            // Only directories are searched for the next component.
+            if (last || is_directory(path, l->types[i], true))
+            {
+                add_path(to, path);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Expands a pattern into the paths it matches, sorted.
+ *
+ * @param pattern   The pattern, its wildcards marked.
+ * @param arena     The arena to allocate the paths from.
+ * @param paths     Set to the memory allocated array of paths.
+ * @return The number of paths, 0 if it matches none, or has no wildcards.
+ */
+size_t wildcard_expand(const char *pattern, ARENA *arena, char ***paths)
+{
+    size_t ncomponents = 0;
+    COMPONENT *components = arena_alloc(arena,
+        (strlen(pattern) / 2 + 1) * sizeof(*components));
+    bool literal = true;
+
+    // Empty components, of a // or a trailing /, are skipped.
+    for (const char *s = pattern; *s != '\0'; )
+    {
+        const char *end = s + strcspn(s, "/");
+
+        if (end > s)
+        {
+            COMPONENT *c = &components[ncomponents++];
+            compile_component(s, end, c, arena);
+            c->globstar = !c->literal && (end - s == 2)
+                && (s[0] == EXPAND_STAR) && (s[1] == EXPAND_STAR);
+            literal &= c->literal;
+        }
+
+        s = end + (*end == '/');
+    }
+
+    *paths = NULL;
+
+    if (literal)
+    {
+        return 0;
+    }
+
+    bool directories = (pattern[strlen(pattern) - 1] == '/');
+    PATHS from = {0}, to = {0};
+    add_path(&from, (pattern[0] == '/') ? "/" : "");
+
+    for (size_t i = 0; i < ncomponents; i++)
+    {
+        to.n = 0;
+        match_component(&components[i], i + 1 == ncomponents, &from, &to, arena);
+        PATHS swap = from;
+        from = to;
+        to = swap;
+    }
+
+    free(to.paths);
+
+    // A last component without wildcards, or a trailing /, is checked.
+    size_t n = 0;
+    bool check = components[ncomponents - 1].literal || directories;
+
+    for (size_t i = 0; i < from.n; i++)
+    {
+        struct stat sb;
+
+        if (check && ((lstat(from.paths[i], &sb) == -1)
+            || (directories && !is_directory(from.paths[i], DT_UNKNOWN, true))))
+        {
+            continue;
+        }
+
+        from.paths[n++] = directories ? join(from.paths[i], "", arena) : from.paths[i];
+    }
+
+    sort_paths(from.paths, n, 0);
+    *paths = from.paths;
+    return n;
+}